@@ -0,0 +1,643 @@
+// BatchRunner.cpp : Headless runner executing a list of ROMs as fast as possible across all cores.
+//
+// Usage: BatchRunner [--engine reference|fast|jit|batch] [--variant chip8|schip|xochip] [--quirks vip|chip48|schip|octo] [--threads N]
+//                    [--instructions-per-tick N] [--frames <directory>] [--analyse] <manifest>
+//
+// Each non-empty line of the manifest that doesn't start with # describes one job:
+//   <rom path> <input script path or -> <instruction budget>
+//
+// Input scripts contain one key event per line:
+//   <instruction count> <key (hex)> <down|up>
+// Events are applied once the program has executed the given number of instructions. If the program is waiting for a key (FX0A) the next event is applied
+// immediately so scripts don't need to know exactly when a program starts waiting.
+//
+// A binary input log recorded by ConsoleUI --record (see Chip8InputLog) can be given in place of an input script. The VM emulates the variant and quirks
+// the log was recorded with whatever --variant and --quirks say, falling back to another engine as below if need be. It is seeded and its timers clocked
+// as they were when recording and the log is replayed up to its recorded length, or the budget if that is shorter (a budget of 0 replays the whole log).
+// Jobs without a log run with seed 0 on every engine.
+//
+// Timers are clocked by the instruction count (every --instructions-per-tick instructions, default 10) instead of the system clock, so the output of a job
+// only depends on the ROM, the input script and the budget.
+//
+// The batch engine runs every job sharing a ROM and a timer rate as lanes of a single Chip8BatchVm instead of giving each job its own VM. All lanes of a
+// VM tick together, so jobs replaying logs recorded at another rate than --instructions-per-tick only share a VM with logs recorded at the same rate.
+//
+// The display= field of each result is the hash every display keeps up to date as it's drawn to (see Chip8Display::getHash()), so identical final frames
+// can be found by comparing it without hashing any pixels here.
+//
+// Each ROM file is memory mapped once and shared by every job running it (see RomCache), along with the fast engine's pre-classified image of it.
+//
+// SUPER-CHIP and XO-CHIP programs (--variant schip|xochip) are only supported by the reference engine, which is used for them whatever --engine says.
+//
+// --quirks picks the platform whose behaviour to emulate (see Chip8Quirks), Octo by default. The batch engine only implements the Octo quirks, the fast
+// engine is used in its place for other platforms.
+//
+// One line is printed per job, in manifest order, with the final state of the VM. The aggregate throughput is reported on stderr.
+//
+// --frames records the display of every job to <directory>/<job>.c8fs, numbering jobs from 0 in manifest order. A frame is written every timer tick (every
+// instructions per tick instructions) plus one for the final state, compressed as described in Chip8FrameWriter. FrameDecoder turns them into images.
+//
+// With --analyse nothing is run, the static analysis of each ROM in the manifest (see Chip8RomAnalysis) is printed instead: its basic blocks and
+// subroutines, self-modifying writes, invalid instructions reachable from the entry point and bytes found to be neither code nor data.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Emulator/Chip8BatchVm.h"
+#include "../Emulator/Chip8FastVm.h"
+#include "../Emulator/Chip8FrameStream.h"
+#include "../Emulator/Chip8InputLog.h"
+#include "../Emulator/Chip8ReferenceVm.h"
+#include "../Emulator/Chip8Rom.h"
+
+struct KeyEvent {
+	unsigned long instruction;
+	uint_fast8_t key;
+	bool pressed;
+};
+typedef std::vector<KeyEvent> input_script_type;
+
+struct Job {
+	std::filesystem::path rom_path;
+	std::filesystem::path input_path;
+	unsigned long budget;
+	std::filesystem::path frames_path; // Empty unless recording frames
+};
+
+struct JobResult {
+	bool loaded = false;
+	unsigned long instructions = 0;
+	uint_fast16_t pc = 0;
+	uint_fast16_t i = 0;
+	std::array<uint8_t, 16> v{};
+	uint64_t display_hash = 0;
+	const char *state = "";
+};
+
+enum class Engine {
+	Reference,
+	Fast,
+	Jit,
+	Batch
+};
+
+constexpr unsigned long DEFAULT_INSTRUCTIONS_PER_TICK = 10;
+
+// The engine to use in place of the requested one for the given instruction set and quirks, the fast engine and batch engine only implement a subset.
+Engine supported_engine(Engine engine, Chip8ReferenceVm::Variant variant, Chip8Platform platform) {
+	if (variant != Chip8ReferenceVm::Variant::Chip8) {
+		return Engine::Reference;
+	}
+	if (engine == Engine::Batch && platform != Chip8Platform::Octo) {
+		return Engine::Fast;
+	}
+	return engine;
+}
+
+/**
+* ROMs shared between jobs, safe to use from every worker thread.
+*
+* Manifests for large runs name the same ROM over and over with different inputs, each file is only mapped (and classified for the fast engine) by the
+* first job to need it. Jobs wanting the same ROM wait for it meanwhile, jobs running other ROMs don't.
+*/
+class RomCache {
+public:
+	struct Entry {
+		std::shared_ptr<const Chip8Rom> rom; // nullptr if the file couldn't be read
+		std::shared_ptr<const Chip8FastVm::Image> image; // Only built when asked for
+	};
+
+	Entry load(const std::filesystem::path &file_name, bool with_image) {
+		Slot *slot;
+		{
+			// Nodes of a map stay put, the slot can be used once the cache is unlocked
+			std::scoped_lock lock(this->mutex);
+			slot = &this->slots[file_name];
+		}
+
+		std::scoped_lock lock(slot->mutex);
+		auto &entry = slot->entry;
+		if (!entry.rom) {
+			entry.rom = Chip8Rom::map(file_name);
+		}
+		if (entry.rom && with_image && !entry.image) {
+			entry.image = std::make_shared<const Chip8FastVm::Image>(entry.rom->getData());
+		}
+		return entry;
+	}
+
+private:
+	struct Slot {
+		std::mutex mutex;
+		Entry entry;
+	};
+
+	std::mutex mutex;
+	std::map<std::filesystem::path, Slot> slots;
+};
+
+bool read_input_log(const std::filesystem::path &file_name, Chip8InputLog &log) {
+	std::ifstream file(file_name, std::ios::binary);
+	return file && log.read(file);
+}
+
+// Key events of a recorded log in the form used by input scripts, for the batch engine.
+input_script_type to_input_script(const Chip8InputLog &log) {
+	input_script_type script;
+	for (const auto &event : log.events) {
+		script.push_back({ static_cast<unsigned long>(event.instruction), event.key, event.pressed });
+	}
+	return script;
+}
+
+unsigned long replay_budget(const Job &job, const Chip8InputLog &log) {
+	return job.budget == 0 ? static_cast<unsigned long>(log.length) : static_cast<unsigned long>(std::min<unsigned long long>(job.budget, log.length));
+}
+
+bool read_input_script(const std::filesystem::path &file_name, input_script_type &script) {
+	std::ifstream file(file_name);
+	if (!file) {
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		KeyEvent event;
+		unsigned key;
+		std::string direction;
+		if (line.empty() || line[0] == '#' || !(fields >> event.instruction >> std::hex >> key >> direction) || key > 0xF) {
+			continue;
+		}
+		event.key = static_cast<uint_fast8_t>(key);
+		event.pressed = direction == "down";
+		script.push_back(event);
+	}
+
+	std::stable_sort(script.begin(), script.end(), [](const KeyEvent &a, const KeyEvent &b) { return a.instruction < b.instruction; });
+	return true;
+}
+
+std::vector<Job> read_manifest(std::istream &manifest) {
+	std::vector<Job> jobs;
+
+	std::string line;
+	while (std::getline(manifest, line)) {
+		std::istringstream fields(line);
+		std::string rom_path, input_path;
+		Job job;
+		if (line.empty() || line[0] == '#' || !(fields >> rom_path >> input_path >> job.budget)) {
+			continue;
+		}
+		job.rom_path = rom_path;
+		if (input_path != "-") {
+			job.input_path = input_path;
+		}
+		jobs.push_back(job);
+	}
+
+	return jobs;
+}
+
+template<typename Vm>
+void store_result(const Vm &vm, unsigned long executed, JobResult &result) {
+	result.instructions = executed;
+	result.pc = vm.getProgramCounter();
+	result.i = vm.getAddressRegister();
+	result.v = vm.getRegisters();
+	result.display_hash = vm.getDisplayBuffer().getHash();
+	result.state = vm.isRunning() ? "running" : vm.isLive() ? "blocked" : "halted";
+}
+
+/**
+* Frames for one job, or nothing when it isn't recording.
+*
+* A frame is written every interval instructions, so runs stop at each frame boundary as they would at an input event.
+*/
+class FrameRecorder {
+public:
+	FrameRecorder(const std::filesystem::path &path, unsigned long interval) :
+		interval(std::max(interval, 1ul))
+	{
+		if (!path.empty()) {
+			this->file.open(path, std::ios::binary);
+			this->writer.emplace(this->file);
+		}
+	}
+
+	// Where the next run has to stop, at most target
+	unsigned long limit(unsigned long target) const {
+		return this->writer ? std::min(target, this->next) : target;
+	}
+
+	// Called whenever a run stops
+	void update(const Chip8Display &display, unsigned long executed) {
+		if (this->writer && executed == this->next) {
+			this->writer->write(display);
+			this->next += this->interval;
+		}
+	}
+
+	// The final state, unless it was just written as a frame
+	void finish(const Chip8Display &display, unsigned long executed) {
+		if (this->writer && executed + this->interval != this->next) {
+			this->writer->write(display);
+		}
+	}
+
+private:
+	unsigned long interval;
+	unsigned long next = interval;
+	std::ofstream file;
+	std::optional<Chip8FrameWriter> writer;
+};
+
+template<typename Vm>
+void run_job(Vm &vm, unsigned long budget, const input_script_type &script, FrameRecorder &frames, JobResult &result) {
+	auto event = script.cbegin();
+	unsigned long executed = 0;
+
+	while (executed < budget && vm.isLive()) {
+		while (event != script.cend() && (event->instruction <= executed || !vm.isRunning())) {
+			vm.setKeyState(event->key, event->pressed);
+			++event;
+		}
+
+		if (!vm.isRunning()) {
+			// Waiting for a key that is never going to arrive
+			break;
+		}
+
+		auto target = frames.limit(event != script.cend() ? std::min(budget, event->instruction) : budget);
+		executed += vm.run(target - executed);
+		frames.update(vm.getDisplayBuffer(), executed);
+	}
+
+	frames.finish(vm.getDisplayBuffer(), executed);
+	store_result(vm, executed, result);
+}
+
+// Runs the same way as Chip8InputLog::replay(), through run_job so frames can be recorded.
+template<typename Vm>
+void replay_job(Vm &vm, const Job &job, const Chip8InputLog &log, JobResult &result) {
+	vm.seed(log.seed);
+	vm.setTimerMode(Vm::TimerMode::Instruction, log.instructions_per_tick);
+	FrameRecorder frames(job.frames_path, log.instructions_per_tick);
+	run_job(vm, replay_budget(job, log), to_input_script(log), frames, result);
+}
+
+void run_job(RomCache &roms, Engine engine, Chip8ReferenceVm::Variant variant, Chip8Platform platform, unsigned long instructions_per_tick, const Job &job, JobResult &result) {
+	input_script_type script;
+	Chip8InputLog log;
+	bool recorded = !job.input_path.empty() && read_input_log(job.input_path, log);
+	if (recorded) {
+		variant = log.variant;
+		platform = log.platform;
+		engine = supported_engine(engine, variant, platform);
+	}
+	auto cached = roms.load(job.rom_path, engine != Engine::Reference);
+	if (!cached.rom || (!job.input_path.empty() && !recorded && !read_input_script(job.input_path, script))) {
+		return;
+	}
+	result.loaded = true;
+
+	switch (engine)
+	{
+	case Engine::Reference: {
+		Chip8ReferenceVm vm(cached.rom->getData(), variant, platform);
+		if (recorded) {
+			replay_job(vm, job, log, result);
+			break;
+		}
+		vm.setTimerMode(Chip8ReferenceVm::TimerMode::Instruction, instructions_per_tick);
+		FrameRecorder frames(job.frames_path, instructions_per_tick);
+		run_job(vm, job.budget, script, frames, result);
+		break;
+	}
+
+	case Engine::Batch:
+	case Engine::Fast:
+	case Engine::Jit: {
+		Chip8FastVm vm(*cached.image, platform);
+		vm.setJitEnabled(engine == Engine::Jit);
+		if (recorded) {
+			replay_job(vm, job, log, result);
+			break;
+		}
+		vm.setTimerMode(Chip8FastVm::TimerMode::Instruction, instructions_per_tick);
+		FrameRecorder frames(job.frames_path, instructions_per_tick);
+		run_job(vm, job.budget, script, frames, result);
+		break;
+	}
+	}
+}
+
+// Runs a group of jobs that all use the same ROM and timer rate as lanes of one Chip8BatchVm.
+void run_batch(RomCache &roms, unsigned long instructions_per_tick, const std::vector<Job> &jobs, const std::vector<std::size_t> &group, std::vector<JobResult> &results) {
+	auto rom = group.empty() ? nullptr : roms.load(jobs[group.front()].rom_path, false).rom;
+	if (!rom) {
+		return;
+	}
+
+	std::vector<std::size_t> lane_jobs;
+	std::vector<input_script_type> scripts;
+	std::vector<unsigned long> budgets;
+	std::vector<std::pair<std::size_t, uint32_t>> seeds;
+	for (auto job : group) {
+		input_script_type script;
+		Chip8InputLog log;
+		auto budget = jobs[job].budget;
+		if (!jobs[job].input_path.empty()) {
+			if (read_input_log(jobs[job].input_path, log)) {
+				if (supported_engine(Engine::Batch, log.variant, log.platform) != Engine::Batch) {
+					// Recorded on a VM the batch engine doesn't emulate, runs on its own
+					run_job(roms, Engine::Batch, log.variant, log.platform, instructions_per_tick, jobs[job], results[job]);
+					continue;
+				}
+				script = to_input_script(log);
+				budget = replay_budget(jobs[job], log);
+				seeds.emplace_back(lane_jobs.size(), log.seed);
+			}
+			else if (!read_input_script(jobs[job].input_path, script)) {
+				continue;
+			}
+		}
+		results[job].loaded = true;
+		lane_jobs.push_back(job);
+		scripts.push_back(std::move(script));
+		budgets.push_back(budget);
+	}
+
+	if (lane_jobs.empty()) {
+		return;
+	}
+
+	Chip8BatchVm vm(rom->getData(), lane_jobs.size());
+	vm.setInstructionsPerTick(instructions_per_tick);
+	for (auto [lane, seed] : seeds) {
+		vm.seed(lane, seed);
+	}
+
+	std::vector<input_script_type::const_iterator> events;
+	for (const auto &script : scripts) {
+		events.push_back(script.cbegin());
+	}
+
+	std::deque<FrameRecorder> frames;
+	for (auto job : lane_jobs) {
+		frames.emplace_back(jobs[job].frames_path, instructions_per_tick);
+	}
+
+	// Same as run_job for a single VM, except each lane is stopped at its next input event (or frame) through its instruction limit and all lanes run
+	// together. Once no lane makes progress every job has used its budget, halted, or is waiting for a key that is never going to arrive.
+	do {
+		for (std::size_t lane = 0; lane < lane_jobs.size(); ++lane) {
+			const auto budget = budgets[lane];
+			auto &event = events[lane];
+			auto executed = vm.getInstructionCount(lane);
+			frames[lane].update(vm.getDisplayBuffer(lane), static_cast<unsigned long>(executed));
+
+			if (executed < budget && vm.isLive(lane)) {
+				while (event != scripts[lane].cend() && (event->instruction <= executed || !vm.isRunning(lane))) {
+					vm.setKeyState(lane, event->key, event->pressed);
+					++event;
+				}
+			}
+
+			vm.setInstructionLimit(lane, frames[lane].limit(event != scripts[lane].cend() ? std::min(budget, event->instruction) : budget));
+		}
+	} while (vm.run() > 0);
+
+	for (std::size_t lane = 0; lane < lane_jobs.size(); ++lane) {
+		auto &result = results[lane_jobs[lane]];
+		result.instructions = static_cast<unsigned long>(vm.getInstructionCount(lane));
+		frames[lane].finish(vm.getDisplayBuffer(lane), result.instructions);
+		result.pc = vm.getProgramCounter(lane);
+		result.i = vm.getAddressRegister(lane);
+		result.v = vm.getRegisters(lane);
+		result.display_hash = vm.getDisplayBuffer(lane).getHash();
+		result.state = vm.isRunning(lane) ? "running" : vm.isLive(lane) ? "blocked" : "halted";
+	}
+}
+
+/**
+* Runs a fixed set of jobs across a number of worker threads.
+*
+* Each worker owns a deque of job indices which it takes work from the front of. Once a worker's own deque is empty it steals from the back of the other
+* workers' deques, so a few long running ROMs don't leave the remaining cores idle.
+*/
+class WorkStealingPool {
+public:
+	WorkStealingPool(std::size_t thread_count, std::size_t job_count) :
+		queues(std::max<std::size_t>(thread_count, 1))
+	{
+		for (std::size_t job = 0; job < job_count; ++job) {
+			this->queues[job % this->queues.size()].jobs.push_back(job);
+		}
+	}
+
+	template<typename Function>
+	void run(Function &&function) {
+		std::vector<std::jthread> workers;
+		for (std::size_t worker = 0; worker < this->queues.size(); ++worker) {
+			workers.emplace_back([this, worker, &function]() {
+				std::size_t job;
+				while (this->take(worker, job)) {
+					function(job);
+				}
+			});
+		}
+	}
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<std::size_t> jobs;
+	};
+	std::deque<WorkQueue> queues;
+
+	bool take(std::size_t worker, std::size_t &job) {
+		{
+			auto &own = this->queues[worker];
+			std::scoped_lock lock(own.mutex);
+			if (!own.jobs.empty()) {
+				job = own.jobs.front();
+				own.jobs.pop_front();
+				return true;
+			}
+		}
+
+		// No jobs are ever added once running so a full pass over the other queues finding nothing means we're done.
+		for (std::size_t offset = 1; offset < this->queues.size(); ++offset) {
+			auto &victim = this->queues[(worker + offset) % this->queues.size()];
+			std::scoped_lock lock(victim.mutex);
+			if (!victim.jobs.empty()) {
+				job = victim.jobs.back();
+				victim.jobs.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+void print_result(std::ostream &output, const Job &job, const JobResult &result) {
+	if (!result.loaded) {
+		output << job.rom_path.string() << " error=unreadable\n";
+		return;
+	}
+
+	char registers[16 * 2 + 1];
+	for (std::size_t index = 0; index < result.v.size(); ++index) {
+		std::snprintf(registers + index * 2, 3, "%02X", result.v[index]);
+	}
+
+	char line[256];
+	std::snprintf(line, sizeof(line), " state=%s instructions=%lu pc=%03X i=%03X v=%s display=%016llX\n",
+		result.state, result.instructions, static_cast<unsigned>(result.pc), static_cast<unsigned>(result.i), registers, static_cast<unsigned long long>(result.display_hash));
+	output << job.rom_path.string() << line;
+}
+
+int main(int argc, char **argv) {
+	Engine engine = Engine::Fast;
+	auto variant = Chip8ReferenceVm::Variant::Chip8;
+	auto platform = Chip8Platform::Octo;
+	std::size_t thread_count = std::thread::hardware_concurrency();
+	unsigned long instructions_per_tick = DEFAULT_INSTRUCTIONS_PER_TICK;
+	const char *manifest_path = nullptr;
+	std::filesystem::path frames_directory;
+	bool analyse = false;
+
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option(argv[arg]);
+		if (option == "--engine" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			engine = name == "reference" ? Engine::Reference : name == "jit" ? Engine::Jit : name == "batch" ? Engine::Batch : Engine::Fast;
+		}
+		else if (option == "--variant" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			variant = name == "xochip" ? Chip8ReferenceVm::Variant::XoChip : name == "schip" ? Chip8ReferenceVm::Variant::SuperChip : Chip8ReferenceVm::Variant::Chip8;
+		}
+		else if (option == "--quirks" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			platform = name == "vip" ? Chip8Platform::CosmacVip : name == "chip48" ? Chip8Platform::Chip48 : name == "schip" ? Chip8Platform::SuperChip : Chip8Platform::Octo;
+		}
+		else if (option == "--threads" && arg + 1 < argc) {
+			thread_count = std::stoul(argv[++arg]);
+		}
+		else if (option == "--instructions-per-tick" && arg + 1 < argc) {
+			instructions_per_tick = std::stoul(argv[++arg]);
+		}
+		else if (option == "--frames" && arg + 1 < argc) {
+			frames_directory = argv[++arg];
+		}
+		else if (option == "--analyse") {
+			analyse = true;
+		}
+		else {
+			manifest_path = argv[arg];
+		}
+	}
+
+	if (manifest_path == nullptr) {
+		std::cerr << "Usage: " << argv[0] << " [--engine reference|fast|jit|batch] [--variant chip8|schip|xochip] [--quirks vip|chip48|schip|octo] [--threads N] [--instructions-per-tick N] [--frames <directory>] [--analyse] <manifest>\n";
+		return 1;
+	}
+
+	engine = supported_engine(engine, variant, platform);
+
+	std::ifstream manifest(manifest_path);
+	if (!manifest) {
+		std::cerr << "Unable to read " << manifest_path << "\n";
+		return 1;
+	}
+
+	auto jobs = read_manifest(manifest);
+	RomCache roms;
+
+	if (!frames_directory.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(frames_directory, error);
+		for (std::size_t job = 0; job < jobs.size(); ++job) {
+			jobs[job].frames_path = frames_directory / (std::to_string(job) + ".c8fs");
+		}
+	}
+
+	if (analyse) {
+		std::set<std::filesystem::path> analysed;
+		for (const auto &job : jobs) {
+			if (!analysed.insert(job.rom_path).second) {
+				continue;
+			}
+
+			std::cout << job.rom_path.string() << "\n";
+			if (auto rom = roms.load(job.rom_path, false).rom) {
+				Chip8ReferenceVm(rom->getData(), variant, platform).getAnalysis().writeReport(std::cout);
+			}
+			else {
+				std::cout << "unable to read\n";
+			}
+		}
+		return 0;
+	}
+
+	std::vector<JobResult> results(jobs.size());
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (engine == Engine::Batch) {
+		// Keyed by ROM and instructions per tick, jobs replaying a log tick at the rate it was recorded at
+		std::map<std::pair<std::filesystem::path, unsigned long>, std::vector<std::size_t>> rom_groups;
+		for (std::size_t job = 0; job < jobs.size(); ++job) {
+			Chip8InputLog log;
+			bool recorded = !jobs[job].input_path.empty() && read_input_log(jobs[job].input_path, log);
+			rom_groups[{ jobs[job].rom_path, recorded ? log.instructions_per_tick : instructions_per_tick }].push_back(job);
+		}
+
+		std::vector<std::pair<unsigned long, std::vector<std::size_t>>> groups;
+		for (auto &rom : rom_groups) {
+			groups.emplace_back(rom.first.second, std::move(rom.second));
+		}
+
+		WorkStealingPool pool(thread_count, groups.size());
+		pool.run([&](std::size_t group) {
+			run_batch(roms, groups[group].first, jobs, groups[group].second, results);
+		});
+	}
+	else {
+		WorkStealingPool pool(thread_count, jobs.size());
+		pool.run([&](std::size_t job) {
+			run_job(roms, engine, variant, platform, instructions_per_tick, jobs[job], results[job]);
+		});
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	unsigned long long total_instructions = 0;
+	for (const auto &result : results) {
+		total_instructions += result.instructions;
+	}
+
+	for (std::size_t job = 0; job < jobs.size(); ++job) {
+		print_result(std::cout, jobs[job], results[job]);
+	}
+
+	std::fprintf(stderr, "%llu instructions in %.3fs, %.1f million instructions/sec\n",
+		total_instructions, elapsed.count(), elapsed.count() > 0 ? total_instructions / elapsed.count() / 1e6 : 0.0);
+
+	return 0;
+}
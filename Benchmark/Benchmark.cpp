@@ -0,0 +1,328 @@
+// Benchmark.cpp : Measures the throughput of each engine over a fixed corpus of ROMs.
+//
+// Usage: Benchmark [--seconds N] [--lanes N] [--engine reference|fast|jit|batch] [rom...]
+//
+// The corpus covers the main kinds of work a ROM does: register arithmetic, sprite drawing, subroutine calls and a real program (Screenwipe, the ROM
+// ConsoleUI runs by default). Any ROM files given on the command line are benchmarked as well. Every ROM is run on every engine (or only the one given
+// with --engine) for roughly --seconds (default 1) per measurement:
+//  - run(): instructions/sec and ns/instruction, with timers clocked by the instruction count.
+//  - doFrame(): frames/sec with ConsoleUI's 500 instructions per frame and no pacing between frames.
+//  - allocs: heap allocations made while executing instructions (construction isn't counted), steady state interpretation shouldn't allocate at all.
+// The batch engine runs --lanes copies of the ROM (default 1024) and reports aggregate instructions/sec, it has no doFrame().
+//
+// Programs that halt are restarted and programs waiting for a key are given one, so every ROM keeps running for the whole measurement.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <vector>
+#include "../Emulator/Chip8BatchVm.h"
+#include "../Emulator/Chip8FastVm.h"
+#include "../Emulator/Chip8ReferenceVm.h"
+#include "../Emulator/Chip8Rom.h"
+
+// Every allocation made through operator new is counted, measurements take the difference around the code being measured.
+std::atomic<unsigned long long> allocation_count = 0;
+
+void *operator new(std::size_t size) {
+	++allocation_count;
+	if (auto memory = std::malloc(size == 0 ? 1 : size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+struct Rom {
+	std::string name;
+	std::shared_ptr<const Chip8Rom> data;
+};
+
+template<typename... Bytes>
+Rom make_rom(const char *name, Bytes... bytes) {
+	const std::byte data[] = { static_cast<std::byte>(bytes)... };
+	return { name, std::make_shared<const Chip8Rom>(data) };
+}
+
+std::vector<Rom> builtin_corpus() {
+	std::vector<Rom> corpus;
+
+	corpus.push_back(make_rom("alu",
+		0x60, 0x01, // 200: V0 = 1
+		0x61, 0x03, // 202: V1 = 3
+		0x80, 0x14, // 204: V0 += V1
+		0x81, 0x05, // 206: V1 -= V0
+		0x82, 0x06, // 208: V2 = V0 >> 1
+		0x73, 0x01, // 20A: V3 += 1
+		0x82, 0x32, // 20C: V2 &= V3
+		0x81, 0x31, // 20E: V1 |= V3
+		0x82, 0x33, // 210: V2 ^= V3
+		0x82, 0x0E, // 212: V2 = V0 << 1
+		0x12, 0x04  // 214: jump 204
+	));
+
+	corpus.push_back(make_rom("sprites",
+		0x60, 0x00, // 200: V0 = 0
+		0x61, 0x00, // 202: V1 = 0
+		0x62, 0x00, // 204: V2 = 0
+		0xF2, 0x29, // 206: I = font(V2)
+		0xD0, 0x15, // 208: draw 5 lines at V0, V1
+		0xA2, 0x00, // 20A: I = 200
+		0xD0, 0x1F, // 20C: draw 15 lines at V0, V1
+		0x70, 0x07, // 20E: V0 += 7
+		0x71, 0x03, // 210: V1 += 3
+		0x72, 0x01, // 212: V2 += 1
+		0x42, 0x10, // 214: skip if V2 != 16
+		0x62, 0x00, // 216: V2 = 0
+		0x12, 0x06  // 218: jump 206
+	));
+
+	// Recurses 7 levels deep, two calls per level, staying within the 16 entries every engine supports
+	corpus.push_back(make_rom("calls",
+		0x60, 0x07, // 200: V0 = 7
+		0x22, 0x06, // 202: call 206
+		0x12, 0x00, // 204: jump 200
+		0x30, 0x00, // 206: skip if V0 == 0
+		0x22, 0x0E, // 208: call 20E
+		0x00, 0xEE, // 20A: return
+		0x00, 0x00, // 20C:
+		0x70, 0xFF, // 20E: V0 -= 1
+		0x22, 0x06, // 210: call 206
+		0x00, 0xEE  // 212: return
+	));
+
+	// Same as the default ROM in ConsoleUI
+	corpus.push_back(make_rom("screenwipe",
+		0xA2, 0x6E, 0x22, 0x3A, 0xA2, 0x76, 0x6D, 0x03,
+		0xFD, 0x15, 0xFF, 0x07, 0x3F, 0x00, 0x12, 0x0A,
+		0x22, 0x3A, 0x70, 0x01, 0x30, 0x7E, 0x12, 0x08,
+		0xA2, 0x6E, 0x22, 0x3A, 0x60, 0x00, 0xA2, 0x7E,
+		0x22, 0x4C, 0xA2, 0x7F, 0xFD, 0x15, 0xFF, 0x07,
+		0x3F, 0x00, 0x12, 0x26, 0x22, 0x4C, 0x70, 0x01,
+		0x30, 0x3F, 0x12, 0x24, 0xA2, 0x7E, 0x22, 0x4C,
+		0xFF, 0x0A, 0x61, 0x00, 0xD0, 0x18, 0x61, 0x08,
+		0xD0, 0x18, 0x61, 0x10, 0xD0, 0x18, 0x61, 0x18,
+		0xD0, 0x18, 0x00, 0xEE, 0x61, 0x00, 0xD1, 0x03,
+		0x61, 0x08, 0xD1, 0x03, 0x61, 0x10, 0xD1, 0x03,
+		0x61, 0x18, 0xD1, 0x03, 0x61, 0x20, 0xD1, 0x03,
+		0x61, 0x28, 0xD1, 0x03, 0x61, 0x30, 0xD1, 0x03,
+		0x61, 0x38, 0xD1, 0x03, 0x00, 0xEE, 0xC0, 0xC0,
+		0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xA0, 0xA0,
+		0xA0, 0xA0, 0xA0, 0xA0, 0xA0, 0xA0, 0xFF, 0xFF,
+		0x00, 0xFF
+	));
+
+	return corpus;
+}
+
+enum class Engine {
+	Reference,
+	Fast,
+	Jit,
+	Batch
+};
+
+const char *engine_name(Engine engine) {
+	switch (engine) {
+	case Engine::Reference: return "reference";
+	case Engine::Fast: return "fast";
+	case Engine::Jit: return "jit";
+	case Engine::Batch: return "batch";
+	}
+	return "";
+}
+
+constexpr unsigned long INSTRUCTIONS_PER_TICK = 10;
+constexpr unsigned long INSTRUCTIONS_PER_FRAME = 500;
+
+// Instructions per run() call, the clock is only checked between calls.
+constexpr unsigned long RUN_CHUNK = 100000;
+
+struct Measurement {
+	unsigned long long instructions = 0;
+	unsigned long long frames = 0;
+	unsigned long long allocations = 0;
+	double run_seconds = 0;
+	double frame_seconds = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+template<typename Vm>
+void unblock(Vm &vm) {
+	if (!vm.isRunning() && vm.isLive()) {
+		vm.setKeyState(0, true);
+		vm.setKeyState(0, false);
+	}
+}
+
+template<typename Vm, typename Factory>
+Measurement measure(Factory &&make_vm, std::chrono::duration<double> duration) {
+	Measurement measurement;
+
+	{
+		auto vm = make_vm();
+		vm->setTimerMode(Vm::TimerMode::Instruction, INSTRUCTIONS_PER_TICK);
+
+		auto start = Clock::now();
+		auto deadline = start + duration;
+		while (Clock::now() < deadline) {
+			if (!vm->isLive()) {
+				vm = make_vm();
+				vm->setTimerMode(Vm::TimerMode::Instruction, INSTRUCTIONS_PER_TICK);
+			}
+			unblock(*vm);
+
+			auto allocations = allocation_count.load();
+			measurement.instructions += vm->run(RUN_CHUNK);
+			measurement.allocations += allocation_count.load() - allocations;
+		}
+		measurement.run_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	{
+		auto vm = make_vm();
+		vm->setTimerMode(Vm::TimerMode::Frame, 0);
+		vm->setEmulationSpeed(INSTRUCTIONS_PER_FRAME);
+
+		auto start = Clock::now();
+		auto deadline = start + duration;
+		while (Clock::now() < deadline) {
+			if (!vm->isLive()) {
+				vm = make_vm();
+				vm->setTimerMode(Vm::TimerMode::Frame, 0);
+				vm->setEmulationSpeed(INSTRUCTIONS_PER_FRAME);
+			}
+			unblock(*vm);
+
+			auto allocations = allocation_count.load();
+			vm->doFrame();
+			measurement.allocations += allocation_count.load() - allocations;
+			++measurement.frames;
+		}
+		measurement.frame_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	return measurement;
+}
+
+Measurement measure_batch(std::span<const std::byte> rom, std::size_t lanes, std::chrono::duration<double> duration) {
+	Measurement measurement;
+
+	auto make_vm = [&]() {
+		auto vm = std::make_unique<Chip8BatchVm>(rom, lanes);
+		vm->setInstructionsPerTick(INSTRUCTIONS_PER_TICK);
+		return vm;
+	};
+
+	auto vm = make_vm();
+	auto start = Clock::now();
+	auto deadline = start + duration;
+	while (Clock::now() < deadline) {
+		for (std::size_t lane = 0; lane < lanes; ++lane) {
+			if (!vm->isRunning(lane) && vm->isLive(lane)) {
+				vm->setKeyState(lane, 0, true);
+				vm->setKeyState(lane, 0, false);
+			}
+			vm->setInstructionLimit(lane, vm->getInstructionCount(lane) + RUN_CHUNK / 100);
+		}
+
+		auto allocations = allocation_count.load();
+		auto executed = vm->run();
+		measurement.allocations += allocation_count.load() - allocations;
+		measurement.instructions += executed;
+
+		if (executed == 0) {
+			// Every lane halted
+			vm = make_vm();
+		}
+	}
+	measurement.run_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	return measurement;
+}
+
+Measurement measure(Engine engine, std::span<const std::byte> rom, std::size_t lanes, std::chrono::duration<double> duration) {
+	switch (engine) {
+	case Engine::Reference:
+		return measure<Chip8ReferenceVm>([&]() { return std::make_unique<Chip8ReferenceVm>(rom); }, duration);
+
+	case Engine::Fast:
+	case Engine::Jit:
+		return measure<Chip8FastVm>([&]() {
+			auto vm = std::make_unique<Chip8FastVm>(rom);
+			vm->setJitEnabled(engine == Engine::Jit);
+			return vm;
+		}, duration);
+
+	case Engine::Batch:
+		return measure_batch(rom, lanes, duration);
+	}
+	return {};
+}
+
+void print_measurement(const std::string &rom, Engine engine, const Measurement &measurement) {
+	auto instructions_per_second = measurement.run_seconds > 0 ? measurement.instructions / measurement.run_seconds : 0.0;
+	auto nanoseconds = measurement.instructions > 0 ? measurement.run_seconds * 1e9 / measurement.instructions : 0.0;
+
+	char frames[32] = "-";
+	if (measurement.frame_seconds > 0) {
+		std::snprintf(frames, sizeof(frames), "%.0f", measurement.frames / measurement.frame_seconds);
+	}
+
+	std::printf("%-16s %-10s %12.1f %10.3f %12s %10llu\n", rom.c_str(), engine_name(engine), instructions_per_second / 1e6, nanoseconds, frames, measurement.allocations);
+}
+
+int main(int argc, char **argv) {
+	std::chrono::duration<double> duration(1.0);
+	std::size_t lanes = 1024;
+	std::vector<Engine> engines = { Engine::Reference, Engine::Fast, Engine::Jit, Engine::Batch };
+	auto corpus = builtin_corpus();
+
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option(argv[arg]);
+		if (option == "--seconds" && arg + 1 < argc) {
+			duration = std::chrono::duration<double>(std::stod(argv[++arg]));
+		}
+		else if (option == "--lanes" && arg + 1 < argc) {
+			lanes = std::max<std::size_t>(std::stoul(argv[++arg]), 1);
+		}
+		else if (option == "--engine" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			engines = { name == "reference" ? Engine::Reference : name == "jit" ? Engine::Jit : name == "batch" ? Engine::Batch : Engine::Fast };
+		}
+		else {
+			Rom rom{ std::filesystem::path(option).filename().string(), Chip8Rom::map(option) };
+			if (!rom.data) {
+				std::cerr << "Unable to read " << option << "\n";
+				return 1;
+			}
+			corpus.push_back(std::move(rom));
+		}
+	}
+
+	std::printf("%-16s %-10s %12s %10s %12s %10s\n", "rom", "engine", "Minstr/s", "ns/instr", "frames/s", "allocs");
+	for (auto &rom : corpus) {
+		for (auto engine : engines) {
+			print_measurement(rom.name, engine, measure(engine, rom.data->getData(), lanes, duration));
+		}
+	}
+
+	return 0;
+}
@@ -1,36 +1,85 @@
 // ConsoleUI.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
+// Usage: ConsoleUI [--record <log>] [--variant chip8|schip|xochip] [--quirks vip|chip48|schip|octo] [--frame-stats] [rom]
+//
+// Press Escape to quit.
+//
+// With --record the RNG seed and every key event are written to the given file on exit (see Chip8InputLog), BatchRunner can then replay the session
+// headlessly. Timers are clocked by the instruction count while recording so the log alone determines the run.
+//
+// The terminal is resized to fit the display whenever a SUPER-CHIP/XO-CHIP program switches resolution, XO-CHIP bit-planes are drawn as different shades.
+//
+// Emulation runs on its own thread at 60 frames per second on a fixed schedule (see Chip8FramePacer), it's the only thread that touches the VM. The main
+// thread draws to the terminal, beeps and reads keys (curses can only be used from one thread): frames reach it through a triple buffer and keys go back
+// through a ring buffer, so a slow terminal never holds up emulation, it just draws fewer of the frames. --frame-stats prints how closely the schedule
+// was kept on exit.
 
 #include <bitset>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include "../Emulator/Chip8FramePacer.h"
+#include "../Emulator/Chip8InputLog.h"
 #include "../Emulator/Chip8ReferenceVm.h"
+#include "../Emulator/Chip8RingBuffer.h"
+#include "../Emulator/Chip8Rom.h"
+#include "../Emulator/Chip8TripleBuffer.h"
 
 #define PDC_WIDE
 #define PDC_DLL_BUILD
 #include <curses.h>
 
 constexpr uint_fast8_t PIXEL_WIDTH = 2;
-constexpr wchar_t ON_PIXEL[PIXEL_WIDTH] = { L'\u2588', L'\u2588' };
-constexpr wchar_t OFF_PIXEL[PIXEL_WIDTH] = { ' ', ' ' };
 
-void render_display_unit(WINDOW *window, uint_fast8_t row, uint_fast8_t col, std::byte display_unit) {
-	for (auto i = 0; i < 8; ++i) {
+// Indexed by the bit mask of planes a pixel is lit in. Plane 0 alone (all a CHIP-8 or SUPER-CHIP program ever draws to) is a full block, plane 1 alone the
+// lightest shade and both together a medium shade. Planes 2 and 3 reuse the same shades as there are only so many block characters.
+constexpr wchar_t PIXELS[Chip8Display::PLANES * Chip8Display::PLANES][PIXEL_WIDTH] = {
+	{ ' ', ' ' }, { L'\u2588', L'\u2588' }, { L'\u2591', L'\u2591' }, { L'\u2592', L'\u2592' },
+	{ L'\u2591', L'\u2591' }, { L'\u2588', L'\u2588' }, { L'\u2592', L'\u2592' }, { L'\u2593', L'\u2593' },
+	{ L'\u2591', L'\u2591' }, { L'\u2588', L'\u2588' }, { L'\u2592', L'\u2592' }, { L'\u2593', L'\u2593' },
+	{ L'\u2592', L'\u2592' }, { L'\u2588', L'\u2588' }, { L'\u2593', L'\u2593' }, { L'\u2588', L'\u2588' },
+};
+
+void render_display_region(WINDOW *window, const Chip8Display &display, const Chip8Display::DirtyRegion &region) {
+	for (uint_fast8_t col = region.x; col < region.x + region.width; ++col) {
 		//using two character strings (wide characters) to make square pixels. Assuming users will have a console with monospaced fonts at approx 2*1 ratio
-		mvwins_nwstr(window, row, ((col * 8) + i) * PIXEL_WIDTH, std::to_integer<bool>(display_unit & std::byte(0b10000000 >> i)) ? ON_PIXEL : OFF_PIXEL, PIXEL_WIDTH);
+		// Cells are overwritten rather than inserted so the rest of the row stays where it is.
+		mvwaddnwstr(window, region.y, col * PIXEL_WIDTH, PIXELS[display.getPlanes(col, region.y)], PIXEL_WIDTH);
 	}
 }
 
-void display_frame(const Chip8ReferenceVm &emulator, WINDOW *window) {
-	auto row = 0, col = 0;
-	for (auto display_unit : emulator.getDisplayBuffer()) {
-		render_display_unit(window, row, col, display_unit);
-		if (++col >= emulator.DISPLAY_WIDTH_UNITS) {
-			++row;
-			col = 0;
-		}
+// Only redraws the cells that differ between what the terminal shows and the latest frame, most frames only touch a few rows and many don't touch the
+// display at all.
+void display_frame(Chip8Display &shown, const Chip8Display &latest, WINDOW *window) {
+	// Marks every pixel that differs as dirty, and all of them on a change of resolution
+	shown.assign(latest);
+
+	// Sprites drawn and erased again between frames (flickering) leave the screen as it was, checked from the display's hash without scanning any rows
+	if (!shown.isChanged()) {
+		shown.clearDirty();
+		return;
 	}
+
+	auto regions = shown.getDirtyRegions();
+	if (regions.empty()) {
+		return;
+	}
+
+	// A change of resolution marks the whole display dirty so resizing is all that's needed here
+	if (getmaxy(window) != shown.getHeight() || getmaxx(window) != shown.getWidth() * PIXEL_WIDTH) {
+		resize_term(shown.getHeight(), shown.getWidth() * PIXEL_WIDTH);
+		werase(window);
+	}
+
+	for (const auto &region : regions) {
+		render_display_region(window, shown, region);
+	}
+	shown.clearDirty();
 	wrefresh(window);
 }
 
@@ -49,53 +98,140 @@ const keymap_type HEX_KEYMAP = {
 };
 keymap_type keymap = QWERTY_KEYMAP;
 
-void run(Chip8ReferenceVm &emulator, WINDOW *window) {
-	keypad(window, true);
-	nodelay(window, true);
-	noecho();
-	curs_set(0);
+constexpr wint_t KEY_ESCAPE = 27;
 
-	unsigned int frameCount = 0;
-	unsigned int instructionCount = 0;
-	while (emulator.isLive()) {
-		instructionCount += emulator.doFrame();
-		display_frame(emulator, window);
-		++frameCount;
+constexpr unsigned long INSTRUCTIONS_PER_FRAME = 500;
 
-		if (emulator.getSoundTimer()) {
-			beep();
-		}
+// How long the main thread waits for a key before checking for a new frame again, well under a frame so frames are drawn soon after they're emulated
+constexpr int INPUT_WAIT_MS = 4;
 
-		wint_t key = 0;
-		int key_return = 0;
+// What the emulation thread hands the main thread after every frame
+struct Frame {
+	Chip8Display display;
+	bool sound = false;
+	bool live = true;
+};
+
+typedef Chip8TripleBuffer<Frame> frame_buffer_type;
+
+// CHIP-8 key codes of the keys pressed, terminals don't report keys being released
+typedef Chip8RingBuffer<uint_fast8_t, 64> key_buffer_type;
+
+// Runs on the emulation thread, the only one to touch the VM, the pacer and the log until it's finished.
+void emulate(std::stop_token stop, Chip8ReferenceVm &emulator, Chip8FramePacer &pacer, Chip8InputLog *log, frame_buffer_type &frames, key_buffer_type &keys) {
+	unsigned long long instructionCount = 0;
+	bool live = emulator.isLive();
+	while (live && !stop.stop_requested()) {
+		auto due = pacer.wait();
 
+		// Keys are held from when they're typed until the frames after them have run, a key held down keeps being typed by the terminal's autorepeat
 		emulator.clearKeyState();
-		while ((key_return = wget_wch(window, &key)) != ERR) {
-			if (key_return == OK) {
-				if (keymap.contains(key)) {
-					emulator.setKeyState(keymap[key], true);
-				}
+		if (log) {
+			log->clearKeyState(instructionCount);
+		}
+		for (uint_fast8_t key; keys.pop(key);) {
+			emulator.setKeyState(key, true);
+			if (log) {
+				log->setKeyState(instructionCount, key, true);
 			}
 		}
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 60));
+		for (; due > 0 && emulator.isLive(); --due) {
+			instructionCount += emulator.doFrame();
+		}
+		live = emulator.isLive();
+
+		auto &frame = frames.back();
+		frame.display = emulator.getDisplayBuffer();
+		frame.sound = emulator.getSoundTimer() != 0;
+		frame.live = live;
+		frames.publish();
+	}
+
+	if (log) {
+		log->length = instructionCount;
 	}
 }
 
-void read_file_into_rom(std::filesystem::path &file_name, std::vector<std::byte> &rom) {
-	std::ifstream file(file_name, std::ios::binary);
+void run(Chip8ReferenceVm &emulator, WINDOW *window, Chip8FramePacer &pacer, Chip8InputLog *log) {
+	keypad(window, true);
+	wtimeout(window, INPUT_WAIT_MS);
+	noecho();
+	curs_set(0);
+
+	frame_buffer_type frames;
+	key_buffer_type keys;
+	std::jthread emulation([&](std::stop_token stop) {
+		emulate(stop, emulator, pacer, log, frames, keys);
+	});
+
+	// What the terminal shows, only ever the last frame emulated by the time the terminal is ready for another
+	Chip8Display shown;
+	bool quit = false;
+	while (!quit) {
+		if (frames.update()) {
+			const auto &frame = frames.front();
+			display_frame(shown, frame.display, window);
+
+			if (frame.sound) {
+				beep();
+			}
+			if (!frame.live) {
+				break;
+			}
+		}
 
-	std::transform(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), std::back_inserter(rom), [](char c) -> std::byte { return std::byte(c); });
+		wint_t key = 0;
+		if (wget_wch(window, &key) == OK) {
+			if (key == KEY_ESCAPE) {
+				quit = true;
+			}
+			else if (keymap.contains(key)) {
+				keys.push(keymap[key]);
+			}
+		}
+	}
+
+	// The VM, pacer and log are only safe to use again once the thread has finished
+	emulation.request_stop();
+	emulation.join();
 }
 
 int main(int argc, char **argv) {
 	WINDOW *window = initscr();
 	resize_term(Chip8ReferenceVm::DISPLAY_HEIGHT, Chip8ReferenceVm::DISPLAY_WIDTH * PIXEL_WIDTH);
 
+	const char *rom_path = nullptr;
+	const char *log_path = nullptr;
+	auto variant = Chip8ReferenceVm::Variant::Chip8;
+	auto platform = Chip8Platform::Octo;
+	bool frame_stats = false;
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option(argv[arg]);
+		if (option == "--record" && arg + 1 < argc) {
+			log_path = argv[++arg];
+		}
+		else if (option == "--variant" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			variant = name == "xochip" ? Chip8ReferenceVm::Variant::XoChip : name == "schip" ? Chip8ReferenceVm::Variant::SuperChip : Chip8ReferenceVm::Variant::Chip8;
+		}
+		else if (option == "--quirks" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			platform = name == "vip" ? Chip8Platform::CosmacVip : name == "chip48" ? Chip8Platform::Chip48 : name == "schip" ? Chip8Platform::SuperChip : Chip8Platform::Octo;
+		}
+		else if (option == "--frame-stats") {
+			frame_stats = true;
+		}
+		else {
+			rom_path = argv[arg];
+		}
+	}
+
 	std::vector<std::byte> rom;
-	if (argc > 1) {
-		std::filesystem::path file_name(argv[1]);
-		read_file_into_rom(file_name, rom);
+	std::shared_ptr<const Chip8Rom> rom_file;
+	if (rom_path) {
+		// A file that can't be read runs as an empty ROM
+		rom_file = Chip8Rom::map(std::filesystem::path(rom_path));
 	} else {
 		for (int8_t byte : {
 			// Screenwipe.ch8
@@ -121,10 +257,45 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	Chip8ReferenceVm emulator(rom);
-	emulator.setEmulationSpeed(500);
-	run(emulator, window);
+	Chip8ReferenceVm emulator(rom_file ? rom_file->getData() : rom, variant, platform);
+	emulator.setEmulationSpeed(INSTRUCTIONS_PER_FRAME);
+
+	// VMs start with a fixed seed, interactive sessions should play differently each time
+	auto seed = std::random_device()();
+	emulator.seed(seed);
+
+	std::unique_ptr<Chip8InputLog> log;
+	if (log_path) {
+		log = std::make_unique<Chip8InputLog>();
+		log->variant = variant;
+		log->platform = platform;
+		log->seed = seed;
+		log->instructions_per_tick = INSTRUCTIONS_PER_FRAME;
+		emulator.setTimerMode(Chip8ReferenceVm::TimerMode::Instruction, log->instructions_per_tick);
+	}
+
+	Chip8FramePacer pacer;
+	run(emulator, window, pacer, log.get());
 
 	endwin();
+
+	if (frame_stats) {
+		const auto &stats = pacer.getStats();
+		std::cout << stats.frames << " frames, " << stats.late << " late, " << stats.dropped << " dropped, jitter mean " << stats.mean_jitter << "us stddev " <<
+			stats.jitterStdDev() << "us max " << stats.max_jitter << "us" << std::endl;
+	}
+
+	if (log) {
+		std::ofstream output(log_path, std::ios::binary);
+		log->write(output);
+	}
+
+#if CHIP8_PROFILER
+	// Written to the working directory, render the folded stacks with e.g. flamegraph.pl chip8-profile.folded > chip8-profile.svg
+	std::ofstream json("chip8-profile.json");
+	emulator.getProfiler().writeJson(json);
+	std::ofstream folded("chip8-profile.folded");
+	emulator.getProfiler().writeFoldedStacks(folded);
+#endif
 	return 0;
 }
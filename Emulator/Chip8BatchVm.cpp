@@ -0,0 +1,866 @@
+#include "Chip8BatchVm.h"
+
+#include "Chip8Font.h"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CHIP8_BATCH_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHIP8_BATCH_SSE2 1
+#endif
+
+namespace {
+	// Every reachable address fits in 15 bits (BNNN can reach 0x10FE) so 16 bit signed comparisons work, this is larger than any of them.
+	constexpr uint16_t NO_ADDRESS = 0x7FFF;
+
+	// Byte-wise operations on as many lanes as the target supports at once. Comparisons produce 0xFF/0x00 masks, matching LaneMask.
+#if defined(CHIP8_BATCH_AVX2)
+	struct Lanes {
+		using Vec = __m256i;
+		static constexpr std::size_t WIDTH = 32;
+
+		static Vec load(const uint8_t *p) { return _mm256_loadu_si256(reinterpret_cast<const Vec *>(p)); }
+		static void store(uint8_t *p, Vec a) { _mm256_storeu_si256(reinterpret_cast<Vec *>(p), a); }
+		static Vec splat(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+
+		static Vec add(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+		static Vec subtract(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+		static Vec bitOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+		static Vec bitAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+		static Vec bitXor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+		static Vec andNot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); }
+		static Vec equal(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+		static Vec shiftRight1(Vec a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), splat(0x7F)); }
+		static Vec select(Vec mask, Vec a, Vec b) { return _mm256_blendv_epi8(b, a, mask); }
+
+		// Byte mask of the lanes where pc == address
+		static Vec equalAddress(const uint16_t *pc, uint16_t address) {
+			auto target = _mm256_set1_epi16(static_cast<short>(address));
+			auto lo = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const Vec *>(pc)), target);
+			auto hi = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const Vec *>(pc + 16)), target);
+			// packs works within each 128 bit half, put the lanes back in order afterwards
+			return _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+		}
+
+		// pc += amount in every lane set in mask
+		static void addAddress(uint16_t *pc, Vec mask, uint16_t amount) {
+			auto value = _mm256_set1_epi16(static_cast<short>(amount));
+			auto *target = reinterpret_cast<Vec *>(pc);
+			auto lo = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask)), value);
+			auto hi = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask, 1)), value);
+			_mm256_storeu_si256(target, _mm256_add_epi16(_mm256_loadu_si256(target), lo));
+			_mm256_storeu_si256(target + 1, _mm256_add_epi16(_mm256_loadu_si256(target + 1), hi));
+		}
+
+		// pc = value in every lane set in mask
+		static void setAddress(uint16_t *pc, Vec mask, uint16_t value) {
+			auto replacement = _mm256_set1_epi16(static_cast<short>(value));
+			auto *target = reinterpret_cast<Vec *>(pc);
+			auto lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask));
+			auto hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask, 1));
+			_mm256_storeu_si256(target, _mm256_blendv_epi8(_mm256_loadu_si256(target), replacement, lo));
+			_mm256_storeu_si256(target + 1, _mm256_blendv_epi8(_mm256_loadu_si256(target + 1), replacement, hi));
+		}
+
+		static std::size_t count(Vec mask) { return std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(mask))); }
+
+		static uint16_t lowestAddress(const uint16_t *pc, const uint8_t *mask, std::size_t count) {
+			auto lowest = _mm256_set1_epi16(NO_ADDRESS);
+			for (std::size_t lane = 0; lane < count; lane += WIDTH) {
+				auto selected = load(mask + lane);
+				auto lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(selected));
+				auto hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(selected, 1));
+				auto values = reinterpret_cast<const Vec *>(pc + lane);
+				lowest = _mm256_min_epi16(lowest, _mm256_blendv_epi8(lowest, _mm256_loadu_si256(values), lo));
+				lowest = _mm256_min_epi16(lowest, _mm256_blendv_epi8(lowest, _mm256_loadu_si256(values + 1), hi));
+			}
+			alignas(32) uint16_t values[16];
+			_mm256_store_si256(reinterpret_cast<Vec *>(values), lowest);
+			return *std::min_element(std::begin(values), std::end(values));
+		}
+	};
+#elif defined(CHIP8_BATCH_SSE2)
+	struct Lanes {
+		using Vec = __m128i;
+		static constexpr std::size_t WIDTH = 16;
+
+		static Vec load(const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const Vec *>(p)); }
+		static void store(uint8_t *p, Vec a) { _mm_storeu_si128(reinterpret_cast<Vec *>(p), a); }
+		static Vec splat(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+
+		static Vec add(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+		static Vec subtract(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+		static Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+		static Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+		static Vec bitXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+		static Vec andNot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+		static Vec equal(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+		static Vec shiftRight1(Vec a) { return _mm_and_si128(_mm_srli_epi16(a, 1), splat(0x7F)); }
+		static Vec select(Vec mask, Vec a, Vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+
+		// Byte mask of the lanes where pc == address
+		static Vec equalAddress(const uint16_t *pc, uint16_t address) {
+			auto target = _mm_set1_epi16(static_cast<short>(address));
+			auto lo = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const Vec *>(pc)), target);
+			auto hi = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const Vec *>(pc + 8)), target);
+			return _mm_packs_epi16(lo, hi);
+		}
+
+		// pc += amount in every lane set in mask
+		static void addAddress(uint16_t *pc, Vec mask, uint16_t amount) {
+			auto value = _mm_set1_epi16(static_cast<short>(amount));
+			auto *target = reinterpret_cast<Vec *>(pc);
+			_mm_storeu_si128(target, _mm_add_epi16(_mm_loadu_si128(target), _mm_and_si128(_mm_unpacklo_epi8(mask, mask), value)));
+			_mm_storeu_si128(target + 1, _mm_add_epi16(_mm_loadu_si128(target + 1), _mm_and_si128(_mm_unpackhi_epi8(mask, mask), value)));
+		}
+
+		// pc = value in every lane set in mask
+		static void setAddress(uint16_t *pc, Vec mask, uint16_t value) {
+			auto replacement = _mm_set1_epi16(static_cast<short>(value));
+			auto *target = reinterpret_cast<Vec *>(pc);
+			auto lo = _mm_unpacklo_epi8(mask, mask);
+			auto hi = _mm_unpackhi_epi8(mask, mask);
+			_mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(lo, replacement), _mm_andnot_si128(lo, _mm_loadu_si128(target))));
+			_mm_storeu_si128(target + 1, _mm_or_si128(_mm_and_si128(hi, replacement), _mm_andnot_si128(hi, _mm_loadu_si128(target + 1))));
+		}
+
+		static std::size_t count(Vec mask) { return std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(mask))); }
+
+		static uint16_t lowestAddress(const uint16_t *pc, const uint8_t *mask, std::size_t count) {
+			auto lowest = _mm_set1_epi16(NO_ADDRESS);
+			for (std::size_t lane = 0; lane < count; lane += WIDTH) {
+				auto selected = load(mask + lane);
+				auto values = reinterpret_cast<const Vec *>(pc + lane);
+				auto lo = _mm_unpacklo_epi8(selected, selected);
+				auto hi = _mm_unpackhi_epi8(selected, selected);
+				lowest = _mm_min_epi16(lowest, _mm_or_si128(_mm_and_si128(lo, _mm_loadu_si128(values)), _mm_andnot_si128(lo, lowest)));
+				lowest = _mm_min_epi16(lowest, _mm_or_si128(_mm_and_si128(hi, _mm_loadu_si128(values + 1)), _mm_andnot_si128(hi, lowest)));
+			}
+			alignas(16) uint16_t values[8];
+			_mm_store_si128(reinterpret_cast<Vec *>(values), lowest);
+			return *std::min_element(std::begin(values), std::end(values));
+		}
+	};
+#else
+	struct Lanes {
+		using Vec = uint8_t;
+		static constexpr std::size_t WIDTH = 1;
+
+		static Vec load(const uint8_t *p) { return *p; }
+		static void store(uint8_t *p, Vec a) { *p = a; }
+		static Vec splat(uint8_t value) { return value; }
+
+		static Vec add(Vec a, Vec b) { return static_cast<Vec>(a + b); }
+		static Vec subtract(Vec a, Vec b) { return static_cast<Vec>(a - b); }
+		static Vec bitOr(Vec a, Vec b) { return a | b; }
+		static Vec bitAnd(Vec a, Vec b) { return a & b; }
+		static Vec bitXor(Vec a, Vec b) { return a ^ b; }
+		static Vec andNot(Vec a, Vec b) { return static_cast<Vec>(~a & b); }
+		static Vec equal(Vec a, Vec b) { return a == b ? 0xFF : 0x00; }
+		static Vec max(Vec a, Vec b) { return std::max(a, b); }
+		static Vec shiftRight1(Vec a) { return a >> 1; }
+		static Vec select(Vec mask, Vec a, Vec b) { return static_cast<Vec>((mask & a) | (~mask & b)); }
+
+		static Vec equalAddress(const uint16_t *pc, uint16_t address) { return *pc == address ? 0xFF : 0x00; }
+		static void addAddress(uint16_t *pc, Vec mask, uint16_t amount) { *pc += mask & amount; }
+		static void setAddress(uint16_t *pc, Vec mask, uint16_t value) { *pc = mask ? value : *pc; }
+		static std::size_t count(Vec mask) { return mask & 1; }
+
+		static uint16_t lowestAddress(const uint16_t *pc, const uint8_t *mask, std::size_t count) {
+			uint16_t lowest = NO_ADDRESS;
+			for (std::size_t lane = 0; lane < count; ++lane) {
+				lowest = mask[lane] ? std::min(lowest, pc[lane]) : lowest;
+			}
+			return lowest;
+		}
+	};
+#endif
+
+	using Vec = Lanes::Vec;
+
+	// target = op(target, source) in every selected lane
+	template<typename Op>
+	void apply(uint8_t *target, const uint8_t *source, const uint8_t *mask, std::size_t count, Op op) {
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			auto old_value = Lanes::load(target + lane);
+			auto value = op(old_value, Lanes::load(source + lane));
+			Lanes::store(target + lane, Lanes::select(Lanes::load(mask + lane), value, old_value));
+		}
+	}
+
+	// As apply() but op also returns a flag (0 or 1) which is stored in VF after the result, so VF holds the flag even when it is also the target.
+	template<typename Op>
+	void applyWithFlag(uint8_t *target, const uint8_t *source, uint8_t *vf, const uint8_t *mask, std::size_t count, Op op) {
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			auto selected = Lanes::load(mask + lane);
+			auto old_value = Lanes::load(target + lane);
+			auto [value, flag] = op(old_value, Lanes::load(source + lane));
+			Lanes::store(target + lane, Lanes::select(selected, value, old_value));
+			Lanes::store(vf + lane, Lanes::select(selected, flag, Lanes::load(vf + lane)));
+		}
+	}
+
+	// condition = mask & ((a == b) == expected), returning the number of lanes where condition is set
+	std::size_t compare(uint8_t *condition, const uint8_t *a, const uint8_t *b, const uint8_t *mask, std::size_t count, bool expected) {
+		std::size_t matched = 0;
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			auto equal = Lanes::equal(Lanes::load(a + lane), Lanes::load(b + lane));
+			auto selected = Lanes::load(mask + lane);
+			auto result = expected ? Lanes::bitAnd(selected, equal) : Lanes::andNot(equal, selected);
+			Lanes::store(condition + lane, result);
+			matched += Lanes::count(result);
+		}
+		return matched;
+	}
+
+	// condition = mask & ((a == value) == expected), returning the number of lanes where condition is set
+	std::size_t compare(uint8_t *condition, const uint8_t *a, uint8_t value, const uint8_t *mask, std::size_t count, bool expected) {
+		std::size_t matched = 0;
+		auto b = Lanes::splat(value);
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			auto equal = Lanes::equal(Lanes::load(a + lane), b);
+			auto selected = Lanes::load(mask + lane);
+			auto result = expected ? Lanes::bitAnd(selected, equal) : Lanes::andNot(equal, selected);
+			Lanes::store(condition + lane, result);
+			matched += Lanes::count(result);
+		}
+		return matched;
+	}
+
+	/**
+	* Select the lanes at an address that hold the same instruction and advance their program counters past it.
+	*
+	* @return The number of lanes selected.
+	*/
+	std::size_t select(uint8_t *selected, uint8_t *executed, uint16_t *pc, const uint8_t *active, const uint8_t *row_hi, const uint8_t *row_lo, uint16_t address, uint8_t hi, uint8_t lo, std::size_t count) {
+		std::size_t total = 0;
+		auto expected_hi = Lanes::splat(hi);
+		auto expected_lo = Lanes::splat(lo);
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			auto same_instruction = Lanes::bitAnd(Lanes::equal(Lanes::load(row_hi + lane), expected_hi), Lanes::equal(Lanes::load(row_lo + lane), expected_lo));
+			auto mask = Lanes::bitAnd(Lanes::bitAnd(Lanes::load(active + lane), Lanes::equalAddress(pc + lane, address)), same_instruction);
+			Lanes::store(selected + lane, mask);
+			// Masks are -1 in selected lanes
+			Lanes::store(executed + lane, Lanes::subtract(Lanes::load(executed + lane), mask));
+			Lanes::addAddress(pc + lane, mask, 2);
+			total += Lanes::count(mask);
+		}
+		return total;
+	}
+
+	struct Flagged {
+		Vec value;
+		Vec flag;
+	};
+}
+
+Chip8BatchVm::Chip8BatchVm(const std::span<const std::byte> &rom, std::size_t lanes) :
+	lanes(lanes),
+	stride((lanes + LANE_ALIGNMENT - 1) / LANE_ALIGNMENT * LANE_ALIGNMENT),
+	ram(MEMORY_SIZE * stride, 0),
+	pc(stride, ROM_OFFSET),
+	i(stride, 0),
+	call_stack(STACK_SIZE * stride, 0),
+	stack_size(stride, 0),
+	delay(stride, 0),
+	sound(stride, 0),
+	instructions_until_tick(stride, 0),
+	keys(stride, 0),
+	display(lanes, Display{}),
+	instructions(stride, 0),
+	instruction_limit(stride, std::numeric_limits<unsigned long long>::max()),
+	state(stride, State::Running),
+	keypress_target_register(stride, NO_KEY),
+	active(stride, 0),
+	selected(stride, 0),
+	condition(stride, 0),
+	slice_instructions(stride, 0)
+{
+	static_assert(LANE_ALIGNMENT % Lanes::WIDTH == 0, "lane columns must be padded to a whole number of vectors");
+
+	for (auto &row : this->v) {
+		row.assign(this->stride, 0);
+	}
+
+	auto initial = Chip8Random::expand(0);
+	for (std::size_t word = 0; word < initial.size(); ++word) {
+		this->random[word].assign(this->stride, initial[word]);
+	}
+
+	this->loadMemory(rom);
+
+	// Padding lanes never run
+	std::fill(this->state.begin() + this->lanes, this->state.end(), State::Halted);
+}
+
+void Chip8BatchVm::load(const std::span<const std::byte> &rom) {
+	std::fill(this->ram.begin(), this->ram.end(), 0);
+	this->loadMemory(rom);
+
+	std::fill(this->pc.begin(), this->pc.end(), ROM_OFFSET);
+	std::fill(this->i.begin(), this->i.end(), 0);
+	for (auto &row : this->v) {
+		std::fill(row.begin(), row.end(), 0);
+	}
+	std::fill(this->call_stack.begin(), this->call_stack.end(), 0);
+	std::fill(this->stack_size.begin(), this->stack_size.end(), 0);
+
+	std::fill(this->delay.begin(), this->delay.end(), 0);
+	std::fill(this->sound.begin(), this->sound.end(), 0);
+	std::fill(this->instructions_until_tick.begin(), this->instructions_until_tick.end(), this->instructions_per_tick);
+
+	std::fill(this->keys.begin(), this->keys.end(), 0);
+	std::fill(this->display.begin(), this->display.end(), Display{});
+
+	auto initial = Chip8Random::expand(0);
+	for (std::size_t word = 0; word < initial.size(); ++word) {
+		std::fill(this->random[word].begin(), this->random[word].end(), initial[word]);
+	}
+
+	std::fill(this->instructions.begin(), this->instructions.end(), 0);
+	std::fill(this->instruction_limit.begin(), this->instruction_limit.end(), std::numeric_limits<unsigned long long>::max());
+	std::fill(this->state.begin(), this->state.begin() + this->lanes, State::Running);
+	std::fill(this->keypress_target_register.begin(), this->keypress_target_register.end(), NO_KEY);
+	std::fill(this->slice_instructions.begin(), this->slice_instructions.end(), 0);
+	std::fill(this->active.begin(), this->active.end(), 0);
+	this->active_count = 0;
+	this->next_address_known = false;
+	this->leader = 0;
+}
+
+void Chip8BatchVm::loadMemory(const std::span<const std::byte> &rom) {
+	// Every lane starts with the same memory, rows hold one address across all lanes
+	auto fill_row = [this](std::size_t address, std::byte value) {
+		std::fill_n(this->ram.begin() + address * this->stride, this->stride, std::to_integer<uint8_t>(value));
+	};
+	for (std::size_t offset = 0; offset < CHIP8_FONT.size(); ++offset) {
+		fill_row(FONT_OFFSET + offset, CHIP8_FONT[offset]);
+	}
+	auto rom_size = std::min<std::size_t>(rom.size(), MEMORY_SIZE - ROM_OFFSET);
+	for (std::size_t offset = 0; offset < rom_size; ++offset) {
+		fill_row(ROM_OFFSET + offset, rom[offset]);
+	}
+}
+
+std::size_t Chip8BatchVm::getLaneCount() const {
+	return this->lanes;
+}
+
+void Chip8BatchVm::seed(std::size_t lane, uint32_t seed) {
+	auto state = Chip8Random::expand(seed);
+	for (std::size_t word = 0; word < state.size(); ++word) {
+		this->random[word][lane] = state[word];
+	}
+}
+
+void Chip8BatchVm::setInstructionsPerTick(unsigned long instructions_per_tick) {
+	this->instructions_per_tick = instructions_per_tick;
+	std::fill(this->instructions_until_tick.begin(), this->instructions_until_tick.end(), instructions_per_tick);
+}
+
+void Chip8BatchVm::tick() {
+	for (std::size_t lane = 0; lane < this->stride; ++lane) {
+		this->delay[lane] -= this->delay[lane] > 0 ? 1 : 0;
+		this->sound[lane] -= this->sound[lane] > 0 ? 1 : 0;
+	}
+}
+
+void Chip8BatchVm::setInstructionLimit(std::size_t lane, unsigned long long instructions) {
+	this->instruction_limit[lane] = instructions;
+}
+
+unsigned long long Chip8BatchVm::run() {
+	unsigned long long executed = 0;
+	while (auto rounds = this->endSlice()) {
+		for (unsigned round = 0; round < rounds; ++round) {
+			auto round_executed = this->step();
+			if (round_executed == 0) {
+				break;
+			}
+			executed += round_executed;
+		}
+	}
+	return executed;
+}
+
+unsigned Chip8BatchVm::endSlice() {
+	unsigned rounds = MAX_SLICE_ROUNDS;
+	this->active_count = 0;
+
+	for (std::size_t lane = 0; lane < this->lanes; ++lane) {
+		auto executed = this->slice_instructions[lane];
+		this->slice_instructions[lane] = 0;
+		this->instructions[lane] += executed;
+
+		if (this->instructions_per_tick != 0 && executed != 0) {
+			// Slices never run past a tick, so this reaches 0 right after the instruction the tick is due after
+			this->instructions_until_tick[lane] -= executed;
+			if (this->instructions_until_tick[lane] == 0) {
+				this->delay[lane] -= this->delay[lane] > 0 ? 1 : 0;
+				this->sound[lane] -= this->sound[lane] > 0 ? 1 : 0;
+				this->instructions_until_tick[lane] = this->instructions_per_tick;
+			}
+		}
+
+		bool can_run = this->state[lane] == State::Running && this->instructions[lane] < this->instruction_limit[lane];
+		this->active[lane] = can_run ? 0xFF : 0x00;
+		if (!can_run) {
+			continue;
+		}
+
+		++this->active_count;
+		rounds = static_cast<unsigned>(std::min<unsigned long long>(rounds, this->instruction_limit[lane] - this->instructions[lane]));
+		if (this->instructions_per_tick != 0) {
+			rounds = static_cast<unsigned>(std::min<unsigned long>(rounds, this->instructions_until_tick[lane]));
+		}
+	}
+
+	this->next_address_known = false;
+	return this->active_count > 0 ? rounds : 0;
+}
+
+std::size_t Chip8BatchVm::step() {
+	if (this->active_count == 0) {
+		return 0;
+	}
+
+	// Always executing the lowest address first lets lanes that branched apart meet up again at the next common address
+	auto address = this->next_address_known ? this->next_address : Lanes::lowestAddress(this->pc.data(), this->active.data(), this->stride);
+	this->next_address_known = false;
+
+	if (!this->active[this->leader] || this->pc[this->leader] != address) {
+		this->leader = 0;
+		while (!this->active[this->leader] || this->pc[this->leader] != address) {
+			++this->leader;
+		}
+	}
+
+	std::size_t executed = 0;
+	if (address + 1 >= MEMORY_SIZE) {
+		// Not enough memory left to hold a full instruction, matches Chip8ReferenceVm::step()
+		for (std::size_t lane = 0; lane < this->lanes; ++lane) {
+			if (this->active[lane] && this->pc[lane] == address) {
+				++this->slice_instructions[lane];
+				++executed;
+				this->halt(lane);
+			}
+		}
+		return executed;
+	}
+
+	const uint8_t *row_hi = &this->ram[address * this->stride];
+	const uint8_t *row_lo = &this->ram[(address + 1) * this->stride];
+	uint8_t hi = row_hi[this->leader];
+	uint8_t lo = row_lo[this->leader];
+
+	// Lanes at the same address that have rewritten the instruction wait for a later round
+	executed = select(this->selected.data(), this->slice_instructions.data(), this->pc.data(), this->active.data(), row_hi, row_lo, address, hi, lo, this->stride);
+
+	// When every active lane executes this instruction they all end up at the same address afterwards, unless the instruction branches per lane
+	bool lockstep = executed == this->active_count;
+	auto next = static_cast<uint16_t>(address + 2);
+
+	const uint8_t x = hi & 0xF;
+	const uint8_t y = lo >> 4;
+	const uint8_t nn = lo;
+	const uint16_t nnn = static_cast<uint16_t>((hi & 0xF) << 8 | lo);
+	const uint8_t *mask = this->selected.data();
+	uint8_t *vx = this->v[x].data();
+	uint8_t *vy = this->v[y].data();
+	uint8_t *vf = this->v[0xF].data();
+	const auto count = this->stride;
+
+	auto for_each_selected = [&](auto function) {
+		for (std::size_t lane = 0; lane < this->lanes; ++lane) {
+			if (this->selected[lane]) {
+				function(lane);
+			}
+		}
+	};
+
+	auto skip_lanes = [&](std::size_t skipped) {
+		this->skip(address, skipped);
+		lockstep = lockstep && (skipped == 0 || skipped == executed);
+		next = static_cast<uint16_t>(skipped == 0 ? address + 2 : address + 4);
+	};
+
+	switch (hi >> 4)
+	{
+	case 0x0:
+		if (hi == 0x00 && lo == 0xE0) {
+			//00E0 Clear the screen
+			for_each_selected([&](std::size_t lane) { this->display[lane].clear(); });
+		}
+		else if (hi == 0x00 && lo == 0xEE) {
+			//00EE Return from a subroutine, ignored when the stack is empty
+			for_each_selected([&](std::size_t lane) {
+				if (this->stack_size[lane] > 0) {
+					this->pc[lane] = this->call_stack[--this->stack_size[lane] * this->stride + lane];
+				}
+			});
+			lockstep = false;
+		}
+		else if (hi == 0x00 && lo == 0x00) {
+			//0000 Halt (Octo)
+			for_each_selected([&](std::size_t lane) { this->halt(lane); });
+			lockstep = false;
+		}
+		// 0NNN is not supported
+		break;
+
+	case 0x1:
+		//1NNN Jump to address NNN
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			Lanes::setAddress(this->pc.data() + lane, Lanes::load(mask + lane), nnn);
+		}
+		next = nnn;
+		break;
+
+	case 0x2:
+		//2NNN Execute subroutine starting at address NNN
+		for_each_selected([&](std::size_t lane) {
+			if (this->stack_size[lane] == STACK_SIZE) {
+				this->halt(lane);
+				return;
+			}
+			this->call_stack[this->stack_size[lane]++ * this->stride + lane] = this->pc[lane];
+			this->pc[lane] = nnn;
+		});
+		next = nnn;
+		break;
+
+	case 0x3:
+		//3XNN Skip the following instruction if the value of register VX equals NN
+		skip_lanes(compare(this->condition.data(), vx, nn, mask, count, true));
+		break;
+
+	case 0x4:
+		//4XNN Skip the following instruction if the value of register VX is not equal to NN
+		skip_lanes(compare(this->condition.data(), vx, nn, mask, count, false));
+		break;
+
+	case 0x5:
+		//5XY0 Skip the following instruction if the value of register VX is equal to the value of register VY
+		skip_lanes(compare(this->condition.data(), vx, vy, mask, count, true));
+		break;
+
+	case 0x6:
+		//6XNN Store number NN in register VX
+		apply(vx, vx, mask, count, [&](Vec, Vec) { return Lanes::splat(nn); });
+		break;
+
+	case 0x7:
+		//7XNN Add the value NN to register VX
+		apply(vx, vx, mask, count, [&](Vec a, Vec) { return Lanes::add(a, Lanes::splat(nn)); });
+		break;
+
+	case 0x8:
+		switch (lo & 0xF)
+		{
+		case 0x0:
+			//8XY0 Store the value of register VY in register VX
+			apply(vx, vy, mask, count, [](Vec, Vec b) { return b; });
+			break;
+
+		case 0x1:
+			//8XY1 Set VX to VX OR VY
+			apply(vx, vy, mask, count, [](Vec a, Vec b) { return Lanes::bitOr(a, b); });
+			break;
+
+		case 0x2:
+			//8XY2 Set VX to VX AND VY
+			apply(vx, vy, mask, count, [](Vec a, Vec b) { return Lanes::bitAnd(a, b); });
+			break;
+
+		case 0x3:
+			//8XY3 Set VX to VX XOR VY
+			apply(vx, vy, mask, count, [](Vec a, Vec b) { return Lanes::bitXor(a, b); });
+			break;
+
+		case 0x4:
+			//8XY4 Add the value of register VY to register VX, VF is set to 1 if a carry occurs
+			applyWithFlag(vx, vy, vf, mask, count, [](Vec a, Vec b) {
+				// a + b carries iff a > ~b
+				auto not_b = Lanes::bitXor(b, Lanes::splat(0xFF));
+				auto no_carry = Lanes::equal(Lanes::max(a, not_b), not_b);
+				return Flagged{ Lanes::add(a, b), Lanes::andNot(no_carry, Lanes::splat(1)) };
+			});
+			break;
+
+		case 0x5:
+			//8XY5 Subtract the value of register VY from register VX, VF is set to 0 if a borrow occurs
+			applyWithFlag(vx, vy, vf, mask, count, [](Vec a, Vec b) {
+				auto no_borrow = Lanes::equal(Lanes::max(a, b), a);
+				return Flagged{ Lanes::subtract(a, b), Lanes::bitAnd(no_borrow, Lanes::splat(1)) };
+			});
+			break;
+
+		case 0x6:
+			//8XY6 Store the value of register VY shifted right one bit in register VX, VF is set to the least significant bit prior to the shift
+			applyWithFlag(vx, vy, vf, mask, count, [](Vec, Vec b) {
+				return Flagged{ Lanes::shiftRight1(b), Lanes::bitAnd(b, Lanes::splat(1)) };
+			});
+			break;
+
+		case 0x7:
+			//8XY7 Set register VX to the value of VY minus VX, VF is set to 0 if a borrow occurs
+			applyWithFlag(vx, vy, vf, mask, count, [](Vec a, Vec b) {
+				auto no_borrow = Lanes::equal(Lanes::max(b, a), b);
+				return Flagged{ Lanes::subtract(b, a), Lanes::bitAnd(no_borrow, Lanes::splat(1)) };
+			});
+			break;
+
+		case 0xE:
+			//8XYE Store the value of register VY shifted left one bit in register VX, VF is set to the most significant bit prior to the shift
+			applyWithFlag(vx, vy, vf, mask, count, [](Vec, Vec b) {
+				auto low = Lanes::equal(Lanes::max(b, Lanes::splat(0x7F)), Lanes::splat(0x7F));
+				return Flagged{ Lanes::add(b, b), Lanes::andNot(low, Lanes::splat(1)) };
+			});
+			break;
+		}
+		break;
+
+	case 0x9:
+		//9XY0 Skip the following instruction if the value of register VX is not equal to the value of register VY
+		skip_lanes(compare(this->condition.data(), vx, vy, mask, count, false));
+		break;
+
+	case 0xA:
+		//ANNN Store memory address NNN in register I
+		for (std::size_t lane = 0; lane < count; lane += Lanes::WIDTH) {
+			Lanes::setAddress(this->i.data() + lane, Lanes::load(mask + lane), nnn);
+		}
+		break;
+
+	case 0xB:
+		//BNNN Jump to address NNN + V0
+		for (std::size_t lane = 0; lane < count; ++lane) {
+			this->pc[lane] = this->selected[lane] ? static_cast<uint16_t>(nnn + this->v[0x0][lane]) : this->pc[lane];
+		}
+		lockstep = false;
+		break;
+
+	case 0xC:
+		//CXNN Set VX to a random number with a mask of NN
+		Chip8Random::nextBytes({ this->random[0].data(), this->random[1].data(), this->random[2].data(), this->random[3].data() }, this->selected.data(), vx,
+			this->stride);
+		for (std::size_t lane = 0; lane < this->stride; ++lane) {
+			vx[lane] &= nn | ~this->selected[lane];
+		}
+		break;
+
+	case 0xD:
+		//DXYN Draw a sprite at position VX, VY with N bytes of sprite data starting at the address stored in I
+		for_each_selected([&](std::size_t lane) { this->drawSprite(lane, vx[lane], vy[lane], lo & 0xF); });
+		break;
+
+	case 0xE:
+		if (lo == 0x9E || lo == 0xA1) {
+			//EX9E Skip the following instruction if the key corresponding to the hex value currently stored in register VX is pressed
+			//EXA1 Skip the following instruction if the key corresponding to the hex value currently stored in register VX is not pressed
+			bool expected = lo == 0x9E;
+			std::size_t skipped = 0;
+			for (std::size_t lane = 0; lane < count; ++lane) {
+				bool pressed = vx[lane] < 16 && (this->keys[lane] >> vx[lane]) & 1;
+				this->condition[lane] = this->selected[lane] && pressed == expected ? 0xFF : 0x00;
+				skipped += this->condition[lane] & 1;
+			}
+			skip_lanes(skipped);
+		}
+		break;
+
+	case 0xF:
+		switch (lo)
+		{
+		case 0x07:
+			//FX07 Store the current value of the delay timer in register VX
+			apply(vx, this->delay.data(), mask, count, [](Vec, Vec b) { return b; });
+			break;
+
+		case 0x0A:
+			//FX0A Wait for a keypress and store the result in register VX
+			for_each_selected([&](std::size_t lane) {
+				this->keypress_target_register[lane] = x;
+				this->state[lane] = State::Blocked;
+				this->active[lane] = 0x00;
+				--this->active_count;
+			});
+			break;
+
+		case 0x15:
+			//FX15 Set the delay timer to the value of register VX
+			apply(this->delay.data(), vx, mask, count, [](Vec, Vec b) { return b; });
+			break;
+
+		case 0x18:
+			//FX18 Set the sound timer to the value of register VX
+			apply(this->sound.data(), vx, mask, count, [](Vec, Vec b) { return b; });
+			break;
+
+		case 0x1E:
+			//FX1E Add the value stored in register VX to register I
+			for (std::size_t lane = 0; lane < count; ++lane) {
+				this->i[lane] += this->selected[lane] ? vx[lane] : 0;
+			}
+			break;
+
+		case 0x29:
+			//FX29 Set I to the memory address of the sprite data corresponding to the hexadecimal digit stored in register VX
+			for (std::size_t lane = 0; lane < count; ++lane) {
+				this->i[lane] = this->selected[lane] ? static_cast<uint16_t>(FONT_OFFSET + 5 * (vx[lane] & 0xF)) : this->i[lane];
+			}
+			break;
+
+		case 0x33:
+			//FX33 Store the binary-coded decimal equivalent of the value stored in register VX at addresses I, I + 1, and I + 2
+			for_each_selected([&](std::size_t lane) {
+				auto val = vx[lane];
+				this->ram[(this->i[lane] & ADDRESS_MASK) * this->stride + lane] = val / 100 % 10;
+				this->ram[((this->i[lane] + 1) & ADDRESS_MASK) * this->stride + lane] = val / 10 % 10;
+				this->ram[((this->i[lane] + 2) & ADDRESS_MASK) * this->stride + lane] = val % 10;
+			});
+			break;
+
+		case 0x55:
+			//FX55 Store the values of registers V0 to VX inclusive in memory starting at address I, I is set to I + X + 1 after operation
+			for_each_selected([&](std::size_t lane) {
+				for (uint_fast8_t r = 0; r <= x; ++r) {
+					this->ram[((this->i[lane] + r) & ADDRESS_MASK) * this->stride + lane] = this->v[r][lane];
+				}
+				this->i[lane] += x + 1;
+			});
+			break;
+
+		case 0x65:
+			//FX65 Fill registers V0 to VX inclusive with the values stored in memory starting at address I, I is set to I + X + 1 after operation
+			for_each_selected([&](std::size_t lane) {
+				for (uint_fast8_t r = 0; r <= x; ++r) {
+					this->v[r][lane] = this->ram[((this->i[lane] + r) & ADDRESS_MASK) * this->stride + lane];
+				}
+				this->i[lane] += x + 1;
+			});
+			break;
+		}
+		break;
+	}
+
+	this->next_address_known = lockstep;
+	this->next_address = next;
+	return executed;
+}
+
+void Chip8BatchVm::halt(std::size_t lane) {
+	this->pc[lane] = MEMORY_SIZE;
+	this->state[lane] = State::Halted;
+	if (this->active[lane]) {
+		this->active[lane] = 0x00;
+		--this->active_count;
+	}
+}
+
+void Chip8BatchVm::skip(uint16_t address, std::size_t skipped) {
+	if (skipped == 0) {
+		return;
+	}
+
+	if (address + 3 >= MEMORY_SIZE) {
+		// The skipped instruction would run past the end of memory, Chip8ReferenceVm::skip() halts in this case
+		for (std::size_t lane = 0; lane < this->lanes; ++lane) {
+			if (this->condition[lane]) {
+				this->halt(lane);
+			}
+		}
+		return;
+	}
+
+	for (std::size_t lane = 0; lane < this->stride; lane += Lanes::WIDTH) {
+		Lanes::addAddress(this->pc.data() + lane, Lanes::load(this->condition.data() + lane), 2);
+	}
+}
+
+bool Chip8BatchVm::isRunning(std::size_t lane) const {
+	return this->state[lane] == State::Running;
+}
+
+bool Chip8BatchVm::isLive(std::size_t lane) const {
+	return this->state[lane] != State::Halted;
+}
+
+void Chip8BatchVm::setKeyState(std::size_t lane, uint_fast8_t key, bool pressed) {
+	if (key >= 16) {
+		return;
+	}
+
+	if (pressed) {
+		if (this->keypress_target_register[lane] != NO_KEY) {
+			this->v[this->keypress_target_register[lane]][lane] = key;
+			this->keypress_target_register[lane] = NO_KEY;
+			this->state[lane] = State::Running;
+		}
+		this->keys[lane] |= 1 << key;
+	}
+	else {
+		this->keys[lane] &= ~(1 << key);
+	}
+}
+
+void Chip8BatchVm::clearKeyState(std::size_t lane) {
+	this->keys[lane] = 0;
+}
+
+const Chip8BatchVm::Display &Chip8BatchVm::getDisplayBuffer(std::size_t lane) const {
+	return this->display[lane];
+}
+
+const Chip8BatchVm::Timer Chip8BatchVm::getSoundTimer(std::size_t lane) const {
+	return this->sound[lane];
+}
+
+std::array<uint8_t, 16> Chip8BatchVm::getRegisters(std::size_t lane) const {
+	std::array<uint8_t, 16> registers;
+	for (std::size_t r = 0; r < registers.size(); ++r) {
+		registers[r] = this->v[r][lane];
+	}
+	return registers;
+}
+
+uint_fast16_t Chip8BatchVm::getProgramCounter(std::size_t lane) const {
+	return this->pc[lane];
+}
+
+uint_fast16_t Chip8BatchVm::getAddressRegister(std::size_t lane) const {
+	return this->i[lane];
+}
+
+std::array<uint16_t, 16> Chip8BatchVm::getCallStack(std::size_t lane) const {
+	std::array<uint16_t, 16> call_stack{};
+	for (uint_fast8_t depth = 0; depth < this->stack_size[lane]; ++depth) {
+		call_stack[depth] = this->call_stack[depth * this->stride + lane];
+	}
+	return call_stack;
+}
+
+uint_fast8_t Chip8BatchVm::getStackDepth(std::size_t lane) const {
+	return this->stack_size[lane];
+}
+
+unsigned long long Chip8BatchVm::getInstructionCount(std::size_t lane) const {
+	return this->instructions[lane];
+}
+
+void Chip8BatchVm::drawSprite(std::size_t lane, uint8_t x, uint8_t y, uint8_t lines) {
+	std::array<std::byte, 16> sprite;
+	for (uint_fast8_t line = 0; line < lines; ++line) {
+		sprite[line] = std::byte{ this->ram[((this->i[lane] + line) & ADDRESS_MASK) * this->stride + lane] };
+	}
+
+	this->v[0xF][lane] = this->display[lane].drawSprite(x, y, std::span{ sprite.data(), lines }) ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "Chip8Display.h"
+#include "Chip8Random.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+* Runs many copies of the same ROM side by side, intended for fuzzing and search workloads where only the input or RNG seed differs between runs.
+*
+* State is stored as a structure of arrays with one column per lane (v[16][lanes], pc[lanes], ram[4096][lanes], ...). Each round the engine picks the
+* lowest program counter of any lane that can run, and every lane at that address holding the same instruction executes it together. Register only
+* instructions are applied to whole rows of lanes at once with SSE2/AVX2 kernels, the rest loop over the selected lanes. Lanes that branch differently
+* simply end up at different addresses and are picked up by later rounds, reconverging once they reach the same address again.
+*
+* Each lane behaves exactly like a Chip8ReferenceVm with the Octo quirks (see Chip8Quirks) and timers clocked by instruction count, except that a halted
+* lane always reports pc as the end of RAM.
+*/
+class Chip8BatchVm {
+public:
+	Chip8BatchVm(const std::span<const std::byte> &rom, std::size_t lanes);
+
+	// Start every lane over with a different ROM as if newly constructed, keeping the lane count and instructions per tick and reusing the columns
+	// already allocated.
+	void load(const std::span<const std::byte> &rom);
+
+	std::size_t getLaneCount() const;
+
+	// Every lane starts from seed 0 like the other VMs, reseed lanes for different runs.
+	void seed(std::size_t lane, uint32_t seed);
+
+	// Timers of each lane tick once every N instructions that lane executes. 0 [default] only ticks them on calls to tick().
+	void setInstructionsPerTick(unsigned long);
+
+	// Tick the timers of every lane.
+	void tick();
+
+	/**
+	* Stop a lane once it has executed a total number of instructions (since construction or the last load()).
+	*
+	* Lanes have no limit by default, run() needs every lane to have a limit or stop on its own to return.
+	*/
+	void setInstructionLimit(std::size_t lane, unsigned long long instructions);
+
+	/**
+	* Run until every lane has hit its instruction limit, is waiting for a key, or has halted.
+	*
+	* @return The total number of instructions executed across all lanes.
+	*/
+	unsigned long long run();
+
+	bool isRunning(std::size_t lane) const;
+	bool isLive(std::size_t lane) const;
+
+	void setKeyState(std::size_t lane, uint_fast8_t keyCode, bool isPressed);
+	void clearKeyState(std::size_t lane);
+
+	static constexpr uint_fast8_t DISPLAY_WIDTH = Chip8Display::WIDTH;
+	static constexpr uint_fast8_t DISPLAY_HEIGHT = Chip8Display::HEIGHT;
+	using Display = Chip8Display;
+	const Display &getDisplayBuffer(std::size_t lane) const;
+
+	using Timer = uint_fast8_t;
+	const Timer getSoundTimer(std::size_t lane) const;
+
+	std::array<uint8_t, 16> getRegisters(std::size_t lane) const;
+	uint_fast16_t getProgramCounter(std::size_t lane) const;
+	uint_fast16_t getAddressRegister(std::size_t lane) const;
+
+	// Return addresses of the lane's active calls, innermost last. Entries past the stack depth are 0.
+	std::array<uint16_t, 16> getCallStack(std::size_t lane) const;
+	uint_fast8_t getStackDepth(std::size_t lane) const;
+	unsigned long long getInstructionCount(std::size_t lane) const;
+
+protected:
+	static constexpr uint16_t MEMORY_SIZE = 4096;
+	static constexpr uint16_t ADDRESS_MASK = MEMORY_SIZE - 1;
+	static constexpr uint16_t FONT_OFFSET = 0x50;
+	static constexpr uint16_t ROM_OFFSET = 0x200;
+	static constexpr uint_fast8_t STACK_SIZE = 16;
+
+	// Columns are padded to a multiple of this so the vector kernels never need a scalar tail. Padding lanes are never active.
+	static constexpr std::size_t LANE_ALIGNMENT = 32;
+
+	std::size_t lanes;
+	std::size_t stride;
+
+	// Lane masks hold 0xFF for selected lanes and 0x00 for the rest so they can be used directly as vector blend masks.
+	using LaneMask = std::vector<uint8_t>;
+
+	std::vector<uint8_t> ram; // [address][lane]
+	std::array<std::vector<uint8_t>, 16> v; // [register][lane]
+	std::vector<uint16_t> pc;
+	std::vector<uint16_t> i;
+
+	std::vector<uint16_t> call_stack; // [depth][lane]
+	std::vector<uint8_t> stack_size;
+
+	std::vector<uint8_t> delay;
+	std::vector<uint8_t> sound;
+	unsigned long instructions_per_tick = 0;
+	std::vector<unsigned long> instructions_until_tick;
+
+	std::vector<uint16_t> keys;
+	std::vector<Display> display;
+	std::array<std::vector<uint32_t>, 4> random; // [state word][lane], see Chip8Random
+
+	std::vector<unsigned long long> instructions;
+	std::vector<unsigned long long> instruction_limit;
+
+	enum class State : uint8_t {
+		Running,
+		Blocked,
+		Halted
+	};
+	std::vector<State> state;
+
+	static constexpr uint8_t NO_KEY = 0xFF;
+	std::vector<uint8_t> keypress_target_register;
+
+	// Lanes that can execute, the subset executing the current round, and scratch space for the outcome of conditional instructions.
+	LaneMask active;
+	LaneMask selected;
+	LaneMask condition;
+	std::size_t active_count = 0;
+
+	// Rounds are grouped into slices short enough that no lane can reach its instruction limit or a timer tick before the end of the slice. Per-lane
+	// instruction counts are only kept in bytes during a slice and added up afterwards, keeping the per-round work to byte-wide vector operations.
+	static constexpr unsigned MAX_SLICE_ROUNDS = 255;
+	std::vector<uint8_t> slice_instructions;
+
+	/**
+	* Add up the instructions executed by each lane during the last slice, ticking timers and retiring lanes that reached their limit.
+	*
+	* @return The number of rounds that can be executed in the next slice, 0 once no lane is active.
+	*/
+	unsigned endSlice();
+
+	// While every active lane executes the same instructions in lockstep the next address is known without searching every lane for it.
+	bool next_address_known = false;
+	uint16_t next_address = 0;
+	std::size_t leader = 0;
+
+	/**
+	* Execute one round, the instruction at the lowest active program counter across every lane that shares it.
+	*
+	* @return The number of lanes that executed an instruction, 0 once no lane is active.
+	*/
+	std::size_t step();
+
+	void halt(std::size_t lane);
+
+	// Fill every lane's RAM with the font and ROM, the rest of RAM is left as it is.
+	void loadMemory(const std::span<const std::byte> &rom);
+
+	/**
+	* Skip the next instruction in every lane where condition is set, halting lanes that would run off the end of memory.
+	*
+	* @param address Address of the skip instruction.
+	* @param skipped The number of lanes with condition set.
+	*/
+	void skip(uint16_t address, std::size_t skipped);
+
+	void drawSprite(std::size_t lane, uint8_t x, uint8_t y, uint8_t lines);
+};
@@ -0,0 +1,557 @@
+#include "Chip8Display.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CHIP8_DISPLAY_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHIP8_DISPLAY_SSE2 1
+#endif
+
+namespace {
+	/**
+	* XOR lines of a sprite onto consecutive rows, each line rotated right by the same amount.
+	*
+	* Lines are processed as many at a time as the target supports (4 with AVX2, 2 with SSE2) with a scalar loop for the remainder.
+	*
+	* @return true if any lit pixel was turned off.
+	*/
+	bool blit(Chip8Display::Row *rows, Chip8Display::Row *dirty, const std::byte *sprite, std::size_t lines, unsigned shift) {
+		std::size_t line = 0;
+		bool collision = false;
+
+#if defined(CHIP8_DISPLAY_AVX2)
+		// Vector shifts by 64 or more produce 0, so the left half of the rotate is a no-op when shift is 0 instead of undefined behaviour.
+		auto right = _mm_cvtsi32_si128(static_cast<int>(shift));
+		auto left = _mm_cvtsi32_si128(static_cast<int>(64 - shift));
+		auto hits = _mm256_setzero_si256();
+		for (; line + 4 <= lines; line += 4) {
+			int32_t data;
+			std::memcpy(&data, sprite + line, sizeof(data));
+			auto pixels = _mm256_slli_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(data)), 56);
+			pixels = _mm256_or_si256(_mm256_srl_epi64(pixels, right), _mm256_sll_epi64(pixels, left));
+
+			auto target = reinterpret_cast<__m256i *>(rows + line);
+			auto current = _mm256_loadu_si256(target);
+			hits = _mm256_or_si256(hits, _mm256_and_si256(current, pixels));
+			_mm256_storeu_si256(target, _mm256_xor_si256(current, pixels));
+
+			auto changed = reinterpret_cast<__m256i *>(dirty + line);
+			_mm256_storeu_si256(changed, _mm256_or_si256(_mm256_loadu_si256(changed), pixels));
+		}
+		collision = !_mm256_testz_si256(hits, hits);
+#elif defined(CHIP8_DISPLAY_SSE2)
+		auto right = _mm_cvtsi32_si128(static_cast<int>(shift));
+		auto left = _mm_cvtsi32_si128(static_cast<int>(64 - shift));
+		auto hits = _mm_setzero_si128();
+		for (; line + 2 <= lines; line += 2) {
+			auto pixels = _mm_set_epi64x(static_cast<long long>(std::to_integer<uint64_t>(sprite[line + 1]) << 56), static_cast<long long>(std::to_integer<uint64_t>(sprite[line]) << 56));
+			pixels = _mm_or_si128(_mm_srl_epi64(pixels, right), _mm_sll_epi64(pixels, left));
+
+			auto target = reinterpret_cast<__m128i *>(rows + line);
+			auto current = _mm_loadu_si128(target);
+			hits = _mm_or_si128(hits, _mm_and_si128(current, pixels));
+			_mm_storeu_si128(target, _mm_xor_si128(current, pixels));
+
+			auto changed = reinterpret_cast<__m128i *>(dirty + line);
+			_mm_storeu_si128(changed, _mm_or_si128(_mm_loadu_si128(changed), pixels));
+		}
+		collision = _mm_movemask_epi8(_mm_cmpeq_epi8(hits, _mm_setzero_si128())) != 0xFFFF;
+#endif
+
+		for (; line < lines; ++line) {
+			auto pixels = std::rotr(std::to_integer<Chip8Display::Row>(sprite[line]) << 56, static_cast<int>(shift));
+			collision |= (rows[line] & pixels) != 0;
+			rows[line] ^= pixels;
+			dirty[line] |= pixels;
+		}
+
+		return collision;
+	}
+
+	// Rotate a 128 pixel row stored as two words (leftmost pixels first) to the right.
+	std::array<Chip8Display::Row, Chip8Display::WORDS> rotr128(Chip8Display::Row left, Chip8Display::Row right, unsigned shift) {
+		shift %= 128;
+		if (shift >= 64) {
+			std::swap(left, right);
+			shift -= 64;
+		}
+		if (shift == 0) {
+			return { left, right };
+		}
+		return { left >> shift | right << (64 - shift), right >> shift | left << (64 - shift) };
+	}
+
+	// Hashed along with the pixels so a blank hires display doesn't hash the same as a blank lores one
+	constexpr uint64_t HIRES_HASH = 0x6A09E667F3BCC909;
+
+	/**
+	* Contribution of one word of a plane to the display hash.
+	*
+	* Every step (multiplying by an odd number, xorshift) is invertible, so a word's contribution changes whenever its pixels do while an unlit word
+	* contributes 0. The pixels are mixed into the low bits before multiplying by the key for the position: a word with only its leftmost pixels lit would
+	* otherwise only see the low bits of the key, and the same sprite in two places could cancel out.
+	*
+	* @param index Position of the word, unique across planes, words and rows.
+	*/
+	constexpr uint64_t contribution(std::size_t index, Chip8Display::Row pixels) {
+		auto hash = pixels * 0xD6E8FEB86659FD93;
+		hash ^= hash >> 32;
+		hash *= (2 * index + 1) * 0x9E3779B97F4A7C15;
+		hash ^= hash >> 32;
+		hash *= 0xD6E8FEB86659FD93;
+		return hash ^ hash >> 32;
+	}
+
+	constexpr std::size_t word_index(uint_fast8_t plane, uint_fast8_t word, uint_fast8_t row) {
+		return (static_cast<std::size_t>(plane) * Chip8Display::WORDS + word) * Chip8Display::HIRES_HEIGHT + row;
+	}
+}
+
+Chip8Display::Chip8Display(const Chip8Display &other) :
+	planes(other.planes),
+	hires(other.hires),
+	selected_planes(other.selected_planes),
+	plane_hashes(other.plane_hashes),
+	clean_hash(other.getHash())
+{
+}
+
+Chip8Display &Chip8Display::operator=(const Chip8Display &other) {
+	this->planes = other.planes;
+	this->dirty.clear();
+	this->hires = other.hires;
+	this->selected_planes = other.selected_planes;
+	this->plane_hashes = other.plane_hashes;
+	this->clean_hash = other.getHash();
+	return *this;
+}
+
+std::size_t Chip8Display::getPlaneSize() const {
+	return this->hires ? static_cast<std::size_t>(WORDS) * HIRES_HEIGHT : HEIGHT;
+}
+
+Chip8Display::Row Chip8Display::getWord(uint_fast8_t plane, std::size_t index) const {
+	return this->planes[plane] ? this->planes[plane][index] : 0;
+}
+
+Chip8Display::Row *Chip8Display::getWritablePlane(uint_fast8_t plane) {
+	auto &rows = this->planes[plane];
+	if (!rows) {
+		rows = std::make_shared<Row[]>(this->getPlaneSize());
+	}
+	else if (rows.use_count() > 1) {
+		// The other displays keep the pixels as they are
+		auto copy = std::make_shared_for_overwrite<Row[]>(this->getPlaneSize());
+		std::copy_n(rows.get(), this->getPlaneSize(), copy.get());
+		rows = std::move(copy);
+	}
+	else {
+		// The last copy may have been dropped by another thread (e.g. a frame handed to a renderer), what it read has to come before these writes
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+	return rows.get();
+}
+
+Chip8Display::Row *Chip8Display::getDirty() {
+	if (this->dirty.empty()) {
+		this->dirty.resize(this->getPlaneSize());
+	}
+	return this->dirty.data();
+}
+
+template<typename Function>
+void Chip8Display::forEachSelectedPlane(Function &&function) {
+	for (uint_fast8_t plane = 0; plane < PLANES; ++plane) {
+		if (this->selected_planes & (1 << plane)) {
+			function(plane);
+		}
+	}
+}
+
+template<typename Function>
+void Chip8Display::scrollSelectedPlanes(Function &&scroll) {
+	this->forEachSelectedPlane([&](uint_fast8_t index) {
+		if (!this->planes[index]) {
+			return;
+		}
+
+		// The pixels as they were only need to live long enough to find what changed, so they're kept on the stack rather than in another plane
+		std::array<Row, WORDS * HIRES_HEIGHT> before;
+		std::copy_n(this->planes[index].get(), this->getPlaneSize(), before.data());
+		auto plane = this->getWritablePlane(index);
+		scroll(plane);
+		this->markChanged(index, before.data(), plane);
+	});
+}
+
+void Chip8Display::setHires(bool hires) {
+	this->hires = hires;
+	for (auto &plane : this->planes) {
+		plane.reset();
+	}
+
+	// Renderers need to redraw the whole screen at the new size
+	this->dirty.assign(this->getPlaneSize(), ~Row{ 0 });
+	this->plane_hashes.fill(0);
+}
+
+bool Chip8Display::isHires() const {
+	return this->hires;
+}
+
+uint_fast8_t Chip8Display::getWidth() const {
+	return this->hires ? HIRES_WIDTH : WIDTH;
+}
+
+uint_fast8_t Chip8Display::getHeight() const {
+	return this->hires ? HIRES_HEIGHT : HEIGHT;
+}
+
+void Chip8Display::selectPlanes(uint8_t mask) {
+	this->selected_planes = mask & ((1 << PLANES) - 1);
+}
+
+uint8_t Chip8Display::getSelectedPlanes() const {
+	return this->selected_planes;
+}
+
+void Chip8Display::clear() {
+	this->forEachSelectedPlane([&](uint_fast8_t index) {
+		if (!this->planes[index]) {
+			return;
+		}
+
+		// Only lit pixels change
+		auto dirty = this->getDirty();
+		for (std::size_t row = 0; row < this->getPlaneSize(); ++row) {
+			dirty[row] |= this->planes[index][row];
+		}
+		this->plane_hashes[index] = 0;
+
+		// A plane shared with other displays is left to them, otherwise it's kept to draw on again
+		if (this->planes[index].use_count() > 1) {
+			this->planes[index].reset();
+		}
+		else {
+			std::fill_n(this->getWritablePlane(index), this->getPlaneSize(), 0);
+		}
+	});
+}
+
+bool Chip8Display::drawSprite(uint_fast8_t x, uint_fast8_t y, std::span<const std::byte> sprite, bool wrap) {
+	return this->draw(x, y, sprite, 1, wrap);
+}
+
+bool Chip8Display::drawWideSprite(uint_fast8_t x, uint_fast8_t y, std::span<const std::byte> sprite, bool wrap) {
+	return this->draw(x, y, sprite, 2, wrap);
+}
+
+bool Chip8Display::draw(uint_fast8_t x, uint_fast8_t y, std::span<const std::byte> sprite, uint_fast8_t bytes_per_line, bool wrap) {
+	const auto width = this->getWidth();
+	const auto height = this->getHeight();
+	const auto plane_count = static_cast<std::size_t>(std::popcount(this->selected_planes));
+	if (plane_count == 0) {
+		return false;
+	}
+
+	const auto plane_bytes = sprite.size() / plane_count;
+	unsigned shift = x % width;
+	bool collision = false;
+
+	// Clipped sprites keep only the pixels from the starting column to the right edge
+	std::array<Row, WORDS> clip{ ~Row{ 0 } >> shift, 0 };
+	if (this->hires) {
+		clip = shift >= ROW_BITS ? std::array<Row, WORDS>{ 0, ~Row{ 0 } >> (shift - ROW_BITS) } : std::array<Row, WORDS>{ ~Row{ 0 } >> shift, ~Row{ 0 } };
+	}
+
+	auto dirty = this->getDirty();
+	this->forEachSelectedPlane([&](uint_fast8_t index) {
+		auto data = sprite.first(plane_bytes);
+		sprite = sprite.subspan(plane_bytes);
+		auto plane = this->getWritablePlane(index);
+
+		if (!this->hires && bytes_per_line == 1 && wrap) {
+			// Wrapping past the right edge is handled by the rotate. Sprites that run past the bottom of the screen continue from the top, so they're drawn
+			// as runs of consecutive rows.
+			uint_fast8_t row = y % height;
+			while (!data.empty()) {
+				auto lines = std::min<std::size_t>(data.size(), height - row);
+				this->plane_hashes[index] ^= this->hashRows(index, 0, row, lines);
+				collision |= blit(plane + row, dirty + row, data.data(), lines, shift);
+				this->plane_hashes[index] ^= this->hashRows(index, 0, row, lines);
+				data = data.subspan(lines);
+				row = 0;
+			}
+			return;
+		}
+
+		for (std::size_t line = 0; line * bytes_per_line < data.size(); ++line) {
+			if (!wrap && y % height + line >= height) {
+				break;
+			}
+
+			Row pixels = 0;
+			for (uint_fast8_t byte = 0; byte < bytes_per_line; ++byte) {
+				pixels |= std::to_integer<Row>(data[line * bytes_per_line + byte]) << (56 - 8 * byte);
+			}
+
+			auto row = (y + line) % height;
+			std::array<Row, WORDS> words{ std::rotr(pixels, static_cast<int>(shift)), 0 };
+			if (this->hires) {
+				words = rotr128(pixels, 0, shift);
+			}
+			if (!wrap) {
+				words[0] &= clip[0];
+				words[1] &= clip[1];
+			}
+
+			for (uint_fast8_t word = 0; word < WORDS; ++word) {
+				if (words[word] == 0) {
+					continue;
+				}
+
+				auto offset = word * height + row;
+				auto position = word_index(index, word, static_cast<uint_fast8_t>(row));
+				collision |= (plane[offset] & words[word]) != 0;
+				this->plane_hashes[index] ^= contribution(position, plane[offset]) ^ contribution(position, plane[offset] ^ words[word]);
+				plane[offset] ^= words[word];
+				dirty[offset] |= words[word];
+			}
+		}
+	});
+
+	return collision;
+}
+
+uint64_t Chip8Display::hashRows(uint_fast8_t plane, uint_fast8_t word, uint_fast8_t first, std::size_t count) const {
+	uint64_t hash = 0;
+	if (!this->planes[plane]) {
+		return hash;
+	}
+
+	for (std::size_t row = first; row < first + count; ++row) {
+		hash ^= contribution(word_index(plane, word, static_cast<uint_fast8_t>(row)), this->planes[plane][word * this->getHeight() + row]);
+	}
+	return hash;
+}
+
+void Chip8Display::markChanged(uint_fast8_t plane, const Row *before, const Row *after) {
+	const auto height = this->getHeight();
+	for (std::size_t offset = 0; offset < this->getPlaneSize(); ++offset) {
+		auto old_pixels = before ? before[offset] : 0;
+		auto new_pixels = after ? after[offset] : 0;
+		if (old_pixels != new_pixels) {
+			auto position = word_index(plane, static_cast<uint_fast8_t>(offset / height), static_cast<uint_fast8_t>(offset % height));
+			this->getDirty()[offset] |= old_pixels ^ new_pixels;
+			this->plane_hashes[plane] ^= contribution(position, old_pixels) ^ contribution(position, new_pixels);
+		}
+	}
+}
+
+void Chip8Display::scrollDown(uint_fast8_t lines) {
+	const auto height = this->getHeight();
+	lines = std::min(lines, height);
+
+	this->scrollSelectedPlanes([&](Row *plane) {
+		for (auto column = plane; column < plane + this->getPlaneSize(); column += height) {
+			std::move_backward(column, column + height - lines, column + height);
+			std::fill_n(column, lines, 0);
+		}
+	});
+}
+
+void Chip8Display::scrollUp(uint_fast8_t lines) {
+	const auto height = this->getHeight();
+	lines = std::min(lines, height);
+
+	this->scrollSelectedPlanes([&](Row *plane) {
+		for (auto column = plane; column < plane + this->getPlaneSize(); column += height) {
+			std::move(column + lines, column + height, column);
+			std::fill(column + height - lines, column + height, 0);
+		}
+	});
+}
+
+void Chip8Display::scrollLeft(uint_fast8_t pixels) {
+	if (pixels == 0) {
+		return;
+	}
+
+	const auto height = this->getHeight();
+	this->scrollSelectedPlanes([&](Row *plane) {
+		for (uint_fast8_t row = 0; row < height; ++row) {
+			if (!this->hires) {
+				plane[row] = pixels < ROW_BITS ? plane[row] << pixels : 0;
+				continue;
+			}
+
+			// Pixels move from the start of the second word into the end of the first
+			auto left = plane[row];
+			auto right = plane[height + row];
+			if (pixels >= ROW_BITS) {
+				left = pixels < 2 * ROW_BITS ? right << (pixels - ROW_BITS) : 0;
+				right = 0;
+			}
+			else {
+				left = left << pixels | right >> (ROW_BITS - pixels);
+				right <<= pixels;
+			}
+			plane[row] = left;
+			plane[height + row] = right;
+		}
+	});
+}
+
+void Chip8Display::scrollRight(uint_fast8_t pixels) {
+	if (pixels == 0) {
+		return;
+	}
+
+	const auto height = this->getHeight();
+	this->scrollSelectedPlanes([&](Row *plane) {
+		for (uint_fast8_t row = 0; row < height; ++row) {
+			if (!this->hires) {
+				plane[row] = pixels < ROW_BITS ? plane[row] >> pixels : 0;
+				continue;
+			}
+
+			// Pixels move from the end of the first word into the start of the second
+			auto left = plane[row];
+			auto right = plane[height + row];
+			if (pixels >= ROW_BITS) {
+				right = pixels < 2 * ROW_BITS ? left >> (pixels - ROW_BITS) : 0;
+				left = 0;
+			}
+			else {
+				right = right >> pixels | left << (ROW_BITS - pixels);
+				left >>= pixels;
+			}
+			plane[row] = left;
+			plane[height + row] = right;
+		}
+	});
+}
+
+Chip8Display::Row Chip8Display::getRow(uint_fast8_t y) const {
+	return this->getWord(0, y % this->getHeight());
+}
+
+Chip8Display::Row Chip8Display::getRow(uint_fast8_t y, uint_fast8_t word, uint_fast8_t plane) const {
+	word %= WORDS;
+	if (!this->hires && word != 0) {
+		return 0;
+	}
+	return this->getWord(plane % PLANES, word * this->getHeight() + y % this->getHeight());
+}
+
+bool Chip8Display::getPixel(uint_fast8_t x, uint_fast8_t y) const {
+	return this->getPlanes(x, y) != 0;
+}
+
+uint8_t Chip8Display::getPlanes(uint_fast8_t x, uint_fast8_t y) const {
+	x %= this->getWidth();
+	y %= this->getHeight();
+
+	const auto offset = x / ROW_BITS * this->getHeight() + y;
+	uint8_t lit = 0;
+	for (uint_fast8_t plane = 0; plane < PLANES; ++plane) {
+		lit |= ((this->getWord(plane, offset) >> (ROW_BITS - 1 - x % ROW_BITS)) & 1) << plane;
+	}
+	return lit;
+}
+
+void Chip8Display::assign(const Chip8Display &other) {
+	if (this->hires != other.hires) {
+		this->setHires(other.hires);
+	}
+
+	// Planes still shared with the other display (e.g. a snapshot restored before anything was drawn) are known to be the same without comparing them
+	for (uint_fast8_t plane = 0; plane < PLANES; ++plane) {
+		if (this->planes[plane] != other.planes[plane]) {
+			this->markChanged(plane, this->planes[plane].get(), other.planes[plane].get());
+		}
+	}
+	this->planes = other.planes;
+	this->selected_planes = other.selected_planes;
+}
+
+std::vector<Chip8Display::DirtyRegion> Chip8Display::getDirtyRegions() const {
+	std::vector<DirtyRegion> regions;
+	if (this->dirty.empty()) {
+		return regions;
+	}
+
+	const auto words = this->hires ? WORDS : 1;
+	for (uint_fast8_t row = 0; row < this->getHeight(); ++row) {
+		// The leftmost pixel is the most significant bit of the first word
+		int first = -1;
+		int last = -1;
+		for (uint_fast8_t word = 0; word < words; ++word) {
+			auto changed = this->dirty[word * this->getHeight() + row];
+			if (changed == 0) {
+				continue;
+			}
+
+			if (first < 0) {
+				first = word * ROW_BITS + std::countl_zero(changed);
+			}
+			last = word * ROW_BITS + ROW_BITS - 1 - std::countr_zero(changed);
+		}
+
+		if (first >= 0) {
+			regions.push_back({ static_cast<uint_fast8_t>(first), row, static_cast<uint_fast8_t>(last - first + 1) });
+		}
+	}
+
+	return regions;
+}
+
+bool Chip8Display::isDirty() const {
+	return std::any_of(this->dirty.cbegin(), this->dirty.cend(), [](Row changed) { return changed != 0; });
+}
+
+void Chip8Display::clearDirty() {
+	// Keeps its capacity so marking pixels dirty again doesn't allocate
+	this->dirty.clear();
+	this->clean_hash = this->getHash();
+}
+
+uint64_t Chip8Display::getHash() const {
+	uint64_t hash = this->hires ? HIRES_HASH : 0;
+	for (auto plane : this->plane_hashes) {
+		hash ^= plane;
+	}
+	return hash;
+}
+
+uint64_t Chip8Display::getPlaneHash(uint_fast8_t plane) const {
+	return this->plane_hashes[plane % PLANES];
+}
+
+bool Chip8Display::isChanged() const {
+	return this->getHash() != this->clean_hash;
+}
+
+bool Chip8Display::operator==(const Chip8Display &other) const {
+	if (this->hires != other.hires) {
+		return false;
+	}
+
+	for (uint_fast8_t plane = 0; plane < PLANES; ++plane) {
+		if (this->planes[plane] == other.planes[plane]) {
+			continue;
+		}
+		for (std::size_t offset = 0; offset < this->getPlaneSize(); ++offset) {
+			if (this->getWord(plane, offset) != other.getWord(plane, offset)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
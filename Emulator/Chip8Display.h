@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+* Frame buffer shared by the VMs: 64x32 for CHIP-8 (lores), 128x64 for SUPER-CHIP/XO-CHIP hires, with up to 4 bit-planes for XO-CHIP.
+*
+* Each row of a plane is stored as one 64 bit word per 64 pixels with the leftmost pixel in the most significant bit of the first word, so a line of a
+* sprite is drawn with one rotate to move it into position (which also handles wrapping past the right edge), one AND to detect collisions and one XOR to
+* draw it. Scrolling moves whole words up or down, or shifts each row sideways a word at a time.
+*
+* Planes are only allocated at the size of the current resolution (256 bytes in lores, 1 KiB in hires) once something is drawn on them, so a plain CHIP-8
+* program only ever has the 256 bytes of plane 0. Copies of a display (e.g. in VM snapshots) share planes with the original until one of them draws on a
+* plane, which then gets a copy of its own, so keeping many snapshots only costs the planes that changed in between.
+*
+* Pixels changed by drawing, clearing or scrolling are tracked (across all planes) until clearDirty() is called so renderers only need to redraw the parts of
+* the screen that changed. What is marked dirty belongs to a display and isn't copied along with the pixels.
+*
+* A hash of the contents is kept up to date as words change rather than computed on request: each word of each plane contributes a mix of its pixels and
+* position, the contributions are XORed together and an unlit word contributes nothing. Replacing a word XORs out its old contribution and XORs in the new
+* one, so a sprite costs a few extra multiplies per line and comparing frames costs one comparison.
+*/
+class Chip8Display {
+public:
+	// Lores resolution
+	static constexpr uint_fast8_t WIDTH = 64;
+	static constexpr uint_fast8_t HEIGHT = 32;
+
+	// Hires resolution
+	static constexpr uint_fast8_t HIRES_WIDTH = 128;
+	static constexpr uint_fast8_t HIRES_HEIGHT = 64;
+
+	static constexpr uint_fast8_t PLANES = 4;
+
+	using Row = uint64_t;
+	static constexpr uint_fast8_t ROW_BITS = 64;
+	static constexpr uint_fast8_t WORDS = HIRES_WIDTH / ROW_BITS;
+
+	Chip8Display() = default;
+
+	// Copies share planes with the original, see above. Nothing is marked dirty in a copy, assign() marks what changes instead.
+	Chip8Display(const Chip8Display &other);
+	Chip8Display &operator=(const Chip8Display &other);
+
+	// Switching resolution clears every plane.
+	void setHires(bool);
+	bool isHires() const;
+	uint_fast8_t getWidth() const;
+	uint_fast8_t getHeight() const;
+
+	// Bit mask of the planes drawn to, cleared and scrolled (XO-CHIP FN01). Only plane 0 is selected by default.
+	void selectPlanes(uint8_t mask);
+	uint8_t getSelectedPlanes() const;
+
+	// Clear the selected planes.
+	void clear();
+
+	/**
+	* XOR an 8 pixel wide sprite onto the selected planes.
+	*
+	* @param x,y Position of the top left corner of the sprite, wrapped to the screen.
+	* @param sprite One byte per line of the sprite, the most significant bit is the leftmost pixel. When several planes are selected the lines for each
+	*               plane follow each other, lowest plane first.
+	* @param wrap Whether the parts of the sprite past the right and bottom edges continue on the opposite edge (the default) or are clipped.
+	* @return true if any lit pixel was turned off.
+	*/
+	bool drawSprite(uint_fast8_t x, uint_fast8_t y, std::span<const std::byte> sprite, bool wrap = true);
+
+	// As drawSprite() for a 16x16 sprite (SUPER-CHIP DXY0), two bytes per line and 32 bytes per selected plane.
+	bool drawWideSprite(uint_fast8_t x, uint_fast8_t y, std::span<const std::byte> sprite, bool wrap = true);
+
+	// Scroll the selected planes by a number of pixels at the current resolution, pixels scrolled in are unlit.
+	void scrollDown(uint_fast8_t lines);
+	void scrollUp(uint_fast8_t lines);
+	void scrollLeft(uint_fast8_t pixels);
+	void scrollRight(uint_fast8_t pixels);
+
+	// First 64 pixels of a row of plane 0, the whole row in lores.
+	Row getRow(uint_fast8_t y) const;
+
+	/**
+	* @param word Which 64 pixels of the row, only word 0 is used in lores.
+	*/
+	Row getRow(uint_fast8_t y, uint_fast8_t word, uint_fast8_t plane) const;
+
+	// Lit in any plane
+	bool getPixel(uint_fast8_t x, uint_fast8_t y) const;
+
+	// Bit mask of the planes a pixel is lit in
+	uint8_t getPlanes(uint_fast8_t x, uint_fast8_t y) const;
+
+	// Replace the contents with those of another display (e.g. when restoring a snapshot), marking every pixel that changes as dirty.
+	void assign(const Chip8Display &other);
+
+	// A span of pixels on one row, covering every pixel on that row that changed since the last call to clearDirty().
+	struct DirtyRegion {
+		uint_fast8_t x;
+		uint_fast8_t y;
+		uint_fast8_t width;
+	};
+
+	/**
+	* Find the parts of the display that changed since the last call to clearDirty().
+	*
+	* Pixels that were flipped and then flipped back are still reported. Everything is reported after a change of resolution.
+	*
+	* @return At most one region per row, ordered from the top of the screen.
+	*/
+	std::vector<DirtyRegion> getDirtyRegions() const;
+	bool isDirty() const;
+	void clearDirty();
+
+	// Hash of the resolution and the pixels of every plane, equal displays always have equal hashes. A blank lores display hashes to 0.
+	uint64_t getHash() const;
+
+	// The part of getHash() covering one plane, which stays the same for as long as the plane's pixels do. A blank plane hashes to 0.
+	uint64_t getPlaneHash(uint_fast8_t plane) const;
+
+	// Whether the resolution or any pixel differs from when clearDirty() was last called. Unlike isDirty() pixels that were flipped back don't count, so a
+	// frame that was drawn and erased again can be skipped.
+	bool isChanged() const;
+
+	// Compares resolution and pixels only, not what is marked dirty or which planes are selected.
+	bool operator==(const Chip8Display &other) const;
+
+protected:
+	// The rows of one word column after another, so a sprite drawn on consecutive lines touches consecutive words. Only the first word column exists in
+	// lores. Planes are null until drawn on and blank again once cleared.
+	using Plane = std::shared_ptr<Row[]>;
+
+	std::array<Plane, PLANES> planes{};
+
+	// Every pixel changed since the last call to clearDirty() in any plane, in the same layout as a plane. Empty while nothing is.
+	std::vector<Row> dirty;
+
+	bool hires = false;
+	uint8_t selected_planes = 1;
+
+	std::array<uint64_t, PLANES> plane_hashes{};
+	uint64_t clean_hash = 0; // getHash() at the last call to clearDirty()
+
+	// Rows in a plane at the current resolution
+	std::size_t getPlaneSize() const;
+
+	// A word of a plane, 0 if the plane is blank. @param index Position in the plane's layout.
+	Row getWord(uint_fast8_t plane, std::size_t index) const;
+
+	// The rows of a plane, allocated if it's blank and copied if it's shared with another display, ready to be drawn on.
+	Row *getWritablePlane(uint_fast8_t plane);
+
+	// The dirty rows, allocated if nothing is dirty yet.
+	Row *getDirty();
+
+	template<typename Function>
+	void forEachSelectedPlane(Function &&function);
+
+	// Scroll each selected plane that isn't blank in place with scroll(Row *rows), then mark what it changed.
+	template<typename Function>
+	void scrollSelectedPlanes(Function &&scroll);
+
+	bool draw(uint_fast8_t x, uint_fast8_t y, std::span<const std::byte> sprite, uint_fast8_t bytes_per_line, bool wrap);
+
+	// Combined contribution to the hash of consecutive rows of one word column.
+	uint64_t hashRows(uint_fast8_t plane, uint_fast8_t word, uint_fast8_t first, std::size_t count) const;
+
+	// Mark everything that differs from a previous copy of a plane as dirty and update the hash to match. Either plane can be null when blank.
+	void markChanged(uint_fast8_t plane, const Row *before, const Row *after);
+};
@@ -0,0 +1,757 @@
+#include "Chip8FastVm.h"
+
+#include "Chip8Font.h"
+#include "Chip8Jit.h"
+
+#include <algorithm>
+#include <thread>
+
+Chip8FastVm::Image::Image(std::span<const std::byte> rom) {
+	std::transform(CHIP8_FONT.begin(), CHIP8_FONT.end(), this->ram.begin() + FONT_OFFSET, [](std::byte b) { return std::to_integer<uint8_t>(b); });
+
+	auto rom_size = std::min<std::size_t>(rom.size(), MEMORY_SIZE - ROM_OFFSET);
+	std::transform(rom.begin(), rom.begin() + rom_size, this->ram.begin() + ROM_OFFSET, [](std::byte b) { return std::to_integer<uint8_t>(b); });
+
+	// The last byte can't hold a full instruction, fetching it halts before the handler is looked at
+	for (uint16_t address = 0; address + 1 < MEMORY_SIZE; ++address) {
+		this->handlers[address] = classify(static_cast<uint16_t>(this->ram[address] << 8 | this->ram[address + 1]));
+	}
+}
+
+Chip8FastVm::Chip8FastVm(const std::span<const std::byte> &rom, Chip8Platform platform) :
+	Chip8FastVm(Image(rom), platform)
+{
+}
+
+Chip8FastVm::Chip8FastVm(const Image &image, Chip8Platform platform) :
+	platform(platform)
+{
+	switch (this->platform)
+	{
+	case Chip8Platform::CosmacVip:
+		this->interpreter = &Chip8FastVm::interpret<Chip8Platform::CosmacVip>;
+		break;
+
+	case Chip8Platform::Chip48:
+		this->interpreter = &Chip8FastVm::interpret<Chip8Platform::Chip48>;
+		break;
+
+	case Chip8Platform::SuperChip:
+		this->interpreter = &Chip8FastVm::interpret<Chip8Platform::SuperChip>;
+		break;
+
+	default:
+		this->interpreter = &Chip8FastVm::interpret<Chip8Platform::Octo>;
+		break;
+	}
+
+	this->load(image);
+}
+
+void Chip8FastVm::load(const std::span<const std::byte> &rom) {
+	this->load(Image(rom));
+}
+
+void Chip8FastVm::load(const Image &image) {
+	this->ram = image.ram;
+	this->handlers = image.handlers;
+	this->memory_pages.markDirty(0, MEMORY_SIZE);
+	if (this->jit) {
+		this->jit->reset();
+	}
+
+	this->cpu = {};
+	this->timers.reset();
+	this->keys = 0;
+	this->display.assign(Display{});
+	this->random = Chip8Random();
+	this->idle = false;
+	this->keypress_target_register = NO_KEY;
+	this->state = State::Running;
+}
+
+Chip8FastVm::~Chip8FastVm() {
+	this->state = State::Halted;
+}
+
+Chip8FastVm::Handler Chip8FastVm::classify(uint16_t opcode) {
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		switch (opcode)
+		{
+		case 0x00E0:
+			return Handler::ClearScreen;
+		case 0x00EE:
+			return Handler::Return;
+		default:
+			// 0NNN is not implemented, 0000 only halts with Chip8Quirks::halt_on_zero
+			return Handler::Unsupported;
+		}
+	case 0x1:
+		return Handler::Jump;
+	case 0x2:
+		return Handler::Call;
+	case 0x3:
+		return Handler::SkipIfEqualValue;
+	case 0x4:
+		return Handler::SkipIfNotEqualValue;
+	case 0x5:
+		return Handler::SkipIfEqualRegister;
+	case 0x6:
+		return Handler::SetValue;
+	case 0x7:
+		return Handler::AddValue;
+	case 0x8:
+		switch (opcode & 0xF)
+		{
+		case 0x0:
+			return Handler::SetRegister;
+		case 0x1:
+			return Handler::Or;
+		case 0x2:
+			return Handler::And;
+		case 0x3:
+			return Handler::Xor;
+		case 0x4:
+			return Handler::Add;
+		case 0x5:
+			return Handler::Subtract;
+		case 0x6:
+			return Handler::ShiftRight;
+		case 0x7:
+			return Handler::SubtractReversed;
+		case 0xE:
+			return Handler::ShiftLeft;
+		default:
+			return Handler::Unsupported;
+		}
+	case 0x9:
+		return Handler::SkipIfNotEqualRegister;
+	case 0xA:
+		return Handler::SetAddress;
+	case 0xB:
+		return Handler::JumpOffset;
+	case 0xC:
+		return Handler::Random;
+	case 0xD:
+		return Handler::Draw;
+	case 0xE:
+		switch (opcode & 0xFF)
+		{
+		case 0x9E:
+			return Handler::SkipIfKeyPressed;
+		case 0xA1:
+			return Handler::SkipIfKeyNotPressed;
+		default:
+			return Handler::Unsupported;
+		}
+	default:
+		switch (opcode & 0xFF)
+		{
+		case 0x07:
+			return Handler::GetDelayTimer;
+		case 0x0A:
+			return Handler::WaitForKey;
+		case 0x15:
+			return Handler::SetDelayTimer;
+		case 0x18:
+			return Handler::SetSoundTimer;
+		case 0x1E:
+			return Handler::AddAddress;
+		case 0x29:
+			return Handler::SetAddressToFont;
+		case 0x33:
+			return Handler::StoreBcd;
+		case 0x55:
+			return Handler::StoreRegisters;
+		case 0x65:
+			return Handler::LoadRegisters;
+		default:
+			return Handler::Unsupported;
+		}
+	}
+}
+
+#if CHIP8_COMPUTED_GOTO
+#define DISPATCH(handler) goto *dispatch_table[static_cast<std::size_t>(handler)];
+#define HANDLER(name) name:
+#define NEXT goto *dispatch_table[static_cast<std::size_t>(fetch())]
+#else
+#define DISPATCH(handler) switch (handler)
+#define HANDLER(name) case Handler::name:
+#define NEXT continue
+#endif
+
+unsigned long Chip8FastVm::execute(unsigned long budget) {
+	return (this->*interpreter)(budget);
+}
+
+template<Chip8Platform quirks_platform>
+unsigned long Chip8FastVm::interpret(unsigned long budget) {
+	constexpr auto quirks = Chip8Quirks::forPlatform(quirks_platform);
+
+	unsigned long executed = 0;
+	uint16_t opcode = 0;
+
+	// Not enough memory left to hold a full instruction. As in Chip8ReferenceVm::getInstruction() a byte left at the very end is still read, otherwise pc
+	// stays wherever it points past the end (e.g. after BNNN).
+	auto halt_at_end = [&]() {
+		if (this->cpu.pc < MEMORY_SIZE) {
+			this->cpu.pc = MEMORY_SIZE;
+		}
+		this->state = State::Halted;
+	};
+
+	auto fetch = [&]() -> Handler {
+		if (executed >= budget || this->state != State::Running) {
+			return Handler::Exit;
+		}
+
+		++executed;
+		if (this->cpu.pc + 1 >= MEMORY_SIZE) {
+			halt_at_end();
+			return Handler::Exit;
+		}
+
+		opcode = static_cast<uint16_t>(this->ram[this->cpu.pc] << 8 | this->ram[this->cpu.pc + 1]);
+		auto &handler = this->handlers[this->cpu.pc];
+		if (handler == Handler::Undecoded) {
+			handler = classify(opcode);
+		}
+		this->cpu.pc += 2;
+		return handler;
+	};
+
+	// Matches Chip8ReferenceVm::skip(), which halts as soon as it runs out of memory to read
+	auto skip = [&]() {
+		if (this->cpu.pc + 1 >= MEMORY_SIZE) {
+			halt_at_end();
+		}
+		else {
+			this->cpu.pc += 2;
+		}
+	};
+
+#if CHIP8_COMPUTED_GOTO
+	static constexpr void *dispatch_table[] = {
+		&&Undecoded,
+		&&Unsupported,
+		&&ClearScreen,
+		&&Return,
+		&&Jump,
+		&&Call,
+		&&SkipIfEqualValue,
+		&&SkipIfNotEqualValue,
+		&&SkipIfEqualRegister,
+		&&SetValue,
+		&&AddValue,
+		&&SetRegister,
+		&&Or,
+		&&And,
+		&&Xor,
+		&&Add,
+		&&Subtract,
+		&&ShiftRight,
+		&&SubtractReversed,
+		&&ShiftLeft,
+		&&SkipIfNotEqualRegister,
+		&&SetAddress,
+		&&JumpOffset,
+		&&Random,
+		&&Draw,
+		&&SkipIfKeyPressed,
+		&&SkipIfKeyNotPressed,
+		&&GetDelayTimer,
+		&&WaitForKey,
+		&&SetDelayTimer,
+		&&SetSoundTimer,
+		&&AddAddress,
+		&&SetAddressToFont,
+		&&StoreBcd,
+		&&StoreRegisters,
+		&&LoadRegisters,
+		&&Exit
+	};
+	static_assert(std::size(dispatch_table) == HANDLER_COUNT, "dispatch_table must have an entry for every handler");
+#endif
+
+	for (;;) {
+		DISPATCH(fetch()) {
+		HANDLER(Undecoded)
+		HANDLER(Unsupported)
+			if constexpr (quirks.halt_on_zero) {
+				if (opcode == 0x0000) {
+					this->state = State::Halted;
+				}
+			}
+			NEXT;
+
+		HANDLER(ClearScreen)
+			this->display.clear();
+			NEXT;
+
+		HANDLER(Return)
+			if (this->cpu.stack_depth > 0) {
+				this->cpu.pc = this->cpu.call_stack[--this->cpu.stack_depth];
+			}
+			NEXT;
+
+		HANDLER(Jump)
+			this->cpu.pc = opcode & 0xFFF;
+			NEXT;
+
+		HANDLER(Call)
+			if (this->cpu.stack_depth == STACK_SIZE) {
+				this->state = State::Halted;
+				NEXT;
+			}
+			this->cpu.call_stack[this->cpu.stack_depth++] = this->cpu.pc;
+			this->cpu.pc = opcode & 0xFFF;
+			NEXT;
+
+		HANDLER(SkipIfEqualValue)
+			if (this->cpu.v[(opcode >> 8) & 0xF] == (opcode & 0xFF)) {
+				skip();
+			}
+			NEXT;
+
+		HANDLER(SkipIfNotEqualValue)
+			if (this->cpu.v[(opcode >> 8) & 0xF] != (opcode & 0xFF)) {
+				skip();
+			}
+			NEXT;
+
+		HANDLER(SkipIfEqualRegister)
+			if (this->cpu.v[(opcode >> 8) & 0xF] == this->cpu.v[(opcode >> 4) & 0xF]) {
+				skip();
+			}
+			NEXT;
+
+		HANDLER(SetValue)
+			this->cpu.v[(opcode >> 8) & 0xF] = static_cast<uint8_t>(opcode);
+			NEXT;
+
+		HANDLER(AddValue)
+			this->cpu.v[(opcode >> 8) & 0xF] += static_cast<uint8_t>(opcode);
+			NEXT;
+
+		HANDLER(SetRegister)
+			this->cpu.v[(opcode >> 8) & 0xF] = this->cpu.v[(opcode >> 4) & 0xF];
+			NEXT;
+
+		HANDLER(Or)
+			this->cpu.v[(opcode >> 8) & 0xF] |= this->cpu.v[(opcode >> 4) & 0xF];
+			NEXT;
+
+		HANDLER(And)
+			this->cpu.v[(opcode >> 8) & 0xF] &= this->cpu.v[(opcode >> 4) & 0xF];
+			NEXT;
+
+		HANDLER(Xor)
+			this->cpu.v[(opcode >> 8) & 0xF] ^= this->cpu.v[(opcode >> 4) & 0xF];
+			NEXT;
+
+		HANDLER(Add) {
+			unsigned wide_val = this->cpu.v[(opcode >> 8) & 0xF] + this->cpu.v[(opcode >> 4) & 0xF];
+			this->cpu.v[(opcode >> 8) & 0xF] = static_cast<uint8_t>(wide_val);
+			this->cpu.v[0xF] = static_cast<uint8_t>(wide_val >> 8);
+			NEXT;
+		}
+
+		HANDLER(Subtract) {
+			unsigned wide_val = (0x100 | this->cpu.v[(opcode >> 8) & 0xF]) - this->cpu.v[(opcode >> 4) & 0xF];
+			this->cpu.v[(opcode >> 8) & 0xF] = static_cast<uint8_t>(wide_val);
+			this->cpu.v[0xF] = static_cast<uint8_t>(wide_val >> 8);
+			NEXT;
+		}
+
+		HANDLER(ShiftRight) {
+			// Shifts VY into VX, or VX in place (see Chip8Quirks)
+			uint8_t val = this->cpu.v[(opcode >> (quirks.shift_uses_vy ? 4 : 8)) & 0xF];
+			this->cpu.v[(opcode >> 8) & 0xF] = val >> 1;
+			this->cpu.v[0xF] = val & 0x1;
+			NEXT;
+		}
+
+		HANDLER(SubtractReversed) {
+			unsigned wide_val = (0x100 | this->cpu.v[(opcode >> 4) & 0xF]) - this->cpu.v[(opcode >> 8) & 0xF];
+			this->cpu.v[(opcode >> 8) & 0xF] = static_cast<uint8_t>(wide_val);
+			this->cpu.v[0xF] = static_cast<uint8_t>(wide_val >> 8);
+			NEXT;
+		}
+
+		HANDLER(ShiftLeft) {
+			uint8_t val = this->cpu.v[(opcode >> (quirks.shift_uses_vy ? 4 : 8)) & 0xF];
+			this->cpu.v[(opcode >> 8) & 0xF] = static_cast<uint8_t>(val << 1);
+			this->cpu.v[0xF] = val >> 7;
+			NEXT;
+		}
+
+		HANDLER(SkipIfNotEqualRegister)
+			if (this->cpu.v[(opcode >> 8) & 0xF] != this->cpu.v[(opcode >> 4) & 0xF]) {
+				skip();
+			}
+			NEXT;
+
+		HANDLER(SetAddress)
+			this->cpu.i = opcode & 0xFFF;
+			NEXT;
+
+		HANDLER(JumpOffset)
+			this->cpu.pc = (opcode & 0xFFF) + this->cpu.v[quirks.jump_uses_vx ? (opcode >> 8) & 0xF : 0x0];
+			NEXT;
+
+		HANDLER(Random)
+			this->cpu.v[(opcode >> 8) & 0xF] = this->getRandomByte() & static_cast<uint8_t>(opcode);
+			NEXT;
+
+		HANDLER(Draw)
+			this->drawSprite(this->cpu.v[(opcode >> 8) & 0xF], this->cpu.v[(opcode >> 4) & 0xF], opcode & 0xF, quirks.wrap_sprites);
+			NEXT;
+
+		HANDLER(SkipIfKeyPressed) {
+			auto key = this->cpu.v[(opcode >> 8) & 0xF];
+			if (key < 16 && (this->keys >> key) & 1) {
+				skip();
+			}
+			NEXT;
+		}
+
+		HANDLER(SkipIfKeyNotPressed) {
+			auto key = this->cpu.v[(opcode >> 8) & 0xF];
+			if (key >= 16 || !((this->keys >> key) & 1)) {
+				skip();
+			}
+			NEXT;
+		}
+
+		HANDLER(GetDelayTimer)
+			this->cpu.v[(opcode >> 8) & 0xF] = static_cast<uint8_t>(this->timers.delay);
+			if (this->isIdleLoop(this->cpu.pc - 2)) {
+				// Stop right after the FX07 as Chip8ReferenceVm::step() does, runInstructions() decides whether to skip the rest of the loop
+				this->idle = true;
+				return executed;
+			}
+			NEXT;
+
+		HANDLER(WaitForKey)
+			this->keypress_target_register = (opcode >> 8) & 0xF;
+			this->state = State::Blocked;
+			NEXT;
+
+		HANDLER(SetDelayTimer)
+			this->timers.delay = this->cpu.v[(opcode >> 8) & 0xF];
+			NEXT;
+
+		HANDLER(SetSoundTimer)
+			this->timers.sound = this->cpu.v[(opcode >> 8) & 0xF];
+			NEXT;
+
+		HANDLER(AddAddress)
+			this->cpu.i += this->cpu.v[(opcode >> 8) & 0xF];
+			NEXT;
+
+		HANDLER(SetAddressToFont)
+			this->cpu.i = FONT_OFFSET + 5 * (this->cpu.v[(opcode >> 8) & 0xF] & 0xF);
+			NEXT;
+
+		HANDLER(StoreBcd) {
+			auto val = this->cpu.v[(opcode >> 8) & 0xF];
+			this->invalidateHandlers(this->cpu.i, 3);
+			this->ram[this->cpu.i & ADDRESS_MASK] = val / 100 % 10;
+			this->ram[(this->cpu.i + 1) & ADDRESS_MASK] = val / 10 % 10;
+			this->ram[(this->cpu.i + 2) & ADDRESS_MASK] = val % 10;
+			NEXT;
+		}
+
+		HANDLER(StoreRegisters) {
+			uint_fast8_t count = ((opcode >> 8) & 0xF) + 1;
+			this->invalidateHandlers(this->cpu.i, count);
+			for (uint_fast8_t r = 0; r < count; ++r) {
+				this->ram[(this->cpu.i + r) & ADDRESS_MASK] = this->cpu.v[r];
+			}
+			if constexpr (quirks.load_store_increment != Chip8Quirks::IndexIncrement::None) {
+				this->cpu.i += quirks.load_store_increment == Chip8Quirks::IndexIncrement::X ? count - 1 : count;
+			}
+			NEXT;
+		}
+
+		HANDLER(LoadRegisters) {
+			uint_fast8_t count = ((opcode >> 8) & 0xF) + 1;
+			for (uint_fast8_t r = 0; r < count; ++r) {
+				this->cpu.v[r] = this->ram[(this->cpu.i + r) & ADDRESS_MASK];
+			}
+			if constexpr (quirks.load_store_increment != Chip8Quirks::IndexIncrement::None) {
+				this->cpu.i += quirks.load_store_increment == Chip8Quirks::IndexIncrement::X ? count - 1 : count;
+			}
+			NEXT;
+		}
+
+		HANDLER(Exit)
+			return executed;
+		}
+	}
+}
+
+#undef DISPATCH
+#undef HANDLER
+#undef NEXT
+
+void Chip8FastVm::step() {
+	this->timers.advance(this->execute(1));
+}
+
+unsigned long Chip8FastVm::run(unsigned long budget) {
+	this->timers.synchronise();
+	return this->runInstructions(budget);
+}
+
+unsigned long Chip8FastVm::runInstructions(unsigned long budget, bool stop_when_idle) {
+	unsigned long executed = 0;
+	while (executed < budget && this->isRunning()) {
+		auto chunk = budget - executed;
+		if (auto until_tick = this->timers.instructionsUntilTick(); until_tick != 0) {
+			chunk = std::min(chunk, until_tick);
+		}
+
+		this->idle = false;
+		auto chunk_executed = this->jit ? this->executeCompiled(chunk) : this->execute(chunk);
+		if (this->idle && !stop_when_idle) {
+			// pc is just past the FX07, each pass runs the skip, the jump and the FX07 again. As in Chip8ReferenceVm::skipIdleLoop() the chunk ends
+			// before the next timer tick so every pass in it sees the same delay.
+			constexpr unsigned long LOOP_LENGTH = 3;
+			chunk_executed += (chunk - chunk_executed) / LOOP_LENGTH * LOOP_LENGTH;
+		}
+		this->timers.advance(chunk_executed);
+		executed += chunk_executed;
+
+		if (this->idle && stop_when_idle) {
+			break;
+		}
+	}
+	return executed;
+}
+
+unsigned long Chip8FastVm::executeCompiled(unsigned long budget) {
+	unsigned long executed = 0;
+	while (executed < budget && this->isRunning() && !this->idle) {
+		if (this->isIdleLoop(this->cpu.pc)) {
+			executed += this->execute(budget - executed);
+			continue;
+		}
+
+		const auto &block = this->jit->getBlock(this->ram, this->cpu.pc);
+		if (block.instructions > 0 && block.instructions <= budget - executed) {
+			executed += block.entry(&this->cpu);
+		}
+		else {
+			executed += this->execute(1);
+		}
+	}
+	return executed;
+}
+
+void Chip8FastVm::setJitEnabled(bool enabled) {
+	if (!enabled) {
+		this->jit.reset();
+	}
+	else if (!this->jit) {
+		this->jit = std::make_unique<Chip8Jit>(Chip8Quirks::forPlatform(this->platform));
+	}
+}
+
+bool Chip8FastVm::isJitEnabled() const {
+	return this->jit != nullptr;
+}
+
+unsigned long Chip8FastVm::doFrame() {
+	unsigned long instructions_executed = 0;
+
+	auto start_time = std::chrono::steady_clock::now();
+	this->timers.synchronise();
+
+	// Without a frame limit an idle loop ends the frame as in Chip8ReferenceVm::doFrame(), unless the timers tick partway through it
+	const bool stop_when_idle = this->frame_limit == 0 && this->timers.instructionsUntilTick() == 0;
+
+	while (this->isRunning()) {
+		auto budget = this->clock_check_interval;
+		if (this->frame_limit != 0) {
+			if (instructions_executed >= this->frame_limit) {
+				break;
+			}
+			budget = std::min(budget, this->frame_limit - instructions_executed);
+		}
+
+		instructions_executed += this->runInstructions(budget, stop_when_idle);
+
+		if (this->idle && stop_when_idle) {
+			// Nothing changes until the timers tick. In realtime mode that's at the start of the next frame, sleep through the rest of this one instead of
+			// spinning, in frame mode it's the end of this one.
+			this->idle = false;
+			if (this->timers.getMode() == Chip8Timers::Mode::Realtime) {
+				std::this_thread::sleep_until(start_time + Chip8Timers::tick_interval);
+			}
+			break;
+		}
+
+		if (std::chrono::steady_clock::now() - start_time >= Chip8Timers::tick_interval) {
+			break;
+		}
+	}
+
+	this->timers.endFrame();
+	return instructions_executed;
+}
+
+bool Chip8FastVm::isIdleLoop(uint16_t address) const {
+	if (this->timers.delay == 0 || address + 5 >= MEMORY_SIZE) {
+		return false;
+	}
+
+	auto x = this->ram[address] & 0xF;
+	return (this->ram[address] & 0xF0) == 0xF0 && this->ram[address + 1] == 0x07 &&
+		this->ram[address + 2] == (0x30 | x) && this->ram[address + 3] == 0x00 &&
+		this->ram[address + 4] == (0x10 | address >> 8) && this->ram[address + 5] == (address & 0xFF);
+}
+
+void Chip8FastVm::invalidateHandlers(uint16_t address, uint_fast8_t count) {
+	this->memory_pages.markDirty(address, count);
+
+	// An instruction starting on the byte before the write also reads the first written byte
+	for (int offset = -1; offset < count; ++offset) {
+		this->handlers[(address + offset) & ADDRESS_MASK] = Handler::Undecoded;
+	}
+
+	if (this->jit) {
+		this->jit->invalidate(address, count);
+	}
+}
+
+void Chip8FastVm::setKeyState(uint_fast8_t key, bool pressed) {
+	if (key >= 16) {
+		return;
+	}
+
+	if (pressed) {
+		if (this->keypress_target_register != NO_KEY) {
+			this->cpu.v[this->keypress_target_register] = key;
+			this->keypress_target_register = NO_KEY;
+			this->state = State::Running;
+		}
+		this->keys |= 1 << key;
+	}
+	else {
+		this->keys &= ~(1 << key);
+	}
+}
+
+void Chip8FastVm::clearKeyState() {
+	this->keys = 0;
+}
+
+Chip8Platform Chip8FastVm::getPlatform() const {
+	return this->platform;
+}
+
+void Chip8FastVm::seed(uint32_t seed) {
+	this->random.seed(seed);
+}
+
+void Chip8FastVm::setEmulationSpeed(unsigned long target_speed) {
+	this->frame_limit = target_speed;
+}
+
+const Chip8FastVm::Display &Chip8FastVm::getDisplayBuffer() const {
+	return this->display;
+}
+
+std::vector<Chip8FastVm::Display::DirtyRegion> Chip8FastVm::getDirtyRegions() const {
+	return this->display.getDirtyRegions();
+}
+
+void Chip8FastVm::clearDirty() {
+	this->display.clearDirty();
+}
+
+const Chip8FastVm::Timer Chip8FastVm::getSoundTimer() const {
+	return this->timers.sound;
+}
+
+void Chip8FastVm::setTimerMode(TimerMode mode, unsigned long instructions_per_tick) {
+	this->timers.setMode(mode, instructions_per_tick);
+}
+
+std::array<uint8_t, 16> Chip8FastVm::getRegisters() const {
+	return this->cpu.v;
+}
+
+uint_fast16_t Chip8FastVm::getProgramCounter() const {
+	return this->cpu.pc;
+}
+
+uint_fast16_t Chip8FastVm::getAddressRegister() const {
+	return this->cpu.i;
+}
+
+std::array<uint16_t, 16> Chip8FastVm::getCallStack() const {
+	std::array<uint16_t, 16> call_stack{};
+	std::copy_n(this->cpu.call_stack.cbegin(), this->cpu.stack_depth, call_stack.begin());
+	return call_stack;
+}
+
+uint_fast8_t Chip8FastVm::getStackDepth() const {
+	return this->cpu.stack_depth;
+}
+
+Chip8FastVm::Snapshot Chip8FastVm::snapshot() {
+	return {
+		this->memory_pages.capture(std::as_bytes(std::span{ this->ram })),
+		this->cpu,
+		this->timers,
+		this->display,
+		this->keys,
+		this->random,
+		this->state,
+		this->keypress_target_register
+	};
+}
+
+void Chip8FastVm::restore(const Snapshot &snapshot) {
+	auto changed = this->memory_pages.restore(std::as_writable_bytes(std::span{ this->ram }), snapshot.ram);
+	for (uint16_t page = 0; page < this->memory_pages.getPageCount(); ++page) {
+		if (changed.test(page)) {
+			// An instruction starting on the byte before the page also reads its first byte
+			uint16_t address = page * Chip8MemoryPages::PAGE_SIZE;
+			for (int offset = -1; offset < static_cast<int>(Chip8MemoryPages::PAGE_SIZE); ++offset) {
+				this->handlers[(address + offset) & ADDRESS_MASK] = Handler::Undecoded;
+			}
+
+			if (this->jit) {
+				this->jit->discard(address, Chip8MemoryPages::PAGE_SIZE);
+			}
+		}
+	}
+
+	this->cpu = snapshot.cpu;
+	this->timers = snapshot.timers;
+	this->display.assign(snapshot.display);
+	this->keys = snapshot.keys;
+	this->random = snapshot.random;
+	this->state = snapshot.state;
+	this->keypress_target_register = snapshot.keypress_target_register;
+}
+
+void Chip8FastVm::drawSprite(uint8_t x, uint8_t y, uint8_t lines, bool wrap) {
+	// Sprite data is read through i like every other memory access, wrapping at the end of RAM.
+	std::array<std::byte, 16> sprite;
+	for (uint_fast8_t line = 0; line < lines; ++line) {
+		sprite[line] = std::byte{ this->ram[(this->cpu.i + line) & ADDRESS_MASK] };
+	}
+
+	this->cpu.v[0xF] = this->display.drawSprite(x, y, std::span{ sprite.data(), lines }, wrap) ? 1 : 0;
+}
+
+uint8_t Chip8FastVm::getRandomByte() {
+	return this->random.nextByte();
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include "Chip8Display.h"
+#include "Chip8MemoryPages.h"
+#include "Chip8Quirks.h"
+#include "Chip8Random.h"
+#include "Chip8Timers.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Dispatch through a table of label addresses where the compiler supports it, otherwise fall back to a plain switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_COMPUTED_GOTO 1
+#else
+#define CHIP8_COMPUTED_GOTO 0
+#endif
+
+class Chip8Jit;
+
+/**
+* Throughput oriented interpreter with the same public interface and behaviour as Chip8ReferenceVm.
+*
+* Registers are plain integers, pc and i are offsets into RAM and each instruction is dispatched through a handler table (or a computed goto when available)
+* indexed by a per-address handler cache, so the hot loop never re-decodes an instruction or bounds checks a register access. The loop is instantiated once
+* per platform (see Chip8Quirks) so quirks cost nothing at run time.
+*/
+class Chip8FastVm {
+public:
+	Chip8FastVm(const std::span<const std::byte> &rom, Chip8Platform platform = Chip8Platform::Octo);
+	~Chip8FastVm();
+
+	// Initial RAM (font and ROM) and handler cache for a ROM. Build one per ROM and share it, constructing a VM from an image is a plain copy of both with
+	// every instruction of the ROM already classified.
+	struct Image;
+	Chip8FastVm(const Image &image, Chip8Platform platform = Chip8Platform::Octo);
+
+	// Start over with a different ROM as if newly constructed with the same platform, keeping the settings (emulation speed, timer mode and JIT) and
+	// reusing the memory (and JIT code buffer) already allocated.
+	void load(const std::span<const std::byte> &rom);
+	void load(const Image &image);
+
+	Chip8Platform getPlatform() const;
+
+	// Set an upper limit on how many instructions per tick should be emulated (0 [default] disables the limit)
+	void setEmulationSpeed(unsigned long);
+
+	constexpr bool isRunning() const {
+		return this->state == State::Running;
+	}
+
+	constexpr bool isLive() const {
+		return this->state != State::Halted;
+	}
+
+	void step();
+
+	unsigned long doFrame();
+
+	// Translate hot basic blocks to native code where supported. Both modes produce identical results, the interpreter is always used by step().
+	void setJitEnabled(bool);
+	bool isJitEnabled() const;
+
+	/**
+	* Run up to budget instructions with no frame pacing, entering compiled code whenever a whole block fits in the remaining budget.
+	*
+	* @return The number of instructions executed, less than budget if the program blocked or halted.
+	*/
+	unsigned long run(unsigned long budget);
+
+	void setKeyState(uint_fast8_t keyCode, bool isPressed);
+	void clearKeyState();
+
+	// The random number generator starts from seed 0, reseed it for a different run (see Chip8Random and Chip8InputLog).
+	void seed(uint32_t);
+
+	static constexpr uint_fast8_t DISPLAY_WIDTH = Chip8Display::WIDTH;
+	static constexpr uint_fast8_t DISPLAY_HEIGHT = Chip8Display::HEIGHT;
+	using Display = Chip8Display;
+	const Display &getDisplayBuffer() const;
+
+	// Parts of the display changed by 00E0/DXYN since the last call to clearDirty(), see Chip8Display::getDirtyRegions().
+	std::vector<Display::DirtyRegion> getDirtyRegions() const;
+	void clearDirty();
+
+	using Timer = Chip8Timers::Timer;
+	const Timer getSoundTimer() const;
+
+	// Timers follow the system clock by default, the other modes make a run independent of wall clock time (see Chip8Timers)
+	using TimerMode = Chip8Timers::Mode;
+	void setTimerMode(TimerMode mode, unsigned long instructions_per_tick = 0);
+
+	std::array<uint8_t, 16> getRegisters() const;
+	uint_fast16_t getProgramCounter() const;
+	uint_fast16_t getAddressRegister() const;
+
+	// Return addresses of the active calls, innermost last. Entries past the stack depth are 0.
+	std::array<uint16_t, 16> getCallStack() const;
+	uint_fast8_t getStackDepth() const;
+
+	// Complete VM state. RAM is stored as pages shared copy-on-write between snapshots (see Chip8MemoryPages).
+	struct Snapshot;
+
+	// Capture the current state, only RAM pages written since the last snapshot or restore are copied. The display's planes are shared with the VM until
+	// it draws on them (see Chip8Display).
+	Snapshot snapshot();
+
+	// Return to a captured state, only RAM pages that differ from the current contents are copied and display planes are shared again.
+	void restore(const Snapshot &);
+
+protected:
+	friend class Chip8Jit;
+
+	static constexpr uint16_t MEMORY_SIZE = 4096;
+	static constexpr uint16_t ADDRESS_MASK = MEMORY_SIZE - 1;
+	static constexpr uint16_t FONT_OFFSET = 0x50;
+	static constexpr uint16_t ROM_OFFSET = 0x200;
+
+	alignas(64) std::array<uint8_t, MEMORY_SIZE> ram{};
+
+	static constexpr std::size_t STACK_SIZE = 16;
+
+	// Register file, kept as a standard layout struct so compiled code can address it directly. Together with the call stack it fits in a single cache
+	// line and is trivially copyable, so cloning the hot state of a VM is a plain copy.
+	struct Registers {
+		std::array<uint8_t, 16> v{};
+
+		// Offset of the next instruction. Values past the end of RAM halt the VM on the next fetch, as in Chip8ReferenceVm with 4 KiB.
+		uint16_t pc = ROM_OFFSET;
+
+		// Address register, memory accessed through this is masked to stay within RAM.
+		uint16_t i = 0;
+
+		// Return addresses, innermost last. A call with a full stack halts the VM.
+		std::array<uint16_t, STACK_SIZE> call_stack{};
+		uint8_t stack_depth = 0;
+	};
+	static_assert(std::is_trivially_copyable_v<Registers> && sizeof(Registers) <= 64, "Registers must stay a single cache line of plain data");
+	alignas(64) Registers cpu;
+
+	// Index into the dispatch table, one entry per byte of RAM.
+	enum class Handler : uint8_t {
+		Undecoded, // Decoded on first execution, reset whenever the program writes over the instruction
+		Unsupported,
+		ClearScreen,
+		Return,
+		Jump,
+		Call,
+		SkipIfEqualValue,
+		SkipIfNotEqualValue,
+		SkipIfEqualRegister,
+		SetValue,
+		AddValue,
+		SetRegister,
+		Or,
+		And,
+		Xor,
+		Add,
+		Subtract,
+		ShiftRight,
+		SubtractReversed,
+		ShiftLeft,
+		SkipIfNotEqualRegister,
+		SetAddress,
+		JumpOffset,
+		Random,
+		Draw,
+		SkipIfKeyPressed,
+		SkipIfKeyNotPressed,
+		GetDelayTimer,
+		WaitForKey,
+		SetDelayTimer,
+		SetSoundTimer,
+		AddAddress,
+		SetAddressToFont,
+		StoreBcd,
+		StoreRegisters,
+		LoadRegisters,
+		Exit // Never cached, returned by the fetch when execution needs to stop
+	};
+	static constexpr std::size_t HANDLER_COUNT = static_cast<std::size_t>(Handler::Exit) + 1;
+
+	alignas(64) std::array<Handler, MEMORY_SIZE> handlers{};
+
+	static Handler classify(uint16_t opcode);
+
+	Chip8Platform platform;
+
+	/**
+	* Run until the budget is exhausted or the VM stops running.
+	*
+	* @param budget Maximum number of instructions to execute.
+	* @return The number of instructions executed.
+	*/
+	unsigned long execute(unsigned long budget);
+
+	// execute() for one platform, the instantiation for the VM's platform is picked on construction.
+	template<Chip8Platform quirks_platform>
+	unsigned long interpret(unsigned long budget);
+
+	using Interpreter = unsigned long (Chip8FastVm::*)(unsigned long);
+	Interpreter interpreter;
+
+	std::unique_ptr<Chip8Jit> jit;
+
+	// As execute() but entering compiled code whenever a whole block fits in the budget.
+	unsigned long executeCompiled(unsigned long budget);
+
+	/**
+	* Execute up to budget instructions while clocking the timers.
+	*
+	* Work is split at every timer tick so an instruction sees the same timer values whether it was compiled or interpreted.
+	*
+	* @param stop_when_idle Return straight after the FX07 of an idle loop instead of skipping through it.
+	*/
+	unsigned long runInstructions(unsigned long budget, bool stop_when_idle = false);
+
+	void invalidateHandlers(uint16_t address, uint_fast8_t count);
+
+	// Idle loops
+	//  An FX07 / 3X00 / 1NNN loop (jumping back to the FX07) can't exit until the delay timer changes, which never happens within a call to execute().
+	//  execute() stops after the FX07 of such a loop, runInstructions() then counts every remaining pass through it up to the next timer tick as executed
+	//  without running them.
+	bool isIdleLoop(uint16_t address) const;
+
+	// Set when execute() stopped at an idle loop, doFrame() without a frame limit then ends the frame instead of spinning
+	bool idle = false;
+
+	// Timers.
+	// Both timers count down at 60hz, clocked by the VM itself (see Chip8Timers).
+	Chip8Timers timers;
+
+	unsigned long frame_limit = 0;
+
+	// How many instructions to run between checks of the frame deadline in doFrame()
+	static constexpr unsigned long clock_check_interval = 64;
+
+	// Key map, each bit corresponds to a key on the hex input device where 1 is pressed and 0 is released.
+	uint16_t keys = 0;
+
+	Display display{};
+
+	void drawSprite(uint8_t x, uint8_t y, uint8_t lines, bool wrap);
+
+	Chip8Random random;
+
+	uint8_t getRandomByte();
+
+	enum class State : uint8_t {
+		Loading,
+		Running,
+		Blocked,
+		Halted
+	};
+	State state = State::Loading;
+
+	static constexpr uint8_t NO_KEY = 0xFF;
+	uint8_t keypress_target_register = NO_KEY;
+
+	// Tracks which parts of RAM were written since the last snapshot or restore
+	Chip8MemoryPages memory_pages;
+};
+
+struct Chip8FastVm::Image {
+	explicit Image(std::span<const std::byte> rom);
+
+	alignas(64) std::array<uint8_t, MEMORY_SIZE> ram{};
+	alignas(64) std::array<Handler, MEMORY_SIZE> handlers{};
+};
+
+struct Chip8FastVm::Snapshot {
+	Chip8MemoryPages::Pages ram;
+	Registers cpu;
+	Chip8Timers timers;
+	Display display;
+	uint16_t keys;
+	Chip8Random random;
+	State state;
+	uint8_t keypress_target_register;
+};
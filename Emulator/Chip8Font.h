@@ -0,0 +1,320 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+template<typename... Ts>
+constexpr std::array<std::byte, sizeof...(Ts)> make_bytes(Ts&&... args) noexcept {
+	return{ std::byte(std::forward<Ts>(args))... };
+}
+
+// Hex digit sprites (0-F), 5 bytes per character. Every VM copies these into RAM at 0x50 on construction.
+inline constexpr auto CHIP8_FONT = make_bytes(
+	// 0
+	0b11110000,
+	0b10010000,
+	0b10010000,
+	0b10010000,
+	0b11110000,
+
+	// 1
+	0b00100000,
+	0b01100000,
+	0b00100000,
+	0b00100000,
+	0b01010000,
+
+	// 2
+	0b11110000,
+	0b00010000,
+	0b11110000,
+	0b10000000,
+	0b11110000,
+
+	// 3
+	0b11110000,
+	0b00010000,
+	0b11110000,
+	0b00010000,
+	0b11110000,
+
+	// 4
+	0b10010000,
+	0b10010000,
+	0b11110000,
+	0b00010000,
+	0b00010000,
+
+	// 5
+	0b11110000,
+	0b10000000,
+	0b11110000,
+	0b00010000,
+	0b11110000,
+
+	// 6
+	0b11110000,
+	0b10000000,
+	0b11110000,
+	0b10010000,
+	0b11110000,
+
+	// 7
+	0b11110000,
+	0b00010000,
+	0b00100000,
+	0b01000000,
+	0b01000000,
+
+	// 8
+	0b11110000,
+	0b10010000,
+	0b11110000,
+	0b10010000,
+	0b11110000,
+
+	// 9
+	0b11110000,
+	0b10010000,
+	0b11110000,
+	0b00010000,
+	0b11110000,
+
+	// A
+	0b11110000,
+	0b10010000,
+	0b11110000,
+	0b10010000,
+	0b10010000,
+
+	// B
+	0b11100000,
+	0b10010000,
+	0b11100000,
+	0b10010000,
+	0b11100000,
+
+	// C
+	0b11110000,
+	0b10000000,
+	0b10000000,
+	0b10000000,
+	0b11110000,
+
+	// D
+	0b11100000,
+	0b10010000,
+	0b10010000,
+	0b10010000,
+	0b11100000,
+
+	// E
+	0b11110000,
+	0b10000000,
+	0b11110000,
+	0b10000000,
+	0b11110000,
+
+	// F
+	0b11110000,
+	0b10000000,
+	0b11110000,
+	0b10000000,
+	0b10000000
+);
+
+// Large hex digit sprites (0-F) for SUPER-CHIP and XO-CHIP, 10 bytes per character. Copied into RAM straight after CHIP8_FONT.
+inline constexpr auto CHIP8_BIG_FONT = make_bytes(
+	// 0
+	0b11111111,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+
+	// 1
+	0b00011000,
+	0b01111000,
+	0b01111000,
+	0b00011000,
+	0b00011000,
+	0b00011000,
+	0b00011000,
+	0b00011000,
+	0b11111111,
+	0b11111111,
+
+	// 2
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11111111,
+	0b11111111,
+
+	// 3
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b11111111,
+	0b11111111,
+
+	// 4
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b00000011,
+	0b00000011,
+
+	// 5
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b11111111,
+	0b11111111,
+
+	// 6
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11111111,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+
+	// 7
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b00000110,
+	0b00001100,
+	0b00011000,
+	0b00011000,
+	0b00011000,
+	0b00011000,
+
+	// 8
+	0b11111111,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+
+	// 9
+	0b11111111,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+	0b00000011,
+	0b00000011,
+	0b11111111,
+	0b11111111,
+
+	// A
+	0b01111110,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11111111,
+	0b11111111,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+
+	// B
+	0b11111100,
+	0b11111100,
+	0b11000011,
+	0b11000011,
+	0b11111100,
+	0b11111100,
+	0b11000011,
+	0b11000011,
+	0b11111100,
+	0b11111100,
+
+	// C
+	0b00111100,
+	0b11111111,
+	0b11000011,
+	0b11000000,
+	0b11000000,
+	0b11000000,
+	0b11000000,
+	0b11000011,
+	0b11111111,
+	0b00111100,
+
+	// D
+	0b11111100,
+	0b11111110,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11000011,
+	0b11111110,
+	0b11111100,
+
+	// E
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11111111,
+	0b11111111,
+
+	// F
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11111111,
+	0b11111111,
+	0b11000000,
+	0b11000000,
+	0b11000000,
+	0b11000000
+);
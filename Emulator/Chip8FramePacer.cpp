@@ -0,0 +1,66 @@
+#include "Chip8FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+double Chip8FramePacer::Stats::jitterStdDev() const {
+	return this->frames > 1 ? std::sqrt(this->jitter_m2 / static_cast<double>(this->frames - 1)) : 0.0;
+}
+
+void Chip8FramePacer::Stats::record(double jitter) {
+	++this->frames;
+	auto delta = jitter - this->mean_jitter;
+	this->mean_jitter += delta / static_cast<double>(this->frames);
+	this->jitter_m2 += delta * (jitter - this->mean_jitter);
+	this->max_jitter = std::max(this->max_jitter, jitter);
+}
+
+Chip8FramePacer::Chip8FramePacer(unsigned frequency, unsigned max_catch_up) :
+	interval(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / std::max(frequency, 1u)),
+	max_catch_up(std::max(max_catch_up, 1u))
+{
+	this->reset();
+}
+
+void Chip8FramePacer::reset() {
+	this->deadline = Clock::now();
+}
+
+unsigned Chip8FramePacer::wait() {
+	auto now = Clock::now();
+	if (now < this->deadline) {
+		if (this->deadline - now > spin_margin) {
+			std::this_thread::sleep_until(this->deadline - spin_margin);
+		}
+
+		while ((now = Clock::now()) < this->deadline) {
+			std::this_thread::yield();
+		}
+	}
+
+	auto lateness = now - this->deadline;
+	this->stats.record(std::chrono::duration<double, std::micro>(lateness).count());
+	if (lateness > late_threshold) {
+		++this->stats.late;
+	}
+
+	// The frame whose deadline just passed plus every whole interval since
+	auto due = static_cast<unsigned long long>(lateness / this->interval) + 1;
+	if (due > this->max_catch_up) {
+		this->stats.dropped += due - this->max_catch_up;
+		this->deadline = now + this->interval;
+		return this->max_catch_up;
+	}
+
+	this->deadline += this->interval * due;
+	return static_cast<unsigned>(due);
+}
+
+Chip8FramePacer::Clock::duration Chip8FramePacer::getInterval() const {
+	return this->interval;
+}
+
+const Chip8FramePacer::Stats &Chip8FramePacer::getStats() const {
+	return this->stats;
+}
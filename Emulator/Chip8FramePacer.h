@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/**
+* Paces a frontend's main loop to a fixed frame rate.
+*
+* Deadlines are absolute: each one is the previous deadline plus the frame interval, not the time the loop woke up plus the interval, so time spent
+* emulating and rendering a frame doesn't push every following frame back. wait() reports how many frames came due while the loop was busy, frontends run
+* that many emulation frames and render once, so a slow terminal lowers the render rate without slowing the program down. After falling more than
+* max_catch_up frames behind (the process was suspended, a breakpoint was hit) the excess frames are dropped and the schedule restarts from the current time.
+*
+* How late every wakeup was compared to its deadline is recorded, see getStats().
+*/
+class Chip8FramePacer {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		unsigned long long frames = 0;  // Calls to wait()
+		unsigned long long late = 0;    // Wakeups more than late_threshold past their deadline
+		unsigned long long dropped = 0; // Frames skipped when the schedule restarted
+
+		// Lateness of each wakeup in microseconds, the mean and variance are kept with Welford's method.
+		double mean_jitter = 0.0;
+		double max_jitter = 0.0;
+
+		double jitterStdDev() const;
+
+	protected:
+		friend class Chip8FramePacer;
+
+		double jitter_m2 = 0.0;
+
+		void record(double jitter);
+	};
+
+	// Wakeups later than this are counted as late frames
+	static constexpr std::chrono::milliseconds late_threshold = std::chrono::milliseconds(1);
+
+	explicit Chip8FramePacer(unsigned frequency = 60, unsigned max_catch_up = 4);
+
+	// Start the schedule over from now, e.g. after a pause. The next call to wait() returns immediately.
+	void reset();
+
+	/**
+	* Block until the next frame is due.
+	*
+	* @return How many frames have come due since the last call, at least 1 and at most max_catch_up.
+	*/
+	unsigned wait();
+
+	Clock::duration getInterval() const;
+
+	const Stats &getStats() const;
+
+protected:
+	// Sleeps regularly overshoot by up to a scheduler quantum, wait() sleeps until this long before the deadline then yields until it arrives.
+	static constexpr std::chrono::milliseconds spin_margin = std::chrono::milliseconds(2);
+
+	Clock::duration interval;
+	unsigned max_catch_up;
+
+	Clock::time_point deadline;
+
+	Stats stats;
+};
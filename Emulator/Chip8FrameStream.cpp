@@ -0,0 +1,284 @@
+#include "Chip8FrameStream.h"
+
+#include "Chip8Varint.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+	constexpr char MAGIC[4] = { 'C', '8', 'F', 'S' };
+	constexpr uint8_t VERSION = 1;
+
+	// Low two bits of each record's tag
+	enum Record : uint8_t {
+		REPEAT = 0,
+		FRAME = 1,
+		RESOLUTION = 2
+	};
+
+	// Literal runs in a delta are at most this long so the length fits in the low 4 bits of the run's header, 0 ends the delta
+	constexpr std::size_t MAX_LITERAL = 15;
+}
+
+Chip8FrameWriter::Chip8FrameWriter(std::ostream &output) :
+	output(output)
+{
+	this->output.write(MAGIC, sizeof(MAGIC));
+	this->output.put(static_cast<char>(VERSION));
+}
+
+Chip8FrameWriter::~Chip8FrameWriter() {
+	this->flush();
+}
+
+void Chip8FrameWriter::write(const Chip8Display &display) {
+	++this->frames;
+
+	// Equal hashes are taken to be equal frames, it's what makes unchanged frames free
+	if (display.getHash() == this->hash) {
+		++this->repeats;
+		return;
+	}
+	this->hash = display.getHash();
+
+	if (this->repeats > 0) {
+		this->writeVarint(this->repeats << 2 | REPEAT);
+		this->repeats = 0;
+	}
+
+	if (display.isHires() != this->hires) {
+		this->hires = display.isHires();
+		this->writeVarint((this->hires ? 1u : 0u) << 2 | RESOLUTION);
+		for (auto &plane : this->previous) {
+			plane.fill(0);
+		}
+		this->plane_hashes.fill(0);
+	}
+
+	const uint_fast8_t words = this->hires ? Chip8Display::WORDS : 1;
+	const std::size_t count = static_cast<std::size_t>(display.getHeight()) * Chip8Display::WORDS;
+
+	// Whole rows are compared a word at a time, only words that changed are split into bytes. Planes are only compared at all when their hash changed,
+	// so plain CHIP-8 programs only ever look at the first.
+	std::array<std::array<Chip8Display::Row, ROWS>, Chip8Display::PLANES> delta;
+	uint8_t changed = 0;
+	for (uint_fast8_t plane = 0; plane < Chip8Display::PLANES; ++plane) {
+		if (display.getPlaneHash(plane) == this->plane_hashes[plane]) {
+			continue;
+		}
+		this->plane_hashes[plane] = display.getPlaneHash(plane);
+
+		Chip8Display::Row differs = 0;
+		for (uint_fast8_t y = 0; y < display.getHeight(); ++y) {
+			for (uint_fast8_t word = 0; word < words; ++word) {
+				auto row = display.getRow(y, word, plane);
+				auto &previous = this->previous[plane][y * Chip8Display::WORDS + word];
+				delta[plane][y * Chip8Display::WORDS + word] = row ^ previous;
+				differs |= row ^ previous;
+				previous = row;
+			}
+		}
+		if (differs != 0) {
+			changed |= 1 << plane;
+		}
+	}
+
+	this->writeVarint(static_cast<unsigned long long>(changed) << 2 | FRAME);
+	for (uint_fast8_t plane = 0; plane < Chip8Display::PLANES; ++plane) {
+		if (!(changed & 1 << plane)) {
+			continue;
+		}
+
+		std::array<char, MAX_LITERAL> literal;
+		std::size_t length = 0;
+		std::size_t skipped = 0;
+		auto end_literal = [&]() {
+			if (length > 0) {
+				this->writeVarint(skipped << 4 | length);
+				this->buffer.insert(this->buffer.end(), literal.begin(), literal.begin() + length);
+				skipped = 0;
+				length = 0;
+			}
+		};
+
+		// Lores rows only use their first word
+		for (std::size_t index = 0; index < count; index += Chip8Display::WORDS / words) {
+			auto pixels = delta[plane][index];
+			if (pixels == 0) {
+				end_literal();
+				skipped += 8;
+				continue;
+			}
+
+			for (int shift = 56; shift >= 0; shift -= 8) {
+				auto byte = static_cast<uint8_t>(pixels >> shift);
+				if (byte == 0) {
+					end_literal();
+					++skipped;
+					continue;
+				}
+
+				literal[length++] = static_cast<char>(byte);
+				if (length == MAX_LITERAL) {
+					end_literal();
+				}
+			}
+		}
+		end_literal();
+		this->writeVarint(0);
+	}
+
+	this->writeBuffer();
+}
+
+void Chip8FrameWriter::flush() {
+	if (this->repeats > 0) {
+		this->writeVarint(this->repeats << 2 | REPEAT);
+		this->repeats = 0;
+	}
+	this->writeBuffer();
+	this->output.flush();
+}
+
+unsigned long long Chip8FrameWriter::getFrameCount() const {
+	return this->frames;
+}
+
+void Chip8FrameWriter::writeVarint(unsigned long long value) {
+	Chip8Varint::write(std::back_inserter(this->buffer), value);
+}
+
+void Chip8FrameWriter::writeBuffer() {
+	this->output.write(this->buffer.data(), static_cast<std::streamsize>(this->buffer.size()));
+	this->buffer.clear();
+}
+
+Chip8FrameReader::Chip8FrameReader(std::istream &input) :
+	input(input)
+{
+	char magic[sizeof(MAGIC)];
+	this->valid = this->input.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), MAGIC) && this->input.get() == VERSION;
+}
+
+bool Chip8FrameReader::isValid() const {
+	return this->valid;
+}
+
+bool Chip8FrameReader::next() {
+	if (!this->valid) {
+		return false;
+	}
+
+	if (this->repeats > 0) {
+		--this->repeats;
+		this->changed = this->frames++ == 0;
+		return true;
+	}
+
+	// A change of resolution clears the display, so the frame after it has changed even if no plane has
+	bool cleared = this->frames == 0;
+	for (;;) {
+		unsigned long long tag;
+		if (!Chip8Varint::read(this->input, tag)) {
+			return false;
+		}
+
+		auto value = tag >> 2;
+		switch (tag & 3) {
+		case REPEAT:
+			if (value == 0) {
+				continue;
+			}
+			this->repeats = value - 1;
+			this->changed = cleared;
+			++this->frames;
+			return true;
+
+		case FRAME:
+			for (uint_fast8_t plane = 0; plane < Chip8Display::PLANES; ++plane) {
+				if ((value & 1 << plane) && !this->readDelta(this->planes[plane])) {
+					this->valid = false;
+					return false;
+				}
+			}
+			this->changed = cleared || (value & 0xF) != 0;
+			++this->frames;
+			return true;
+
+		case RESOLUTION:
+			this->hires = (value & 1) != 0;
+			for (auto &plane : this->planes) {
+				plane.fill(0);
+			}
+			cleared = true;
+			continue;
+
+		default:
+			this->valid = false;
+			return false;
+		}
+	}
+}
+
+unsigned long long Chip8FrameReader::getFrameCount() const {
+	return this->frames;
+}
+
+bool Chip8FrameReader::isChanged() const {
+	return this->changed;
+}
+
+bool Chip8FrameReader::isHires() const {
+	return this->hires;
+}
+
+uint_fast8_t Chip8FrameReader::getWidth() const {
+	return this->hires ? Chip8Display::HIRES_WIDTH : Chip8Display::WIDTH;
+}
+
+uint_fast8_t Chip8FrameReader::getHeight() const {
+	return this->hires ? Chip8Display::HIRES_HEIGHT : Chip8Display::HEIGHT;
+}
+
+uint8_t Chip8FrameReader::getPlanes(uint_fast8_t x, uint_fast8_t y) const {
+	x %= this->getWidth();
+	y %= this->getHeight();
+
+	uint8_t lit = 0;
+	for (uint_fast8_t plane = 0; plane < Chip8Display::PLANES; ++plane) {
+		lit |= ((this->planes[plane][y * ROW_BYTES + x / 8] >> (7 - x % 8)) & 1) << plane;
+	}
+	return lit;
+}
+
+bool Chip8FrameReader::readDelta(std::array<uint8_t, PLANE_BYTES> &plane) {
+	const std::size_t row_bytes = this->getWidth() / 8;
+	const std::size_t count = row_bytes * this->getHeight();
+
+	std::size_t index = 0;
+	for (;;) {
+		unsigned long long run;
+		if (!Chip8Varint::read(this->input, run)) {
+			return false;
+		}
+
+		auto length = static_cast<std::size_t>(run & 0xF);
+		if (length == 0) {
+			return true;
+		}
+
+		auto skipped = run >> 4;
+		if (skipped > count - index || count - index - skipped < length) {
+			return false;
+		}
+		index += static_cast<std::size_t>(skipped);
+
+		for (std::size_t byte = 0; byte < length; ++byte, ++index) {
+			auto pixels = this->input.get();
+			if (pixels == std::istream::traits_type::eof()) {
+				return false;
+			}
+			plane[index / row_bytes * ROW_BYTES + index % row_bytes] ^= static_cast<uint8_t>(pixels);
+		}
+	}
+}
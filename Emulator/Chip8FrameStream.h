@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "Chip8Display.h"
+
+/**
+* Compressed recordings of the display, one frame per call to Chip8FrameWriter::write() (BatchRunner writes one per timer tick).
+*
+* Each frame is stored as the XOR of its pixels with those of the previous frame, so only what was drawn or erased takes any space, and runs of frames
+* that are the same as the one before (most of them, in most programs) are stored as a count. Frames are spotted as unchanged through the display's hash
+* (see Chip8Display::getHash()) without looking at any pixels, so writing costs next to nothing until something is drawn.
+*
+* Streams are written front to back without seeking, to a file or a pipe. All numbers are unsigned LEB128 varints:
+*   "C8FS" <version (1 byte)>
+*   <record>... each starting with a tag, (value << 2) | kind:
+*     kind 0, repeat: value more frames the same as the last one
+*     kind 1, frame: the planes that changed in value (bit 0 for plane 0), followed by a delta per changed plane
+*     kind 2, resolution: clear the display and switch to hires if value is 1, lores if 0. Not a frame in itself.
+* A delta covers the bytes of one plane (8 pixels each, the leftmost pixel in the most significant bit) from the top left, row by row, as runs
+*   <(zero bytes skipped << 4) | literal length> <literal bytes XORed with the previous frame>...
+* ending with a run with no literal bytes.
+*/
+class Chip8FrameWriter {
+public:
+	// Writes the header straight away.
+	explicit Chip8FrameWriter(std::ostream &output);
+
+	// Writes any repeats still being counted.
+	~Chip8FrameWriter();
+
+	Chip8FrameWriter(const Chip8FrameWriter &) = delete;
+	Chip8FrameWriter &operator=(const Chip8FrameWriter &) = delete;
+
+	// Append a frame.
+	void write(const Chip8Display &display);
+
+	// Write any repeats still being counted, the stream is complete as it stands and further frames can still be added.
+	void flush();
+
+	unsigned long long getFrameCount() const;
+
+protected:
+	static constexpr std::size_t ROWS = Chip8Display::WORDS * Chip8Display::HIRES_HEIGHT;
+
+	std::ostream &output;
+
+	// The last frame written, each row as Chip8Display stores it. Only the first word of each row is used in lores.
+	std::array<std::array<Chip8Display::Row, ROWS>, Chip8Display::PLANES> previous{};
+	bool hires = false;
+	uint64_t hash = 0;
+	std::array<uint64_t, Chip8Display::PLANES> plane_hashes{};
+
+	unsigned long long frames = 0;
+	unsigned long long repeats = 0;
+
+	// Records are built here and written with a single call
+	std::vector<char> buffer;
+
+	void writeVarint(unsigned long long value);
+	void writeBuffer();
+};
+
+/**
+* Plays back a stream written by Chip8FrameWriter one frame at a time.
+*/
+class Chip8FrameReader {
+public:
+	// Reads the header, see isValid().
+	explicit Chip8FrameReader(std::istream &input);
+
+	// false if the input isn't a frame stream in a supported version
+	bool isValid() const;
+
+	// Move on to the next frame. @return false at the end of the stream, or if the rest of it is truncated or corrupt.
+	bool next();
+
+	// Number of frames read so far
+	unsigned long long getFrameCount() const;
+
+	// Whether the current frame differs from the one before it (always true for the first frame).
+	bool isChanged() const;
+
+	bool isHires() const;
+	uint_fast8_t getWidth() const;
+	uint_fast8_t getHeight() const;
+
+	// Bit mask of the planes a pixel is lit in, as Chip8Display::getPlanes().
+	uint8_t getPlanes(uint_fast8_t x, uint_fast8_t y) const;
+
+protected:
+	static constexpr std::size_t ROW_BYTES = Chip8Display::HIRES_WIDTH / 8;
+	static constexpr std::size_t PLANE_BYTES = ROW_BYTES * Chip8Display::HIRES_HEIGHT;
+
+	std::istream &input;
+	bool valid = false;
+
+	std::array<std::array<uint8_t, PLANE_BYTES>, Chip8Display::PLANES> planes{};
+	bool hires = false;
+
+	unsigned long long frames = 0;
+	unsigned long long repeats = 0;
+	bool changed = false;
+
+	bool readDelta(std::array<uint8_t, PLANE_BYTES> &plane);
+};
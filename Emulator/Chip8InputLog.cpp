@@ -0,0 +1,90 @@
+#include "Chip8InputLog.h"
+
+#include "Chip8Varint.h"
+
+#include <iterator>
+
+namespace {
+	constexpr char MAGIC[4] = { 'C', '8', 'I', 'L' };
+}
+
+void Chip8InputLog::setKeyState(unsigned long long instruction, uint_fast8_t key, bool pressed) {
+	if (key >= 16 || (!pressed && !(this->held & 1 << key))) {
+		return;
+	}
+
+	// Presses are always logged, pressing a key that's already held still wakes a VM waiting on FX0A
+	if (pressed) {
+		this->held |= 1 << key;
+	}
+	else {
+		this->held &= ~(1 << key);
+	}
+	this->events.push_back({ instruction, static_cast<uint8_t>(key), pressed });
+}
+
+void Chip8InputLog::clearKeyState(unsigned long long instruction) {
+	for (uint_fast8_t key = 0; key < 16; ++key) {
+		this->setKeyState(instruction, key, false);
+	}
+}
+
+void Chip8InputLog::write(std::ostream &output) const {
+	output.write(MAGIC, sizeof(MAGIC));
+	output.put(static_cast<char>(VERSION));
+	output.put(static_cast<char>(this->variant));
+	output.put(static_cast<char>(this->platform));
+
+	std::ostreambuf_iterator<char> varints(output);
+	Chip8Varint::write(varints, this->seed);
+	Chip8Varint::write(varints, this->instructions_per_tick);
+	Chip8Varint::write(varints, this->length);
+	Chip8Varint::write(varints, this->events.size());
+
+	unsigned long long previous = 0;
+	for (const auto &event : this->events) {
+		Chip8Varint::write(varints, (event.instruction - previous) << 5 | (event.pressed ? 0x10 : 0) | event.key);
+		previous = event.instruction;
+	}
+}
+
+bool Chip8InputLog::read(std::istream &input) {
+	*this = {};
+
+	char magic[sizeof(MAGIC)];
+	if (!input.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) || input.get() != VERSION) {
+		return false;
+	}
+
+	auto variant = input.get();
+	auto platform = input.get();
+	if (variant < 0 || variant > static_cast<int>(Variant::XoChip) || platform < 0 || platform > static_cast<int>(Chip8Platform::Octo)) {
+		return false;
+	}
+
+	unsigned long long seed, instructions_per_tick, length, count;
+	if (!Chip8Varint::read(input, seed) || !Chip8Varint::read(input, instructions_per_tick) || !Chip8Varint::read(input, length) || !Chip8Varint::read(input, count)) {
+		return false;
+	}
+
+	Chip8InputLog log;
+	log.variant = static_cast<Variant>(variant);
+	log.platform = static_cast<Chip8Platform>(platform);
+	log.seed = static_cast<uint32_t>(seed);
+	log.instructions_per_tick = static_cast<unsigned long>(instructions_per_tick);
+	log.length = length;
+
+	unsigned long long instruction = 0;
+	for (unsigned long long index = 0; index < count; ++index) {
+		unsigned long long value;
+		if (!Chip8Varint::read(input, value)) {
+			return false;
+		}
+
+		instruction += value >> 5;
+		log.events.push_back({ instruction, static_cast<uint8_t>(value & 0xF), (value & 0x10) != 0 });
+	}
+
+	*this = std::move(log);
+	return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Chip8Quirks.h"
+#include "Chip8ReferenceVm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/**
+* Everything outside the ROM that affects a run: the instruction set and platform, the RNG seed, how the timers were clocked and every key event keyed by the
+* number of instructions executed before it. Replaying a log against a VM of the same variant and platform, seeded the same way and with instruction clocked
+* timers reproduces the recorded run exactly.
+*
+* Logs are stored in a compact binary format, all numbers are unsigned LEB128 varints:
+*   "C8IL" <version (1 byte)> <variant (1 byte)> <platform (1 byte)> <seed> <instructions per tick> <length in instructions> <event count>
+*   <event>... each (instructions since the previous event << 5) | (pressed << 4) | key
+* Events at the same instruction count as the previous one take a single byte.
+*/
+class Chip8InputLog {
+public:
+	struct Event {
+		unsigned long long instruction;
+		uint8_t key;
+		bool pressed;
+	};
+
+	using Variant = Chip8ReferenceVm::Variant;
+	Variant variant = Variant::Chip8;
+	Chip8Platform platform = Chip8Platform::Octo;
+
+	uint32_t seed = 0;
+	unsigned long instructions_per_tick = 1;
+
+	// Total instructions executed by the recorded run, replays stop here.
+	unsigned long long length = 0;
+
+	// Ordered by instruction count.
+	std::vector<Event> events;
+
+	// Record calls made to the VM's setKeyState()/clearKeyState(). Releasing keys that are not held has no effect on the VM so isn't logged.
+	void setKeyState(unsigned long long instruction, uint_fast8_t key, bool pressed);
+	void clearKeyState(unsigned long long instruction);
+
+	void write(std::ostream &output) const;
+
+	// @return false if the input isn't a log in a supported version, the log is left empty.
+	bool read(std::istream &input);
+
+	// Whether the VM emulates the recorded variant and platform. VMs without a getVariant() only implement CHIP-8.
+	template<typename Vm>
+	bool matches(const Vm &vm) const;
+
+	/**
+	* Re-execute the log against a freshly constructed VM with no frame pacing.
+	*
+	* Once the VM is waiting for a key the next event is applied immediately, as the VM executes no instructions while blocked.
+	*
+	* @return The number of instructions executed, at most length. Nothing is executed if the VM doesn't match() the log.
+	*/
+	template<typename Vm>
+	unsigned long long replay(Vm &vm) const;
+
+protected:
+	// Version 2 changed the RNG seeded from the log to Chip8Random, version 1 logs would not replay the same run. Version 3 added the variant and platform,
+	// older logs don't say which VM they were recorded on.
+	static constexpr uint8_t VERSION = 3;
+
+	// Keys currently held according to the events recorded so far
+	uint16_t held = 0;
+};
+
+template<typename Vm>
+bool Chip8InputLog::matches(const Vm &vm) const {
+	if constexpr (requires { vm.getVariant(); }) {
+		if (vm.getVariant() != this->variant) {
+			return false;
+		}
+	}
+	else if (this->variant != Variant::Chip8) {
+		return false;
+	}
+	return vm.getPlatform() == this->platform;
+}
+
+template<typename Vm>
+unsigned long long Chip8InputLog::replay(Vm &vm) const {
+	if (!this->matches(vm)) {
+		return 0;
+	}
+
+	vm.seed(this->seed);
+	vm.setTimerMode(Vm::TimerMode::Instruction, this->instructions_per_tick);
+
+	auto event = this->events.cbegin();
+	unsigned long long executed = 0;
+
+	while (executed < this->length && vm.isLive()) {
+		while (event != this->events.cend() && (event->instruction <= executed || !vm.isRunning())) {
+			vm.setKeyState(event->key, event->pressed);
+			++event;
+		}
+
+		if (!vm.isRunning()) {
+			// Waiting for a key that was never recorded
+			break;
+		}
+
+		auto target = event != this->events.cend() ? std::min(this->length, event->instruction) : this->length;
+		executed += vm.run(static_cast<unsigned long>(target - executed));
+	}
+
+	return executed;
+}
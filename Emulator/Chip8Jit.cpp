@@ -0,0 +1,438 @@
+#include "Chip8Jit.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if CHIP8_JIT_SUPPORTED
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace {
+	// Minimal x86-64 encoder covering the handful of instructions the translator needs.
+	//  The register file pointer lives in r8 (volatile in both the Windows and System V calling conventions), eax/ecx/edx are scratch.
+	class Emitter {
+	public:
+		enum Reg : uint8_t {
+			EAX = 0,
+			ECX = 1,
+			EDX = 2
+		};
+
+		std::vector<uint8_t> code;
+
+		void prologue() {
+#ifdef _WIN32
+			bytes({ 0x49, 0x89, 0xC8 }); // mov r8, rcx
+#else
+			bytes({ 0x49, 0x89, 0xF8 }); // mov r8, rdi
+#endif
+		}
+
+		// movzx reg, byte [r8 + disp]
+		void load8(Reg reg, uint8_t disp) {
+			bytes({ 0x41, 0x0F, 0xB6, modrmDisp8(reg), disp });
+		}
+
+		// mov byte [r8 + disp], reg8
+		void store8(Reg reg, uint8_t disp) {
+			bytes({ 0x41, 0x88, modrmDisp8(reg), disp });
+		}
+
+		// mov byte [r8 + disp], imm8
+		void store8(uint8_t disp, uint8_t value) {
+			bytes({ 0x41, 0xC6, modrmDisp8(0), disp, value });
+		}
+
+		// add byte [r8 + disp], imm8
+		void add8(uint8_t disp, uint8_t value) {
+			bytes({ 0x41, 0x80, modrmDisp8(0), disp, value });
+		}
+
+		// cmp byte [r8 + disp], imm8
+		void compare8(uint8_t disp, uint8_t value) {
+			bytes({ 0x41, 0x80, modrmDisp8(7), disp, value });
+		}
+
+		// mov word [r8 + disp], imm16
+		void store16(uint8_t disp, uint16_t value) {
+			bytes({ 0x66, 0x41, 0xC7, modrmDisp8(0), disp, static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) });
+		}
+
+		// mov word [r8 + disp], ax
+		void store16(uint8_t disp) {
+			bytes({ 0x66, 0x41, 0x89, modrmDisp8(EAX), disp });
+		}
+
+		// add word [r8 + disp], ax
+		void add16(uint8_t disp) {
+			bytes({ 0x66, 0x41, 0x01, modrmDisp8(EAX), disp });
+		}
+
+		// <op> eax, ecx where op is one of the r/m32, r32 opcodes (or 09, and 21, xor 31, add 01, sub 29, cmp 39)
+		void aluEaxEcx(uint8_t op) {
+			bytes({ op, 0xC8 });
+		}
+
+		// or eax, imm32
+		void orEax(uint32_t value) {
+			code.push_back(0x0D);
+			imm32(value);
+		}
+
+		// add eax, imm32
+		void addEax(uint32_t value) {
+			code.push_back(0x05);
+			imm32(value);
+		}
+
+		// and edx, imm8
+		void andEdx(uint8_t value) {
+			bytes({ 0x83, 0xE2, value });
+		}
+
+		// mov edx, eax
+		void copyEaxToEdx() {
+			bytes({ 0x89, 0xC2 });
+		}
+
+		// shr eax, imm8
+		void shrEax(uint8_t count) {
+			bytes({ 0xC1, 0xE8, count });
+		}
+
+		// shl eax, imm8
+		void shlEax(uint8_t count) {
+			bytes({ 0xC1, 0xE0, count });
+		}
+
+		// j<cc> rel8 with a placeholder offset, returns the position to patch with bindLabel()
+		std::size_t jumpIf(uint8_t condition) {
+			bytes({ condition, 0x00 });
+			return code.size();
+		}
+
+		void bindLabel(std::size_t label) {
+			code[label - 1] = static_cast<uint8_t>(code.size() - label);
+		}
+
+		// mov eax, imm32; ret
+		void returnValue(uint32_t value) {
+			code.push_back(0xB8);
+			imm32(value);
+			code.push_back(0xC3);
+		}
+
+		static constexpr uint8_t JE = 0x74;
+		static constexpr uint8_t JNE = 0x75;
+
+	private:
+		static constexpr uint8_t modrmDisp8(uint8_t reg) {
+			// mod = 01 (disp8), rm = 000 (r8 with REX.B)
+			return static_cast<uint8_t>(0x40 | reg << 3);
+		}
+
+		void bytes(std::initializer_list<uint8_t> values) {
+			code.insert(code.end(), values);
+		}
+
+		void imm32(uint32_t value) {
+			for (auto shift = 0; shift < 32; shift += 8) {
+				code.push_back(static_cast<uint8_t>(value >> shift));
+			}
+		}
+	};
+
+	constexpr uint8_t V_OFFSET = static_cast<uint8_t>(offsetof(Chip8Jit::Registers, v));
+	constexpr uint8_t PC_OFFSET = static_cast<uint8_t>(offsetof(Chip8Jit::Registers, pc));
+	constexpr uint8_t I_OFFSET = static_cast<uint8_t>(offsetof(Chip8Jit::Registers, i));
+}
+
+Chip8Jit::Chip8Jit(Chip8Quirks quirks) :
+	quirks(quirks)
+{
+#if CHIP8_JIT_SUPPORTED
+#ifdef _WIN32
+	this->buffer = static_cast<uint8_t *>(VirtualAlloc(nullptr, BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READ));
+#else
+	auto mapping = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	this->buffer = mapping == MAP_FAILED ? nullptr : static_cast<uint8_t *>(mapping);
+#endif
+#endif
+}
+
+Chip8Jit::~Chip8Jit() {
+#if CHIP8_JIT_SUPPORTED
+	if (this->buffer != nullptr) {
+#ifdef _WIN32
+		VirtualFree(this->buffer, 0, MEM_RELEASE);
+#else
+		munmap(this->buffer, BUFFER_SIZE);
+#endif
+	}
+#endif
+}
+
+bool Chip8Jit::isAvailable() const {
+	return this->buffer != nullptr;
+}
+
+void Chip8Jit::setWritable(bool writable) {
+#if CHIP8_JIT_SUPPORTED
+#ifdef _WIN32
+	DWORD previous;
+	VirtualProtect(this->buffer, BUFFER_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &previous);
+	if (!writable) {
+		FlushInstructionCache(GetCurrentProcess(), this->buffer, BUFFER_SIZE);
+	}
+#else
+	mprotect(this->buffer, BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+#else
+	(void)writable;
+#endif
+}
+
+void Chip8Jit::flush() {
+	this->blocks.fill({});
+	this->buffer_used = 0;
+}
+
+const Chip8Jit::Block &Chip8Jit::getBlock(const std::array<uint8_t, Chip8FastVm::MEMORY_SIZE> &ram, uint16_t address) {
+	if (address >= Chip8FastVm::MEMORY_SIZE) {
+		// Out of range, the interpreter will halt
+		static constexpr Block none{};
+		return none;
+	}
+
+	auto &block = this->blocks[address];
+	if (!block.compiled) {
+		block = this->compile(ram, address);
+	}
+	return block;
+}
+
+void Chip8Jit::invalidate(uint16_t address, uint_fast8_t count) {
+	for (uint_fast8_t offset = 0; offset < count; ++offset) {
+		this->modified.set((address + offset) & Chip8FastVm::ADDRESS_MASK);
+	}
+
+	this->discard(address, count);
+}
+
+void Chip8Jit::discard(uint16_t address, uint16_t count) {
+	// Any block starting up to a full block length before the write might cover it
+	auto first_written = address & Chip8FastVm::ADDRESS_MASK;
+	auto first_start = std::max(0, first_written - MAX_BLOCK_INSTRUCTIONS * 2);
+	auto written_end = first_written + std::min<int>(count, Chip8FastVm::MEMORY_SIZE);
+	auto last_start = std::min<int>(written_end, Chip8FastVm::MEMORY_SIZE);
+	for (auto start = first_start; start < last_start; ++start) {
+		if (this->blocks[start].compiled && this->blocks[start].end > first_written) {
+			this->blocks[start] = {};
+		}
+	}
+
+	// Blocks never run past the end of memory, but a write can wrap around to its start
+	if (written_end > Chip8FastVm::MEMORY_SIZE) {
+		this->discard(0, written_end - Chip8FastVm::MEMORY_SIZE);
+	}
+}
+
+void Chip8Jit::reset() {
+	this->flush();
+	this->modified.reset();
+}
+
+Chip8Jit::Block Chip8Jit::compile(const std::array<uint8_t, Chip8FastVm::MEMORY_SIZE> &ram, uint16_t address) {
+	Block block;
+	block.compiled = true;
+	block.end = address;
+
+	if (!this->isAvailable()) {
+		return block;
+	}
+
+	Emitter emitter;
+	emitter.prologue();
+
+	uint32_t instructions = 0;
+	auto pc = address;
+	bool terminated = false;
+	bool interpreted = false;
+
+	// Stop early enough that a skip at the end of the block can never run off the end of memory, the interpreter handles halting.
+	while (!terminated && instructions < MAX_BLOCK_INSTRUCTIONS && pc + 5 < Chip8FastVm::MEMORY_SIZE && !this->modified.test(pc) && !this->modified.test(pc + 1)) {
+		uint16_t opcode = static_cast<uint16_t>(ram[pc] << 8 | ram[pc + 1]);
+		uint8_t x = V_OFFSET + ((opcode >> 8) & 0xF);
+		uint8_t y = V_OFFSET + ((opcode >> 4) & 0xF);
+		uint8_t nn = opcode & 0xFF;
+		uint16_t nnn = opcode & 0xFFF;
+		constexpr uint8_t vf = V_OFFSET + 0xF;
+
+		auto skip = [&](auto emitCompare, uint8_t skipUnless) {
+			emitter.store16(PC_OFFSET, static_cast<uint16_t>(pc + 2));
+			emitCompare();
+			auto label = emitter.jumpIf(skipUnless);
+			emitter.store16(PC_OFFSET, static_cast<uint16_t>(pc + 4));
+			emitter.bindLabel(label);
+			terminated = true;
+		};
+
+		auto handler = Chip8FastVm::classify(opcode);
+		switch (handler)
+		{
+		case Chip8FastVm::Handler::Unsupported:
+			// Unsupported instructions are no-ops in the interpreter, except 0000 where it halts
+			interpreted = opcode == 0x0000 && this->quirks.halt_on_zero;
+			break;
+
+		case Chip8FastVm::Handler::Jump:
+			emitter.store16(PC_OFFSET, nnn);
+			terminated = true;
+			break;
+
+		case Chip8FastVm::Handler::JumpOffset:
+			emitter.load8(Emitter::EAX, this->quirks.jump_uses_vx ? x : V_OFFSET);
+			emitter.addEax(nnn);
+			emitter.store16(PC_OFFSET);
+			terminated = true;
+			break;
+
+		case Chip8FastVm::Handler::SkipIfEqualValue:
+			skip([&] { emitter.compare8(x, nn); }, Emitter::JNE);
+			break;
+
+		case Chip8FastVm::Handler::SkipIfNotEqualValue:
+			skip([&] { emitter.compare8(x, nn); }, Emitter::JE);
+			break;
+
+		case Chip8FastVm::Handler::SkipIfEqualRegister:
+			skip([&] {
+				emitter.load8(Emitter::EAX, x);
+				emitter.load8(Emitter::ECX, y);
+				emitter.aluEaxEcx(0x39);
+			}, Emitter::JNE);
+			break;
+
+		case Chip8FastVm::Handler::SkipIfNotEqualRegister:
+			skip([&] {
+				emitter.load8(Emitter::EAX, x);
+				emitter.load8(Emitter::ECX, y);
+				emitter.aluEaxEcx(0x39);
+			}, Emitter::JE);
+			break;
+
+		case Chip8FastVm::Handler::SetValue:
+			emitter.store8(x, nn);
+			break;
+
+		case Chip8FastVm::Handler::AddValue:
+			emitter.add8(x, nn);
+			break;
+
+		case Chip8FastVm::Handler::SetRegister:
+			emitter.load8(Emitter::EAX, y);
+			emitter.store8(Emitter::EAX, x);
+			break;
+
+		case Chip8FastVm::Handler::Or:
+		case Chip8FastVm::Handler::And:
+		case Chip8FastVm::Handler::Xor:
+			emitter.load8(Emitter::EAX, x);
+			emitter.load8(Emitter::ECX, y);
+			emitter.aluEaxEcx(handler == Chip8FastVm::Handler::Or ? 0x09 : handler == Chip8FastVm::Handler::And ? 0x21 : 0x31);
+			emitter.store8(Emitter::EAX, x);
+			break;
+
+		case Chip8FastVm::Handler::Add:
+			emitter.load8(Emitter::EAX, x);
+			emitter.load8(Emitter::ECX, y);
+			emitter.aluEaxEcx(0x01);
+			emitter.store8(Emitter::EAX, x);
+			emitter.shrEax(8);
+			emitter.store8(Emitter::EAX, vf);
+			break;
+
+		case Chip8FastVm::Handler::Subtract:
+		case Chip8FastVm::Handler::SubtractReversed: {
+			bool reversed = handler == Chip8FastVm::Handler::SubtractReversed;
+			emitter.load8(Emitter::EAX, reversed ? y : x);
+			emitter.orEax(0x100);
+			emitter.load8(Emitter::ECX, reversed ? x : y);
+			emitter.aluEaxEcx(0x29);
+			emitter.store8(Emitter::EAX, x);
+			emitter.shrEax(8);
+			emitter.store8(Emitter::EAX, vf);
+			break;
+		}
+
+		case Chip8FastVm::Handler::ShiftRight:
+			emitter.load8(Emitter::EAX, this->quirks.shift_uses_vy ? y : x);
+			emitter.copyEaxToEdx();
+			emitter.shrEax(1);
+			emitter.store8(Emitter::EAX, x);
+			emitter.andEdx(1);
+			emitter.store8(Emitter::EDX, vf);
+			break;
+
+		case Chip8FastVm::Handler::ShiftLeft:
+			emitter.load8(Emitter::EAX, this->quirks.shift_uses_vy ? y : x);
+			emitter.shlEax(1);
+			emitter.store8(Emitter::EAX, x);
+			emitter.shrEax(8);
+			emitter.store8(Emitter::EAX, vf);
+			break;
+
+		case Chip8FastVm::Handler::SetAddress:
+			emitter.store16(I_OFFSET, nnn);
+			break;
+
+		case Chip8FastVm::Handler::AddAddress:
+			emitter.load8(Emitter::EAX, x);
+			emitter.add16(I_OFFSET);
+			break;
+
+		default:
+			// Everything else is left to the interpreter, the block ends before this instruction.
+			interpreted = true;
+			break;
+		}
+
+		if (interpreted) {
+			break;
+		}
+
+		++instructions;
+		pc += 2;
+	}
+
+	if (!terminated) {
+		emitter.store16(PC_OFFSET, pc);
+	}
+	emitter.returnValue(instructions);
+	block.end = pc;
+	block.instructions = static_cast<uint8_t>(instructions);
+
+	if (block.instructions == 0) {
+		// Nothing worth calling into, let the interpreter handle this address.
+		return block;
+	}
+
+	if (this->buffer_used + emitter.code.size() > BUFFER_SIZE) {
+		this->flush();
+	}
+
+	this->setWritable(true);
+	std::memcpy(this->buffer + this->buffer_used, emitter.code.data(), emitter.code.size());
+	this->setWritable(false);
+
+	block.entry = reinterpret_cast<Entry>(this->buffer + this->buffer_used);
+	this->buffer_used += emitter.code.size();
+
+	return block;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Chip8FastVm.h"
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Native code generation is only implemented for x86-64, everywhere else the JIT never compiles anything and Chip8FastVm keeps interpreting.
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_SUPPORTED 1
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+/**
+* Dynamic recompiler for Chip8FastVm.
+*
+* Basic blocks of register only instructions are translated to x86-64 and cached per start address. A block ends at (and includes) a jump, BNNN, or a
+* conditional skip. Any other instruction (calls and returns, DXYN, FX0A, timers, memory access, ...) ends the block before it so the interpreter can execute it.
+* Code that has been written to by the program is never compiled. Code is generated for the quirks of the VM's platform (see Chip8Quirks).
+*/
+class Chip8Jit {
+public:
+	explicit Chip8Jit(Chip8Quirks quirks = Chip8Quirks::forPlatform(Chip8Platform::Octo));
+	~Chip8Jit();
+
+	Chip8Jit(const Chip8Jit &) = delete;
+	Chip8Jit &operator=(const Chip8Jit &) = delete;
+
+	// Whether native code can be generated on this platform (and the executable buffer could be allocated)
+	bool isAvailable() const;
+
+	using Registers = Chip8FastVm::Registers;
+
+	// Compiled code takes the register file and returns the number of instructions it executed, having stored the address of the next instruction in pc.
+	using Entry = uint32_t(*)(Registers *);
+
+	struct Block {
+		Entry entry = nullptr;
+		uint16_t end = 0; // One past the last byte of RAM the block was compiled from
+		uint8_t instructions = 0; // Zero when no code could be generated for the start address
+		bool compiled = false;
+	};
+
+	/**
+	* Find or compile the block starting at an address.
+	*
+	* @return The cached block, check instructions before calling entry as not every address can be compiled.
+	*/
+	const Block &getBlock(const std::array<uint8_t, Chip8FastVm::MEMORY_SIZE> &ram, uint16_t address);
+
+	/**
+	* Discard compiled code overlapping a write to memory and stop compiling those bytes in the future.
+	*/
+	void invalidate(uint16_t address, uint_fast8_t count);
+
+	// Discard compiled code overlapping a range of memory that was replaced wholesale (e.g. by restoring a snapshot), without treating it as written.
+	void discard(uint16_t address, uint16_t count);
+
+	// Forget every block and write for a newly loaded program, the executable buffer is kept for reuse.
+	void reset();
+
+protected:
+	Chip8Quirks quirks;
+
+	static constexpr std::size_t BUFFER_SIZE = 1 << 20;
+	static constexpr uint_fast8_t MAX_BLOCK_INSTRUCTIONS = 64;
+
+	// Executable memory. Writable while emitting a block, read/execute otherwise.
+	uint8_t *buffer = nullptr;
+	std::size_t buffer_used = 0;
+
+	std::array<Block, Chip8FastVm::MEMORY_SIZE> blocks{};
+
+	// Bytes the program has written to, code containing any of these stays interpreted.
+	std::bitset<Chip8FastVm::MEMORY_SIZE> modified;
+
+	void setWritable(bool writable);
+	void flush();
+
+	Block compile(const std::array<uint8_t, Chip8FastVm::MEMORY_SIZE> &ram, uint16_t address);
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+* Copy-on-write snapshots of a VM's RAM (4 KiB for CHIP-8, up to 64 KiB for XO-CHIP), split into pages of 256 bytes.
+*
+* The VM reports every write to RAM through markDirty(). Capturing only copies the pages written since the last capture or restore, every other page is
+* shared with earlier snapshots, so keeping thousands of snapshots of a mostly static program costs little more than their page pointers. Restoring
+* likewise only copies the pages that differ from what RAM currently holds.
+*/
+class Chip8MemoryPages {
+public:
+	static constexpr std::size_t PAGE_SIZE = 256;
+	static constexpr std::size_t MAX_MEMORY_SIZE = 64 * 1024;
+	static constexpr std::size_t MAX_PAGE_COUNT = MAX_MEMORY_SIZE / PAGE_SIZE;
+
+	using Page = std::array<std::byte, PAGE_SIZE>;
+	using Pages = std::vector<std::shared_ptr<const Page>>;
+
+	// One bit per page
+	using PageMask = std::bitset<MAX_PAGE_COUNT>;
+
+	// @param memory_size Size of RAM in bytes, a multiple of PAGE_SIZE no larger than MAX_MEMORY_SIZE.
+	explicit Chip8MemoryPages(std::size_t memory_size = 4096) :
+		memory_size(memory_size),
+		pages(memory_size / PAGE_SIZE)
+	{
+		// Nothing has been captured yet so every page needs copying on the first capture.
+		for (std::size_t page = 0; page < this->pages.size(); ++page) {
+			this->dirty.set(page);
+		}
+	}
+
+	std::size_t getPageCount() const {
+		return this->pages.size();
+	}
+
+	// Record a write to RAM, addresses wrap at the end of memory.
+	void markDirty(std::size_t address, std::size_t count) {
+		if (count >= this->memory_size) {
+			count = this->memory_size;
+		}
+
+		for (std::size_t offset = 0; offset < count; offset += PAGE_SIZE) {
+			this->dirty.set((address + offset) % this->memory_size / PAGE_SIZE);
+		}
+		if (count > 0) {
+			this->dirty.set((address + count - 1) % this->memory_size / PAGE_SIZE);
+		}
+	}
+
+	// Copy the pages written since the last capture or restore and return the full set of pages making up RAM.
+	Pages capture(std::span<const std::byte> ram) {
+		for (std::size_t page = 0; page < this->pages.size(); ++page) {
+			if (this->dirty.test(page)) {
+				auto copy = std::make_shared<Page>();
+				std::copy_n(ram.begin() + page * PAGE_SIZE, PAGE_SIZE, copy->begin());
+				this->pages[page] = std::move(copy);
+			}
+		}
+
+		this->dirty.reset();
+		return this->pages;
+	}
+
+	/**
+	* Bring RAM back to a captured state, copying only pages that were written since the last capture/restore or that differ in the snapshot.
+	*
+	* @return The pages that were overwritten, anything the VM cached about their contents is stale.
+	*/
+	PageMask restore(std::span<std::byte> ram, const Pages &snapshot) {
+		PageMask changed = this->dirty;
+		for (std::size_t page = 0; page < this->pages.size(); ++page) {
+			if (snapshot[page] != this->pages[page]) {
+				changed.set(page);
+			}
+		}
+
+		for (std::size_t page = 0; page < this->pages.size(); ++page) {
+			if (changed.test(page)) {
+				std::copy(snapshot[page]->begin(), snapshot[page]->end(), ram.begin() + page * PAGE_SIZE);
+			}
+		}
+
+		this->pages = snapshot;
+		this->dirty.reset();
+		return changed;
+	}
+
+protected:
+	std::size_t memory_size;
+
+	// The pages as of the last capture or restore, shared with every snapshot taken since.
+	Pages pages;
+
+	PageMask dirty;
+};
@@ -0,0 +1,252 @@
+#include "Chip8Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CHIP8_PROFILER_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CHIP8_PROFILER_RDTSC 1
+#endif
+
+namespace {
+	constexpr const char *OPCODE_NAMES[Chip8Profiler::OPCODE_CLASSES] = {
+		"00E0", "00EE", "00CN", "00DN", "00FB", "00FC", "00FD", "00FE", "00FF", "0NNN",
+		"1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "5XY2", "5XY3", "6XNN", "7XNN",
+		"8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+		"9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1",
+		"F000", "FN01", "F002", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX30", "FX33", "FX3A", "FX55", "FX65", "FX75", "FX85",
+		"unknown"
+	};
+	constexpr uint_fast8_t UNKNOWN = Chip8Profiler::OPCODE_CLASSES - 1;
+
+	// Index of the first class for each leading nybble, 0, 5, 8, E and F are split further by the low bits
+	constexpr uint_fast8_t FIRST_CLASS[16] = { 0, 10, 11, 12, 13, 14, 17, 18, 19, 28, 29, 30, 31, 32, 33, 35 };
+
+	void writeCounters(std::ostream &output, const Chip8Profiler::Counters &counters) {
+		output << "\"executions\": " << counters.executions << ", \"cycles\": " << counters.cycles;
+	}
+}
+
+Chip8Profiler::Cycles Chip8Profiler::now() {
+#if defined(CHIP8_PROFILER_RDTSC)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+const char *Chip8Profiler::getCycleUnit() {
+#if defined(CHIP8_PROFILER_RDTSC)
+	return "tsc";
+#else
+	return "ns";
+#endif
+}
+
+Chip8Profiler::Chip8Profiler(std::size_t memory_size) :
+	addresses(memory_size)
+{
+}
+
+uint_fast8_t Chip8Profiler::classify(uint16_t instruction) {
+	auto group = instruction >> 12;
+	auto lo = instruction & 0xFF;
+
+	switch (group) {
+	case 0x0:
+		switch (instruction & 0xFFF0) {
+		case 0x00C0: return FIRST_CLASS[group] + 2;
+		case 0x00D0: return FIRST_CLASS[group] + 3;
+		}
+		switch (instruction) {
+		case 0x00E0: return FIRST_CLASS[group];
+		case 0x00EE: return FIRST_CLASS[group] + 1;
+		case 0x00FB: return FIRST_CLASS[group] + 4;
+		case 0x00FC: return FIRST_CLASS[group] + 5;
+		case 0x00FD: return FIRST_CLASS[group] + 6;
+		case 0x00FE: return FIRST_CLASS[group] + 7;
+		case 0x00FF: return FIRST_CLASS[group] + 8;
+		default: return FIRST_CLASS[group] + 9;
+		}
+
+	case 0x5:
+		switch (instruction & 0xF) {
+		case 0x0: return FIRST_CLASS[group];
+		case 0x2: return FIRST_CLASS[group] + 1;
+		case 0x3: return FIRST_CLASS[group] + 2;
+		default: return UNKNOWN;
+		}
+
+	case 0x8:
+		switch (instruction & 0xF) {
+		case 0x0: case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7:
+			return FIRST_CLASS[group] + (instruction & 0xF);
+		case 0xE:
+			return FIRST_CLASS[group] + 8;
+		default:
+			return UNKNOWN;
+		}
+
+	case 0xE:
+		return lo == 0x9E ? FIRST_CLASS[group] : lo == 0xA1 ? FIRST_CLASS[group] + 1 : UNKNOWN;
+
+	case 0xF:
+		switch (instruction) {
+		case 0xF000: return FIRST_CLASS[group];
+		case 0xF002: return FIRST_CLASS[group] + 2;
+		}
+		switch (lo) {
+		case 0x01: return FIRST_CLASS[group] + 1;
+		case 0x07: return FIRST_CLASS[group] + 3;
+		case 0x0A: return FIRST_CLASS[group] + 4;
+		case 0x15: return FIRST_CLASS[group] + 5;
+		case 0x18: return FIRST_CLASS[group] + 6;
+		case 0x1E: return FIRST_CLASS[group] + 7;
+		case 0x29: return FIRST_CLASS[group] + 8;
+		case 0x30: return FIRST_CLASS[group] + 9;
+		case 0x33: return FIRST_CLASS[group] + 10;
+		case 0x3A: return FIRST_CLASS[group] + 11;
+		case 0x55: return FIRST_CLASS[group] + 12;
+		case 0x65: return FIRST_CLASS[group] + 13;
+		case 0x75: return FIRST_CLASS[group] + 14;
+		case 0x85: return FIRST_CLASS[group] + 15;
+		default: return UNKNOWN;
+		}
+
+	default:
+		return FIRST_CLASS[group];
+	}
+}
+
+const char *Chip8Profiler::getOpcodeName(uint_fast8_t opcode_class) {
+	return OPCODE_NAMES[std::min(opcode_class, UNKNOWN)];
+}
+
+void Chip8Profiler::record(uint16_t instruction, uint16_t address, std::span<const uint16_t> call_stack, Cycles cycles) {
+	auto &opcode = this->opcodes[classify(instruction)];
+	++opcode.executions;
+	opcode.cycles += cycles;
+
+	auto &location = this->addresses[address % this->addresses.size()];
+	++location.executions;
+	location.cycles += cycles;
+
+	this->scratch_key.assign(call_stack.begin(), call_stack.end());
+	this->scratch_key.push_back(address);
+	this->scratch_key.push_back(instruction);
+
+	auto stack = this->stacks.find(this->scratch_key);
+	if (stack == this->stacks.end()) {
+		stack = this->stacks.emplace(this->scratch_key, Counters{}).first;
+	}
+	++stack->second.executions;
+	stack->second.cycles += cycles;
+}
+
+void Chip8Profiler::recordFusion(const char *name, Cycles cycles) {
+	auto fusion = std::find_if(this->fusions.begin(), this->fusions.end(), [name](const auto &entry) { return entry.first == name; });
+	if (fusion == this->fusions.end()) {
+		fusion = this->fusions.emplace(this->fusions.end(), name, Counters{});
+	}
+
+	++fusion->second.executions;
+	fusion->second.cycles += cycles;
+}
+
+void Chip8Profiler::reset() {
+	this->opcodes.fill({});
+	std::fill(this->addresses.begin(), this->addresses.end(), Counters{});
+	this->fusions.clear();
+	this->stacks.clear();
+}
+
+const Chip8Profiler::Counters &Chip8Profiler::getOpcodeCounters(uint_fast8_t opcode_class) const {
+	return this->opcodes[std::min(opcode_class, UNKNOWN)];
+}
+
+const Chip8Profiler::Counters &Chip8Profiler::getAddressCounters(uint16_t address) const {
+	return this->addresses[address % this->addresses.size()];
+}
+
+const std::vector<std::pair<std::string, Chip8Profiler::Counters>> &Chip8Profiler::getFusionCounters() const {
+	return this->fusions;
+}
+
+void Chip8Profiler::writeJson(std::ostream &output) const {
+	output << "{\n\t\"cycle_unit\": \"" << getCycleUnit() << "\",\n\t\"opcodes\": [";
+
+	const char *separator = "\n";
+	for (uint_fast8_t opcode_class = 0; opcode_class < OPCODE_CLASSES; ++opcode_class) {
+		if (this->opcodes[opcode_class].executions == 0) {
+			continue;
+		}
+
+		output << separator << "\t\t{ \"opcode\": \"" << getOpcodeName(opcode_class) << "\", ";
+		writeCounters(output, this->opcodes[opcode_class]);
+		output << " }";
+		separator = ",\n";
+	}
+
+	output << "\n\t],\n\t\"addresses\": [";
+
+	separator = "\n";
+	for (std::size_t address = 0; address < this->addresses.size(); ++address) {
+		if (this->addresses[address].executions == 0) {
+			continue;
+		}
+
+		char hex[8];
+		std::snprintf(hex, sizeof(hex), "%04X", static_cast<unsigned>(address));
+		output << separator << "\t\t{ \"address\": \"" << hex << "\", ";
+		writeCounters(output, this->addresses[address]);
+		output << " }";
+		separator = ",\n";
+	}
+
+	output << "\n\t],\n\t\"fusions\": [";
+
+	separator = "\n";
+	for (const auto &[name, counters] : this->fusions) {
+		output << separator << "\t\t{ \"fusion\": \"" << name << "\", ";
+		writeCounters(output, counters);
+		output << " }";
+		separator = ",\n";
+	}
+
+	output << "\n\t]\n}\n";
+}
+
+void Chip8Profiler::writeFoldedStacks(std::ostream &output) const {
+	// Stacks start from the program entry point, each subroutine is named after its address and the leaf is the instruction with its address
+	std::string line;
+	char frame[16];
+	for (const auto &[key, counters] : this->stacks) {
+		line = "main";
+		for (std::size_t depth = 0; depth + 2 < key.size(); ++depth) {
+			std::snprintf(frame, sizeof(frame), ";sub_%04X", static_cast<unsigned>(key[depth]));
+			line += frame;
+		}
+
+		auto address = key[key.size() - 2];
+		auto instruction = key[key.size() - 1];
+		std::snprintf(frame, sizeof(frame), ";%s@%04X ", getOpcodeName(classify(instruction)), static_cast<unsigned>(address));
+		line += frame;
+
+		output << line << counters.cycles << "\n";
+	}
+}
+
+std::size_t Chip8Profiler::StackKeyHash::operator()(const StackKey &key) const {
+	// FNV-1a over the 16 bit entries
+	uint64_t hash = 0xcbf29ce484222325;
+	for (auto value : key) {
+		hash ^= value;
+		hash *= 0x100000001b3;
+	}
+	return static_cast<std::size_t>(hash);
+}
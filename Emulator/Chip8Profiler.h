@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Build with CHIP8_PROFILER defined as 1 (e.g. /DCHIP8_PROFILER=1) to compile profiling hooks into Chip8ReferenceVm::step(). The hooks and the profiler
+// state are left out of the VM entirely otherwise.
+#ifndef CHIP8_PROFILER
+#define CHIP8_PROFILER 0
+#endif
+
+/**
+* Counts executions and the time spent on each instruction, grouped by opcode class (8XY4, DXYN, FX33, ...), by address and by call stack.
+*
+* Time is measured in host cycles where a cycle counter is available (rdtsc on x86) and nanoseconds otherwise, see getCycleUnit().
+*/
+class Chip8Profiler {
+public:
+	using Cycles = uint64_t;
+	static Cycles now();
+	static const char *getCycleUnit();
+
+	// @param memory_size Size of the profiled VM's RAM, a power of 2. Every address in it is counted separately.
+	explicit Chip8Profiler(std::size_t memory_size = 4096);
+
+	// Opcode classes are indices into a table of names in the usual notation, the last class holds anything that isn't a valid instruction. SUPER-CHIP and
+	// XO-CHIP instructions have classes of their own whichever instruction set the VM runs.
+	static constexpr uint_fast8_t OPCODE_CLASSES = 52;
+	static uint_fast8_t classify(uint16_t instruction);
+	static const char *getOpcodeName(uint_fast8_t opcode_class);
+
+	struct Counters {
+		unsigned long long executions = 0;
+		Cycles cycles = 0;
+	};
+
+	/**
+	* Account for one executed instruction.
+	*
+	* @param instruction The instruction as a big endian 16 bit value.
+	* @param address Where the instruction was fetched from.
+	* @param call_stack Entry address of every subroutine active when the instruction started, outermost first.
+	* @param cycles Time spent executing the instruction.
+	*/
+	void record(uint16_t instruction, uint16_t address, std::span<const uint16_t> call_stack, Cycles cycles);
+
+	/**
+	* Account for one execution of a superinstruction, in addition to recording each of the instructions it executed.
+	*
+	* @param name Name of the fused sequence, e.g. "6XNN ANNN DXYN".
+	*/
+	void recordFusion(const char *name, Cycles cycles);
+
+	void reset();
+
+	const Counters &getOpcodeCounters(uint_fast8_t opcode_class) const;
+	const Counters &getAddressCounters(uint16_t address) const;
+
+	// Executions of each superinstruction the VM ran, by name
+	const std::vector<std::pair<std::string, Counters>> &getFusionCounters() const;
+
+	// Totals per opcode class, per address and per superinstruction, leaving out anything that never executed.
+	void writeJson(std::ostream &output) const;
+
+	// One line per distinct call stack and instruction in the folded format used by flamegraph.pl and compatible tools, weighted by cycles.
+	void writeFoldedStacks(std::ostream &output) const;
+
+protected:
+	std::array<Counters, OPCODE_CLASSES> opcodes{};
+
+	// One per byte of RAM
+	std::vector<Counters> addresses;
+
+	// Only a handful of sequences are fused, a linear search is quicker than hashing their names
+	std::vector<std::pair<std::string, Counters>> fusions;
+
+	// Samples are keyed by the subroutine entry addresses followed by the address and value of the instruction itself.
+	using StackKey = std::vector<uint16_t>;
+	struct StackKeyHash {
+		std::size_t operator()(const StackKey &key) const;
+	};
+	std::unordered_map<StackKey, Counters, StackKeyHash> stacks;
+
+	// Reused between calls to record() so looking up an existing stack doesn't allocate.
+	StackKey scratch_key;
+};
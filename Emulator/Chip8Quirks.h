@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+// Interpreters whose behaviour programs commonly depend on. Most programs only run correctly with the quirks of the platform they were written for.
+enum class Chip8Platform : uint8_t {
+	CosmacVip, // The original interpreter on the RCA COSMAC VIP
+	Chip48,    // CHIP-48 on the HP-48
+	SuperChip, // SUPER-CHIP 1.1 on the HP-48
+	Octo       // The Octo IDE, what most modern programs are written for (default)
+};
+
+/**
+* Behaviour that differs between platforms.
+*
+* The VMs take a Chip8Platform as a template argument for their interpreter loop and read these flags with if constexpr, so each platform compiles to its
+* own specialised interpreter instead of testing flags on every instruction. The platform is picked once when the VM is constructed.
+*/
+struct Chip8Quirks {
+	// What FX55/FX65 leave in I after storing/loading V0 to VX
+	enum class IndexIncrement : uint8_t {
+		None,    // Unchanged
+		X,       // I + X
+		XPlusOne // I + X + 1
+	};
+
+	// 8XY6/8XYE shift VY and store the result in VX, instead of shifting VX in place
+	bool shift_uses_vy;
+
+	IndexIncrement load_store_increment;
+
+	// BNNN jumps to NNN + VX (where X is the high nybble of NNN) instead of NNN + V0
+	bool jump_uses_vx;
+
+	// Sprites drawn past the right or bottom edge of the screen continue on the opposite edge instead of being clipped. The starting position always wraps.
+	bool wrap_sprites;
+
+	// 0000 halts the VM instead of being ignored like any other 0NNN machine code call
+	bool halt_on_zero;
+
+	static constexpr Chip8Quirks forPlatform(Chip8Platform platform) {
+		switch (platform)
+		{
+		case Chip8Platform::CosmacVip:
+			return { true, IndexIncrement::XPlusOne, false, false, false };
+
+		case Chip8Platform::Chip48:
+			return { false, IndexIncrement::X, true, false, false };
+
+		case Chip8Platform::SuperChip:
+			return { false, IndexIncrement::None, true, false, false };
+
+		default:
+			return { true, IndexIncrement::XPlusOne, false, true, true };
+		}
+	}
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+* The random number generator behind CXNN, xoshiro128** seeded through splitmix64.
+*
+* The whole state is four 32 bit words, so it's free to construct, copy into a snapshot and step, unlike the standard library engines (and no
+* std::random_device is opened per VM). Every engine draws the top byte of each number from a generator seeded with the same 32 bit value, so VMs seeded
+* the same way see the same random bytes whichever engine runs them. VMs start with seed 0; frontends that want a different run each time seed them
+* from std::random_device themselves.
+*/
+class Chip8Random {
+public:
+	using State = std::array<uint32_t, 4>;
+
+	constexpr explicit Chip8Random(uint32_t seed = 0) :
+		state(expand(seed))
+	{
+	}
+
+	constexpr void seed(uint32_t seed) {
+		this->state = expand(seed);
+	}
+
+	constexpr uint32_t next() {
+		return step(this->state[0], this->state[1], this->state[2], this->state[3]);
+	}
+
+	constexpr uint8_t nextByte() {
+		return static_cast<uint8_t>(this->next() >> 24);
+	}
+
+	// splitmix64 spreads the seed over the whole state, so seeds that differ in a single bit still give unrelated streams. The state is never all zero.
+	static constexpr State expand(uint32_t seed) {
+		uint64_t x = seed;
+		State state{};
+		for (std::size_t word = 0; word < state.size(); word += 2) {
+			x += 0x9E3779B97F4A7C15;
+			auto z = x;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+			z ^= z >> 31;
+			state[word] = static_cast<uint32_t>(z);
+			state[word + 1] = static_cast<uint32_t>(z >> 32);
+		}
+		return state;
+	}
+
+	/**
+	* Draw a byte for every lane set in mask (0xFF) from generators stored as a structure of arrays, one column per state word.
+	*
+	* The loop has no branches so compilers vectorise it, unselected lanes keep their state and output.
+	*/
+	static void nextBytes(const std::array<uint32_t *, 4> &columns, const uint8_t *mask, uint8_t *output, std::size_t count) {
+		for (std::size_t lane = 0; lane < count; ++lane) {
+			uint32_t keep = static_cast<uint32_t>(mask[lane] & 1) - 1;
+			uint32_t s0 = columns[0][lane], s1 = columns[1][lane], s2 = columns[2][lane], s3 = columns[3][lane];
+			uint32_t n0 = s0, n1 = s1, n2 = s2, n3 = s3;
+			auto value = step(n0, n1, n2, n3);
+
+			columns[0][lane] = (n0 & ~keep) | (s0 & keep);
+			columns[1][lane] = (n1 & ~keep) | (s1 & keep);
+			columns[2][lane] = (n2 & ~keep) | (s2 & keep);
+			columns[3][lane] = (n3 & ~keep) | (s3 & keep);
+			output[lane] = static_cast<uint8_t>(((value >> 24) & ~keep) | (output[lane] & keep));
+		}
+	}
+
+protected:
+	State state;
+
+	static constexpr uint32_t rotl(uint32_t x, int k) {
+		return (x << k) | (x >> (32 - k));
+	}
+
+	static constexpr uint32_t step(uint32_t &s0, uint32_t &s1, uint32_t &s2, uint32_t &s3) {
+		auto result = rotl(s1 * 5, 7) * 9;
+		auto t = s1 << 9;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = rotl(s3, 11);
+
+		return result;
+	}
+};
@@ -1,136 +1,83 @@
 #include "Chip8ReferenceVm.h"
 
+#include "Chip8Font.h"
+
+#include <algorithm>
+#include <bit>
 #include <chrono>
+#include <limits>
+#include <thread>
+
+Chip8ReferenceVm::Chip8ReferenceVm(const std::span<const std::byte>& rom, Variant variant, Chip8Platform platform) :
+	variant(variant),
+	platform(platform),
+	ram(variant == Variant::XoChip ? 64 * 1024 : 4096),
+	address_mask(static_cast<Address>(ram.size() - 1)),
+	decoded_instructions(ram.size()),
+	memory_pages(ram.size())
+{
+	switch (this->platform)
+	{
+	case Chip8Platform::CosmacVip:
+		this->step_function = &Chip8ReferenceVm::execute<Chip8Platform::CosmacVip>;
+		break;
+
+	case Chip8Platform::Chip48:
+		this->step_function = &Chip8ReferenceVm::execute<Chip8Platform::Chip48>;
+		break;
+
+	case Chip8Platform::SuperChip:
+		this->step_function = &Chip8ReferenceVm::execute<Chip8Platform::SuperChip>;
+		break;
+
+	default:
+		this->step_function = &Chip8ReferenceVm::execute<Chip8Platform::Octo>;
+		break;
+	}
+
+#if CHIP8_PROFILER
+	this->profiler = Chip8Profiler(this->ram.size());
+#endif
 
-template<typename... Ts>
-std::array<std::byte, sizeof...(Ts)> make_bytes(Ts&&... args) noexcept {
-	return{ std::byte(std::forward<Ts>(args))... };
+	this->load(rom);
 }
 
-Chip8ReferenceVm::Chip8ReferenceVm(const std::span<std::byte>& rom) :
-	random(rd()),
-	pc(ram.cbegin() + 0x200),
-	i(ram.begin()),
-	timer_thread(&Chip8ReferenceVm::runTimers, std::ref(this->sound), std::ref(this->delay))
-{
+void Chip8ReferenceVm::load(const std::span<const std::byte> &rom) {
+	std::fill(this->ram.begin(), this->ram.end(), std::byte{ 0 });
+	std::copy(CHIP8_FONT.begin(), CHIP8_FONT.end(), this->ram.begin() + this->font_offset);
+	if (this->variant != Variant::Chip8) {
+		std::copy(CHIP8_BIG_FONT.begin(), CHIP8_BIG_FONT.end(), this->ram.begin() + this->big_font_offset);
+	}
 
-	auto font = make_bytes(
-		// 0
-		0b11110000,
-		0b10010000,
-		0b10010000,
-		0b10010000,
-		0b11110000,
-
-		// 1
-		0b00100000,
-		0b01100000,
-		0b00100000,
-		0b00100000,
-		0b01010000,
-
-		// 2
-		0b11110000,
-		0b00010000,
-		0b11110000,
-		0b10000000,
-		0b11110000,
-
-		// 3
-		0b11110000,
-		0b00010000,
-		0b11110000,
-		0b00010000,
-		0b11110000,
-
-		// 4
-		0b10010000,
-		0b10010000,
-		0b11110000,
-		0b00010000,
-		0b00010000,
-
-		// 5
-		0b11110000,
-		0b10000000,
-		0b11110000,
-		0b00010000,
-		0b11110000,
-
-		// 6
-		0b11110000,
-		0b10000000,
-		0b11110000,
-		0b10010000,
-		0b11110000,
-
-		// 7
-		0b11110000,
-		0b00010000,
-		0b00100000,
-		0b01000000,
-		0b01000000,
-
-		// 8
-		0b11110000,
-		0b10010000,
-		0b11110000,
-		0b10010000,
-		0b11110000,
-
-		// 9
-		0b11110000,
-		0b10010000,
-		0b11110000,
-		0b00010000,
-		0b11110000,
-
-		// A
-		0b11110000,
-		0b10010000,
-		0b11110000,
-		0b10010000,
-		0b10010000,
-
-		// B
-		0b11100000,
-		0b10010000,
-		0b11100000,
-		0b10010000,
-		0b11100000,
-
-		// C
-		0b11110000,
-		0b10000000,
-		0b10000000,
-		0b10000000,
-		0b11110000,
-
-		// D
-		0b11100000,
-		0b10010000,
-		0b10010000,
-		0b10010000,
-		0b11100000,
-
-		// E
-		0b11110000,
-		0b10000000,
-		0b11110000,
-		0b10000000,
-		0b11110000,
-
-		// F
-		0b11110000,
-		0b10000000,
-		0b11110000,
-		0b10000000,
-		0b10000000
-	);
-
-	std::move(font.begin(), font.end(), this->font_offset);
-
-	std::copy(rom.begin(), rom.end(), this->rom_offset);
+	auto rom_size = std::min<std::size_t>(rom.size(), this->ram.size() - this->rom_offset);
+	std::copy(rom.begin(), rom.begin() + rom_size, this->ram.begin() + this->rom_offset);
+	this->memory_pages.markDirty(0, this->ram.size());
+
+	std::fill(this->decoded_instructions.begin(), this->decoded_instructions.end(), DecodedInstruction{});
+	this->analysis = Chip8RomAnalysis(this->ram, { this->rom_offset, static_cast<uint16_t>(rom_size) }, this->variant != Variant::Chip8,
+		this->variant == Variant::XoChip);
+	for (const auto &block : this->analysis.getBlocks()) {
+		for (std::size_t offset = block.start; offset < block.end; ++offset) {
+			if (this->analysis.isInstruction(static_cast<uint16_t>(offset))) {
+				this->decoded_instructions[offset] = this->decodeAt(static_cast<Address>(offset));
+			}
+		}
+	}
+
+	this->cpu = {};
+	this->flags = {};
+	this->audio_pattern = {};
+	this->pitch = 64;
+	this->timers.reset();
+	this->display.assign(Display{});
+	this->keys = 0;
+	this->random = Chip8Random();
+	this->idle = false;
+	this->keypress_target_register = -1;
+
+#if CHIP8_PROFILER
+	this->profiler.reset();
+#endif
 
 	this->state = State::Running;
 }
@@ -147,232 +94,187 @@ constexpr inline auto hi_nybble(const std::byte& byte) {
 	return byte >> 4;
 }
 
-void Chip8ReferenceVm::step() {
-	if (!this->isRunning()) {
-		return;
-	}
+constexpr Chip8ReferenceVm::DecodedInstruction Chip8ReferenceVm::decode(const Instruction &instruction, Variant variant) {
+	const bool super_chip = variant != Variant::Chip8;
+	const bool xo_chip = variant == Variant::XoChip;
 
-	auto instruction = this->getInstruction();
+	DecodedInstruction decoded{
+		Opcode::Unsupported,
+		getShortValueLo(instruction.hi),
+		getShortValueHi(instruction.lo),
+		getValue(instruction.lo),
+		static_cast<uint16_t>(getLongValue(instruction.hi, instruction.lo))
+	};
 
 	switch (hi_nybble(instruction.hi))
 	{
 	case std::byte{ 0x0 }:
-		//0NNN Execute machine language subroutine at address NNN
-		switch (getLongValue(instruction.hi, instruction.lo))
+		switch (decoded.nnn)
 		{
 		case 0x000:
 			//0000 Is implemented in Octo as halt
-			//this->running = false;
+			decoded.op = Opcode::Halt;
 			break;
 
 		case 0x0E0:
-			//00E0 Clear the screen
-			this->display.fill(std::byte{ 0 });
+			decoded.op = Opcode::ClearScreen;
 			break;
 
 		case 0x0EE:
-			//00EE Return from a subroutine
-			this->doReturn();
+			decoded.op = Opcode::Return;
+			break;
+
+		case 0x0FB:
+			if (super_chip) {
+				decoded.op = Opcode::ScrollRight;
+			}
+			break;
+
+		case 0x0FC:
+			if (super_chip) {
+				decoded.op = Opcode::ScrollLeft;
+			}
+			break;
+
+		case 0x0FD:
+			if (super_chip) {
+				decoded.op = Opcode::Exit;
+			}
+			break;
+
+		case 0x0FE:
+			if (super_chip) {
+				decoded.op = Opcode::LowResolution;
+			}
+			break;
+
+		case 0x0FF:
+			if (super_chip) {
+				decoded.op = Opcode::HighResolution;
+			}
 			break;
 
 		default:
+			if (super_chip && (decoded.nnn & 0xFF0) == 0x0C0) {
+				decoded.op = Opcode::ScrollDown;
+			}
+			else if (xo_chip && (decoded.nnn & 0xFF0) == 0x0D0) {
+				decoded.op = Opcode::ScrollUp;
+			}
+			//0NNN Execute machine language subroutine at address NNN
 			// Unimplemented
 			break;
 		}
 		break;
 
-	case std::byte{ 0x1 }: {
-		//1NNN Jump to address NNN
-		this->jump(getLongValue(instruction.hi, instruction.lo));
+	case std::byte{ 0x1 }:
+		decoded.op = Opcode::Jump;
 		break;
-	}
 
-	case std::byte{ 0x2 }: {
-		//2NNN Execute subroutine starting at address NNN
-		this->call(getLongValue(instruction.hi, instruction.lo));
+	case std::byte{ 0x2 }:
+		decoded.op = Opcode::Call;
 		break;
-	}
 
-	case std::byte{ 0x3 }: {
-		auto x = getShortValueLo(instruction.hi);
-		//3XNN Skip the following instruction if the value of register VX equals NN
-		if (this->v.at(x) == instruction.lo) {
-			this->skip();
-		}
+	case std::byte{ 0x3 }:
+		decoded.op = Opcode::SkipIfEqualValue;
 		break;
-	}
 
-	case std::byte{ 0x4 }: {
-		auto x = getShortValueLo(instruction.hi);
-		//4XNN Skip the following instruction if the value of register VX is not equal to NN
-		if (this->v.at(x) != instruction.lo) {
-			this->skip();
-		}
+	case std::byte{ 0x4 }:
+		decoded.op = Opcode::SkipIfNotEqualValue;
 		break;
-	}
 
-	case std::byte{ 0x5 }: {
-		auto x = getShortValueLo(instruction.hi);
-		auto y = getShortValueHi(instruction.lo);
-		//5XY0 Skip the following instruction if the value of register VX is equal to the value of register VY
-		if (this->v.at(x) == this->v.at(y)) {
-			this->skip();
+	case std::byte{ 0x5 }:
+		decoded.op = Opcode::SkipIfEqualRegister;
+		if (xo_chip && lo_nybble(instruction.lo) == std::byte{ 0x2 }) {
+			decoded.op = Opcode::StoreRange;
+		}
+		else if (xo_chip && lo_nybble(instruction.lo) == std::byte{ 0x3 }) {
+			decoded.op = Opcode::LoadRange;
 		}
 		break;
-	}
 
-	case std::byte{ 0x6 }: {
-		auto x = getShortValueLo(instruction.hi);
-		//6XNN Store number NN in register VX
-		this->v.at(x) = instruction.lo;
+	case std::byte{ 0x6 }:
+		decoded.op = Opcode::SetValue;
 		break;
-	}
 
-	case std::byte{ 0x7 }: {
-		auto x = getShortValueLo(instruction.hi);
-		//7XNN Add the value NN to register VX
-		// NOTE: Overflows do not set VF
-		this->v.at(x) = static_cast<std::byte>(getValue(this->v.at(x)) + getValue(instruction.lo));
+	case std::byte{ 0x7 }:
+		decoded.op = Opcode::AddValue;
 		break;
-	}
 
-	case std::byte{ 0x8 }: {
-		auto x = getShortValueLo(instruction.hi);
-		auto y = getShortValueHi(instruction.lo);
+	case std::byte{ 0x8 }:
 		switch (lo_nybble(instruction.lo))
 		{
 		case std::byte{ 0x0 }:
-			//8XY0 Store the value of register VY in register VX
-			this->v.at(x) = this->v.at(y);
+			decoded.op = Opcode::SetRegister;
 			break;
 
 		case std::byte{ 0x1 }:
-			//8XY1 Set VX to VX OR VY
-			this->v.at(x) |= this->v.at(y);
+			decoded.op = Opcode::Or;
 			break;
 
 		case std::byte{ 0x2 }:
-			//8XY2 Set VX to VX AND VY
-			this->v.at(x) &= this->v.at(y);
+			decoded.op = Opcode::And;
 			break;
 
 		case std::byte{ 0x3 }:
-			//8XY3 Set VX to VX XOR VY
-			this->v.at(x) ^= this->v.at(y);
+			decoded.op = Opcode::Xor;
 			break;
 
-		case std::byte{ 0x4 }: {
-			//8XY4 Add the value of register VY to register VX
-			//     Set VF to 01 if a carry occurs
-			//     Set VF to 00 if a carry does not occur
-			auto wide_val = std::to_integer<LongValue>(this->v.at(x)) + std::to_integer<LongValue>(this->v.at(y));
-			this->v.at(x) = static_cast<std::byte>(wide_val);
-			this->v.at(0xF) = static_cast<std::byte>(wide_val >> 8);
+		case std::byte{ 0x4 }:
+			decoded.op = Opcode::Add;
 			break;
-		}
 
-		case std::byte{ 0x5 }: {
-			//8XY5 Subtract the value of register VY from register VX
-			//     Set VF to 00 if a borrow occurs
-			//     Set VF to 01 if a borrow does not occur
-			auto wide_val = (0x100 & std::to_integer<LongValue>(this->v.at(x))) - std::to_integer<LongValue>(this->v.at(y));
-			this->v.at(x) = static_cast<std::byte>(wide_val);
-			this->v.at(0xF) = static_cast<std::byte>(wide_val >> 8);
+		case std::byte{ 0x5 }:
+			decoded.op = Opcode::Subtract;
 			break;
-		}
 
-		case std::byte{ 0x6 }: {
-			//8XY6 Store the value of register VY shifted right one bit in register VX
-			//     Set register VF to the least significant bit prior to the shift
-			//     VY is unchanged
-			auto val = this->v.at(y);
-			this->v.at(x) = val >> 1;
-			this->v.at(0xF) = val & std::byte{ 0x1 };
+		case std::byte{ 0x6 }:
+			decoded.op = Opcode::ShiftRight;
 			break;
-		}
 
-		case std::byte{ 0x7 }: {
-			//8XY7 Set register VX to the value of VY minus VX
-			//     Set VF to 00 if a borrow occurs
-			//     Set VF to 01 if a borrow does not occur
-			auto wide_val = (0x100 & std::to_integer<LongValue>(this->v.at(y))) - std::to_integer<LongValue>(this->v.at(x));
-			this->v.at(x) = static_cast<std::byte>(wide_val);
-			this->v.at(0xF) = static_cast<std::byte>(wide_val >> 8);
+		case std::byte{ 0x7 }:
+			decoded.op = Opcode::SubtractReversed;
 			break;
-		}
 
-		case std::byte{ 0xE }: {
-			//8XYE Store the value of register VY shifted left one bit in register VX
-			//     Set register VF to the most significant bit prior to the shift
-			//     VY is unchanged
-			auto wide_val = std::to_integer<LongValue>(this->v.at(y)) << 1;
-			this->v.at(x) = static_cast<std::byte>(wide_val);
-			this->v.at(0xF) = static_cast<std::byte>(wide_val >> 8);
+		case std::byte{ 0xE }:
+			decoded.op = Opcode::ShiftLeft;
 			break;
-		}
 
 		default:
 			// Unsupported instruction
 			break;
 		}
 		break;
-	}
 
-	case std::byte{ 0x9 }: {
-		auto x = getShortValueLo(instruction.hi);
-		auto y = getShortValueHi(instruction.lo);
-		//9XY0 Skip the following instruction if the value of register VX is not equal to the value of register VY
-		if (this->v.at(x) != this->v.at(y)) {
-			this->skip();
-		}
+	case std::byte{ 0x9 }:
+		decoded.op = Opcode::SkipIfNotEqualRegister;
 		break;
-	}
 
-	case std::byte{ 0xA }: {
-		//ANNN Store memory address NNN in register I
-		this->setAddressRegister(getLongValue(instruction.hi, instruction.lo));
+	case std::byte{ 0xA }:
+		decoded.op = Opcode::SetAddress;
 		break;
-	}
 
 	case std::byte{ 0xB }:
-		//BNNN Jump to address NNN + V0
-		this->jump(getLongValue(instruction.hi, instruction.lo) + std::to_integer<LongValue>(this->v.at(0x0)));
+		decoded.op = Opcode::JumpOffset;
 		break;
 
-	case std::byte{ 0xC }: {
-		auto x = getShortValueLo(instruction.hi);
-		//CXNN Set VX to a random number with a mask of NN
-		this->v.at(x) = this->getRandomByte() & instruction.lo;
+	case std::byte{ 0xC }:
+		decoded.op = Opcode::Random;
 		break;
-	}
 
-	case std::byte{ 0xD }: {
-		auto x = getShortValueLo(instruction.hi);
-		auto y = getShortValueHi(instruction.lo);
-		//DXYN Draw a sprite at position VX, VY with N bytes of sprite data starting at the address stored in I
-		//     Set VF to 01 if any set pixels are changed to unset, and 00 otherwise
-		this->drawSprite(getValue(this->v.at(x)), getValue(this->v.at(y)), getShortValueLo(instruction.lo));
+	case std::byte{ 0xD }:
+		decoded.op = super_chip && lo_nybble(instruction.lo) == std::byte{ 0x0 } ? Opcode::DrawLarge : Opcode::Draw;
 		break;
-	}
-
-	case std::byte{ 0xE }: {
-		// Key operations based on the keycode stored in register VX
-		auto x = getValue(this->v.at(getShortValueLo(instruction.hi)));
 
+	case std::byte{ 0xE }:
 		switch (instruction.lo)
 		{
 		case std::byte{ 0x9E }:
-			//EX9E	Skip the following instruction if the key corresponding to the hex value currently stored in register VX is pressed
-			if (isKeyPressed(x)) {
-				this->skip();
-			}
+			decoded.op = Opcode::SkipIfKeyPressed;
 			break;
 
 		case std::byte{ 0xA1 }:
-			//EXA1	Skip the following instruction if the key corresponding to the hex value currently stored in register VX is not pressed
-			if (!isKeyPressed(x)) {
-				this->skip();
-			}
+			decoded.op = Opcode::SkipIfKeyNotPressed;
 			break;
 
 		default:
@@ -380,85 +282,686 @@ void Chip8ReferenceVm::step() {
 			break;
 		}
 		break;
-	}
-
-	case std::byte{ 0xF }: {
-		auto x = getShortValueLo(instruction.hi);
 
+	case std::byte{ 0xF }:
 		switch (instruction.lo)
 		{
+		case std::byte{ 0x00 }:
+			if (xo_chip && decoded.x == 0) {
+				decoded.op = Opcode::SetAddressLong;
+			}
+			break;
+
+		case std::byte{ 0x01 }:
+			if (xo_chip) {
+				decoded.op = Opcode::SelectPlanes;
+			}
+			break;
+
+		case std::byte{ 0x02 }:
+			if (xo_chip && decoded.x == 0) {
+				decoded.op = Opcode::LoadAudioPattern;
+			}
+			break;
+
 		case std::byte{ 0x07 }:
-			//FX07 Store the current value of the delay timer in register VX
-			this->v.at(x) = static_cast<std::byte>(this->delay.load());
+			decoded.op = Opcode::GetDelayTimer;
 			break;
 
 		case std::byte{ 0x0A }:
-			//FX0A Wait for a keypress and store the result in register VX
-			this->keypress_target_register = x;
-			this->state = State::Blocked;
-			// The emulator will return immediately for any further calls to step() until a key is received.
+			decoded.op = Opcode::WaitForKey;
 			break;
 
 		case std::byte{ 0x15 }:
-			//FX15 Set the delay timer to the value of register VX
-			this->delay = static_cast<Timer>(this->v.at(x));
+			decoded.op = Opcode::SetDelayTimer;
 			break;
 
 		case std::byte{ 0x18 }:
-			//FX18 Set the sound timer to the value of register VX
-			this->sound = static_cast<Timer>(this->v.at(x));
+			decoded.op = Opcode::SetSoundTimer;
 			break;
 
 		case std::byte{ 0x1E }:
-			//FX1E Add the value stored in register VX to register I
-			this->incrementAddressRegister(getValue(this->v.at(x)));
+			decoded.op = Opcode::AddAddress;
 			break;
 
 		case std::byte{ 0x29 }:
-			//FX29 Set I to the memory address of the sprite data corresponding to the hexadecimal digit stored in register VX
-			this->setAddressRegister(this->font_offset + 5 * std::to_integer<ptrdiff_t>(this->v.at(x) & std::byte(0xF)));
+			decoded.op = Opcode::SetAddressToFont;
 			break;
 
-		case std::byte{ 0x33 }: {
-			//FX33 Store the binary - coded decimal equivalent of the value stored in register VX at addresses I, I + 1, and I + 2
-			auto val = getValue(this->v.at(x));
-			*this->i = std::byte(val / 100 % 10);
-			*(this->i + 1) = std::byte(val / 10 % 10);
-			*(this->i + 2) = std::byte(val % 10);
+		case std::byte{ 0x30 }:
+			if (super_chip) {
+				decoded.op = Opcode::SetAddressToBigFont;
+			}
+			break;
+
+		case std::byte{ 0x33 }:
+			decoded.op = Opcode::StoreBcd;
+			break;
+
+		case std::byte{ 0x3A }:
+			if (xo_chip) {
+				decoded.op = Opcode::SetPitch;
+			}
 			break;
-		}
 
 		case std::byte{ 0x55 }:
-			//FX55 Store the values of registers V0 to VX inclusive in memory starting at address I
-			//     I is set to I + X + 1 after operation
-			std::copy(this->v.cbegin(), this->v.cbegin() + x + 1, this->i);
-			this->incrementAddressRegister(x + 1);
+			decoded.op = Opcode::StoreRegisters;
 			break;
 
-		case std::byte{ 0x65 }: {
-			//FX65 Fill registers V0 to VX inclusive with the values stored in memory starting at address I
-			//     I is set to I + X + 1 after operation
-			const auto start_i = this->i;
-			this->incrementAddressRegister(x + 1);
-			std::copy(start_i, this->i, this->v.begin());
+		case std::byte{ 0x65 }:
+			decoded.op = Opcode::LoadRegisters;
+			break;
+
+		case std::byte{ 0x75 }:
+			if (super_chip) {
+				decoded.op = Opcode::StoreFlags;
+			}
+			break;
+
+		case std::byte{ 0x85 }:
+			if (super_chip) {
+				decoded.op = Opcode::LoadFlags;
+			}
 			break;
-		}
 
 		default:
 			// Unsupported instruction
 			break;
 		}
 		break;
-	}
 
 	default:
 		// Unreachable
 		break;
 	}
+
+	return decoded;
+}
+
+constexpr Chip8ReferenceVm::Opcode Chip8ReferenceVm::unfuse(Opcode op) {
+	switch (op)
+	{
+	case Opcode::SetValueSetAddressDraw:
+		return Opcode::SetValue;
+
+	case Opcode::AddValueSkipJump:
+		return Opcode::AddValue;
+
+	case Opcode::GetDelayTimerSkipJump:
+		return Opcode::GetDelayTimer;
+
+	default:
+		return op;
+	}
+}
+
+constexpr const char *Chip8ReferenceVm::getFusionName(Opcode op) {
+	switch (op)
+	{
+	case Opcode::SetValueSetAddressDraw:
+		return "6XNN ANNN DXYN";
+
+	case Opcode::AddValueSkipJump:
+		return "7XNN 3XNN 1NNN";
+
+	case Opcode::GetDelayTimerSkipJump:
+		return "FX07 3XNN 1NNN";
+
+	default:
+		return nullptr;
+	}
+}
+
+Chip8ReferenceVm::DecodedInstruction Chip8ReferenceVm::decodeAt(Address offset) {
+	auto decoded = decode({ this->ram[offset], this->ram[(offset + 1) & this->address_mask] }, this->variant);
+	if (offset + FUSED_LENGTH > this->ram.size() ||
+		(decoded.op != Opcode::SetValue && decoded.op != Opcode::AddValue && decoded.op != Opcode::GetDelayTimer)) {
+		return decoded;
+	}
+
+	// Fused handlers read the other two instructions from their slots, so they have to be decoded as well. Neither can start a sequence of its own.
+	auto &second = this->decoded_instructions[offset + 2];
+	if (second.op == Opcode::Undecoded) {
+		second = decode({ this->ram[offset + 2], this->ram[offset + 3] }, this->variant);
+	}
+	auto &third = this->decoded_instructions[offset + 4];
+	if (third.op == Opcode::Undecoded) {
+		third = decode({ this->ram[offset + 4], this->ram[offset + 5] }, this->variant);
+	}
+
+	if (decoded.op == Opcode::SetValue && second.op == Opcode::SetAddress && third.op == Opcode::Draw) {
+		decoded.op = Opcode::SetValueSetAddressDraw;
+	}
+	else if (decoded.op == Opcode::AddValue && second.op == Opcode::SkipIfEqualValue && third.op == Opcode::Jump) {
+		decoded.op = Opcode::AddValueSkipJump;
+	}
+	else if (decoded.op == Opcode::GetDelayTimer && second.op == Opcode::SkipIfEqualValue && third.op == Opcode::Jump) {
+		decoded.op = Opcode::GetDelayTimerSkipJump;
+	}
+	return decoded;
+}
+
+void Chip8ReferenceVm::step() {
+	(this->*step_function)(1);
+
+	// Only run() and doFrame() skip idle loops, a later call to either must not act on a loop step() found
+	this->idle = false;
+}
+
+template<Chip8Platform quirks_platform>
+unsigned long Chip8ReferenceVm::execute(unsigned long budget) {
+	constexpr auto quirks = Chip8Quirks::forPlatform(quirks_platform);
+
+	if (!this->isRunning()) {
+		return 0;
+	}
+
+	const auto offset = this->cpu.pc;
+	if (offset + 1 >= std::ssize(this->ram) && !this->wrapsAround()) {
+		// Not enough memory left to hold a full instruction
+		this->getInstruction();
+		this->timers.advance(1);
+		return 1;
+	}
+
+#if CHIP8_PROFILER
+	// Samples are attributed to the instruction and call stack as they were before executing it
+	const auto profile_start = Chip8Profiler::now();
+	const auto profile_instruction = static_cast<uint16_t>(std::to_integer<uint16_t>(this->ram[offset]) << 8 | std::to_integer<uint16_t>(this->ram[(offset + 1) & this->address_mask]));
+	this->profiled_stack.clear();
+	for (uint_fast8_t frame = 0; frame < this->cpu.stack_depth; ++frame) {
+		// The call that pushed this return address sits just before it
+		auto return_address = this->cpu.call_stack[frame];
+		this->profiled_stack.push_back(static_cast<uint16_t>(getLongValue(this->ram[(return_address - 2) & this->address_mask], this->ram[(return_address - 1) & this->address_mask])));
+	}
+#endif
+
+	auto &cached = this->decoded_instructions[offset];
+	if (cached.op == Opcode::Undecoded) {
+		cached = this->decodeAt(offset);
+	}
+	auto instruction = cached;
+	if (budget < FUSED_LENGTH / 2) {
+		instruction.op = unfuse(instruction.op);
+	}
+	this->cpu.pc += 2;
+	unsigned long executed = 1;
+
+	const auto x = instruction.x;
+	const auto y = instruction.y;
+
+	switch (instruction.op)
+	{
+	case Opcode::Halt:
+		//0000 Halt (Octo), ignored elsewhere
+		if constexpr (quirks.halt_on_zero) {
+			this->state = State::Halted;
+		}
+		break;
+
+	case Opcode::ClearScreen:
+		//00E0 Clear the screen
+		this->display.clear();
+		break;
+
+	case Opcode::Return:
+		//00EE Return from a subroutine
+		this->doReturn();
+		break;
+
+	case Opcode::Jump:
+		//1NNN Jump to address NNN
+		this->jump(instruction.nnn);
+		break;
+
+	case Opcode::Call:
+		//2NNN Execute subroutine starting at address NNN
+		this->call(instruction.nnn);
+		break;
+
+	case Opcode::SkipIfEqualValue:
+		//3XNN Skip the following instruction if the value of register VX equals NN
+		if (getValue(this->cpu.v[x]) == instruction.nn) {
+			this->skip();
+		}
+		break;
+
+	case Opcode::SkipIfNotEqualValue:
+		//4XNN Skip the following instruction if the value of register VX is not equal to NN
+		if (getValue(this->cpu.v[x]) != instruction.nn) {
+			this->skip();
+		}
+		break;
+
+	case Opcode::SkipIfEqualRegister:
+		//5XY0 Skip the following instruction if the value of register VX is equal to the value of register VY
+		if (this->cpu.v[x] == this->cpu.v[y]) {
+			this->skip();
+		}
+		break;
+
+	case Opcode::SetValue:
+		//6XNN Store number NN in register VX
+		this->cpu.v[x] = std::byte(instruction.nn);
+		break;
+
+	case Opcode::AddValue:
+		//7XNN Add the value NN to register VX
+		// NOTE: Overflows do not set VF
+		this->cpu.v[x] = static_cast<std::byte>(getValue(this->cpu.v[x]) + instruction.nn);
+		break;
+
+	case Opcode::SetRegister:
+		//8XY0 Store the value of register VY in register VX
+		this->cpu.v[x] = this->cpu.v[y];
+		break;
+
+	case Opcode::Or:
+		//8XY1 Set VX to VX OR VY
+		this->cpu.v[x] |= this->cpu.v[y];
+		break;
+
+	case Opcode::And:
+		//8XY2 Set VX to VX AND VY
+		this->cpu.v[x] &= this->cpu.v[y];
+		break;
+
+	case Opcode::Xor:
+		//8XY3 Set VX to VX XOR VY
+		this->cpu.v[x] ^= this->cpu.v[y];
+		break;
+
+	case Opcode::Add: {
+		//8XY4 Add the value of register VY to register VX
+		//     Set VF to 01 if a carry occurs
+		//     Set VF to 00 if a carry does not occur
+		auto wide_val = std::to_integer<LongValue>(this->cpu.v[x]) + std::to_integer<LongValue>(this->cpu.v[y]);
+		this->cpu.v[x] = static_cast<std::byte>(wide_val);
+		this->cpu.v[0xF] = static_cast<std::byte>(wide_val >> 8);
+		break;
+	}
+
+	case Opcode::Subtract: {
+		//8XY5 Subtract the value of register VY from register VX
+		//     Set VF to 00 if a borrow occurs
+		//     Set VF to 01 if a borrow does not occur
+		auto wide_val = (0x100 | std::to_integer<LongValue>(this->cpu.v[x])) - std::to_integer<LongValue>(this->cpu.v[y]);
+		this->cpu.v[x] = static_cast<std::byte>(wide_val);
+		this->cpu.v[0xF] = static_cast<std::byte>(wide_val >> 8);
+		break;
+	}
+
+	case Opcode::ShiftRight: {
+		//8XY6 Store the value of register VY shifted right one bit in register VX
+		//     Set register VF to the least significant bit prior to the shift
+		//     VY is unchanged
+		//     CHIP-48 and SUPER-CHIP shift VX in place instead
+		auto val = this->cpu.v[quirks.shift_uses_vy ? y : x];
+		this->cpu.v[x] = val >> 1;
+		this->cpu.v[0xF] = val & std::byte{ 0x1 };
+		break;
+	}
+
+	case Opcode::SubtractReversed: {
+		//8XY7 Set register VX to the value of VY minus VX
+		//     Set VF to 00 if a borrow occurs
+		//     Set VF to 01 if a borrow does not occur
+		auto wide_val = (0x100 | std::to_integer<LongValue>(this->cpu.v[y])) - std::to_integer<LongValue>(this->cpu.v[x]);
+		this->cpu.v[x] = static_cast<std::byte>(wide_val);
+		this->cpu.v[0xF] = static_cast<std::byte>(wide_val >> 8);
+		break;
+	}
+
+	case Opcode::ShiftLeft: {
+		//8XYE Store the value of register VY shifted left one bit in register VX
+		//     Set register VF to the most significant bit prior to the shift
+		//     VY is unchanged
+		//     CHIP-48 and SUPER-CHIP shift VX in place instead
+		auto wide_val = std::to_integer<LongValue>(this->cpu.v[quirks.shift_uses_vy ? y : x]) << 1;
+		this->cpu.v[x] = static_cast<std::byte>(wide_val);
+		this->cpu.v[0xF] = static_cast<std::byte>(wide_val >> 8);
+		break;
+	}
+
+	case Opcode::SkipIfNotEqualRegister:
+		//9XY0 Skip the following instruction if the value of register VX is not equal to the value of register VY
+		if (this->cpu.v[x] != this->cpu.v[y]) {
+			this->skip();
+		}
+		break;
+
+	case Opcode::SetAddress:
+		//ANNN Store memory address NNN in register I
+		this->setAddressRegister(LongValue{ instruction.nnn });
+		break;
+
+	case Opcode::JumpOffset:
+		//BNNN Jump to address NNN + V0
+		//     CHIP-48 and SUPER-CHIP add VX instead, where X is the high nybble of NNN
+		this->jump(instruction.nnn + std::to_integer<LongValue>(this->cpu.v[quirks.jump_uses_vx ? x : 0x0]));
+		break;
+
+	case Opcode::Random:
+		//CXNN Set VX to a random number with a mask of NN
+		this->cpu.v[x] = this->getRandomByte() & std::byte(instruction.nn);
+		break;
+
+	case Opcode::Draw:
+		//DXYN Draw a sprite at position VX, VY with N bytes of sprite data starting at the address stored in I
+		//     Set VF to 01 if any set pixels are changed to unset, and 00 otherwise
+		this->drawSprite(getValue(this->cpu.v[x]), getValue(this->cpu.v[y]), instruction.nn & 0xF, quirks.wrap_sprites);
+		break;
+
+	case Opcode::SkipIfKeyPressed:
+		//EX9E	Skip the following instruction if the key corresponding to the hex value currently stored in register VX is pressed
+		if (isKeyPressed(getValue(this->cpu.v[x]))) {
+			this->skip();
+		}
+		break;
+
+	case Opcode::SkipIfKeyNotPressed:
+		//EXA1	Skip the following instruction if the key corresponding to the hex value currently stored in register VX is not pressed
+		if (!isKeyPressed(getValue(this->cpu.v[x]))) {
+			this->skip();
+		}
+		break;
+
+	case Opcode::GetDelayTimer:
+		//FX07 Store the current value of the delay timer in register VX
+		this->cpu.v[x] = static_cast<std::byte>(this->timers.delay);
+		this->idle = this->timers.delay > 0 && this->isIdleLoop(offset);
+		break;
+
+	case Opcode::WaitForKey:
+		//FX0A Wait for a keypress and store the result in register VX
+		this->keypress_target_register = x;
+		this->state = State::Blocked;
+		// The emulator will return immediately for any further calls to step() until a key is received.
+		break;
+
+	case Opcode::SetDelayTimer:
+		//FX15 Set the delay timer to the value of register VX
+		this->timers.delay = static_cast<Timer>(this->cpu.v[x]);
+		break;
+
+	case Opcode::SetSoundTimer:
+		//FX18 Set the sound timer to the value of register VX
+		this->timers.sound = static_cast<Timer>(this->cpu.v[x]);
+		break;
+
+	case Opcode::AddAddress:
+		//FX1E Add the value stored in register VX to register I
+		this->incrementAddressRegister(getValue(this->cpu.v[x]));
+		break;
+
+	case Opcode::SetAddressToFont:
+		//FX29 Set I to the memory address of the sprite data corresponding to the hexadecimal digit stored in register VX
+		this->setAddressRegister(LongValue{ this->font_offset + 5 * std::to_integer<LongValue>(this->cpu.v[x] & std::byte(0xF)) });
+		break;
+
+	case Opcode::StoreBcd: {
+		//FX33 Store the binary - coded decimal equivalent of the value stored in register VX at addresses I, I + 1, and I + 2
+		auto val = getValue(this->cpu.v[x]);
+		this->invalidateDecodedInstructions(this->cpu.i, 3);
+		this->ram[this->cpu.i & this->address_mask] = std::byte(val / 100 % 10);
+		this->ram[(this->cpu.i + 1) & this->address_mask] = std::byte(val / 10 % 10);
+		this->ram[(this->cpu.i + 2) & this->address_mask] = std::byte(val % 10);
+		break;
+	}
+
+	case Opcode::StoreRegisters:
+		//FX55 Store the values of registers V0 to VX inclusive in memory starting at address I
+		//     I is set to I + X + 1 after operation (I + X on CHIP-48, unchanged on SUPER-CHIP)
+		this->invalidateDecodedInstructions(this->cpu.i, x + 1);
+		for (uint_fast8_t r = 0; r <= x; ++r) {
+			this->ram[(this->cpu.i + r) & this->address_mask] = this->cpu.v[r];
+		}
+		if constexpr (quirks.load_store_increment != Chip8Quirks::IndexIncrement::None) {
+			this->incrementAddressRegister(quirks.load_store_increment == Chip8Quirks::IndexIncrement::X ? x : x + 1);
+		}
+		break;
+
+	case Opcode::LoadRegisters: {
+		//FX65 Fill registers V0 to VX inclusive with the values stored in memory starting at address I
+		//     I is set to I + X + 1 after operation (I + X on CHIP-48, unchanged on SUPER-CHIP)
+		for (uint_fast8_t r = 0; r <= x; ++r) {
+			this->cpu.v[r] = this->ram[(this->cpu.i + r) & this->address_mask];
+		}
+		if constexpr (quirks.load_store_increment != Chip8Quirks::IndexIncrement::None) {
+			this->incrementAddressRegister(quirks.load_store_increment == Chip8Quirks::IndexIncrement::X ? x : x + 1);
+		}
+		break;
+	}
+
+	case Opcode::ScrollDown:
+		//00CN Scroll the display down by N lines
+		this->display.scrollDown(instruction.nn & 0xF);
+		break;
+
+	case Opcode::ScrollRight:
+		//00FB Scroll the display right by 4 pixels
+		this->display.scrollRight(4);
+		break;
+
+	case Opcode::ScrollLeft:
+		//00FC Scroll the display left by 4 pixels
+		this->display.scrollLeft(4);
+		break;
+
+	case Opcode::Exit:
+		//00FD Exit the interpreter
+		this->state = State::Halted;
+		break;
+
+	case Opcode::LowResolution:
+		//00FE Switch to the 64x32 display
+		this->display.setHires(false);
+		break;
+
+	case Opcode::HighResolution:
+		//00FF Switch to the 128x64 display
+		this->display.setHires(true);
+		break;
+
+	case Opcode::DrawLarge:
+		//DXY0 Draw a 16x16 sprite at position VX, VY with 32 bytes of sprite data (per selected plane) starting at the address stored in I
+		//     Set VF to 01 if any set pixels are changed to unset, and 00 otherwise
+		this->drawSprite(getValue(this->cpu.v[x]), getValue(this->cpu.v[y]), 16, quirks.wrap_sprites, true);
+		break;
+
+	case Opcode::SetAddressToBigFont:
+		//FX30 Set I to the memory address of the large (8x10) sprite data corresponding to the hexadecimal digit stored in register VX
+		this->setAddressRegister(LongValue{ this->big_font_offset + 10 * std::to_integer<LongValue>(this->cpu.v[x] & std::byte(0xF)) });
+		break;
+
+	case Opcode::StoreFlags: {
+		//FX75 Store the values of registers V0 to VX inclusive in the user flags
+		auto count = std::min<std::size_t>(x + 1, this->variant == Variant::SuperChip ? 8 : this->flags.size());
+		std::copy_n(this->cpu.v.begin(), count, this->flags.begin());
+		break;
+	}
+
+	case Opcode::LoadFlags: {
+		//FX85 Fill registers V0 to VX inclusive with the values stored in the user flags
+		auto count = std::min<std::size_t>(x + 1, this->variant == Variant::SuperChip ? 8 : this->flags.size());
+		std::copy_n(this->flags.begin(), count, this->cpu.v.begin());
+		break;
+	}
+
+	case Opcode::ScrollUp:
+		//00DN Scroll the display up by N lines
+		this->display.scrollUp(instruction.nn & 0xF);
+		break;
+
+	case Opcode::StoreRange: {
+		//5XY2 Store the values of registers VX to VY inclusive (in either order) in memory starting at address I
+		//     I is not changed
+		auto count = x < y ? y - x + 1 : x - y + 1;
+		int direction = x < y ? 1 : -1;
+		this->invalidateDecodedInstructions(this->cpu.i, count);
+		for (int r = 0; r < count; ++r) {
+			this->ram[(this->cpu.i + r) & this->address_mask] = this->cpu.v[x + r * direction];
+		}
+		break;
+	}
+
+	case Opcode::LoadRange: {
+		//5XY3 Fill registers VX to VY inclusive (in either order) with the values stored in memory starting at address I
+		//     I is not changed
+		auto count = x < y ? y - x + 1 : x - y + 1;
+		int direction = x < y ? 1 : -1;
+		for (int r = 0; r < count; ++r) {
+			this->cpu.v[x + r * direction] = this->ram[(this->cpu.i + r) & this->address_mask];
+		}
+		break;
+	}
+
+	case Opcode::SetAddressLong:
+		//F000 NNNN Set I to the 16 bit address NNNN stored in the following two bytes
+		this->cpu.i = static_cast<Address>(std::to_integer<Address>(this->ram[this->cpu.pc & this->address_mask]) << 8 | std::to_integer<Address>(this->ram[(this->cpu.pc + 1) & this->address_mask]));
+		this->cpu.pc += 2;
+		break;
+
+	case Opcode::SelectPlanes:
+		//FN01 Select the bit-planes drawn to, cleared and scrolled, N is a bit mask
+		this->display.selectPlanes(x);
+		break;
+
+	case Opcode::LoadAudioPattern:
+		//F002 Load the 16 byte audio pattern starting at the address stored in I
+		for (std::size_t offset = 0; offset < this->audio_pattern.size(); ++offset) {
+			this->audio_pattern[offset] = this->ram[(this->cpu.i + offset) & this->address_mask];
+		}
+		break;
+
+	case Opcode::SetPitch:
+		//FX3A Set the audio pitch to the value of register VX
+		this->pitch = getValue(this->cpu.v[x]);
+		break;
+
+	case Opcode::SetValueSetAddressDraw: {
+		//6XNN ANNN DXYN
+		const auto &draw = this->decoded_instructions[offset + 4];
+		this->cpu.v[x] = std::byte(instruction.nn);
+		this->setAddressRegister(LongValue{ this->decoded_instructions[offset + 2].nnn });
+		this->drawSprite(getValue(this->cpu.v[draw.x]), getValue(this->cpu.v[draw.y]), draw.nn & 0xF, quirks.wrap_sprites);
+		this->cpu.pc = static_cast<Address>(offset + FUSED_LENGTH);
+		executed = 3;
+		break;
+	}
+
+	case Opcode::AddValueSkipJump: {
+		//7XNN 3XNN 1NNN
+		const auto &skip = this->decoded_instructions[offset + 2];
+		this->cpu.v[x] = static_cast<std::byte>(getValue(this->cpu.v[x]) + instruction.nn);
+		if (getValue(this->cpu.v[skip.x]) == skip.nn) {
+			this->cpu.pc = static_cast<Address>(offset + FUSED_LENGTH);
+			executed = 2;
+		}
+		else {
+			this->jump(this->decoded_instructions[offset + 4].nnn);
+			executed = 3;
+		}
+		break;
+	}
+
+	case Opcode::GetDelayTimerSkipJump: {
+		//FX07 3XNN 1NNN
+		this->cpu.v[x] = static_cast<std::byte>(this->timers.delay);
+		this->idle = this->timers.delay > 0 && this->isIdleLoop(offset);
+		if (this->idle) {
+			// Stop after the FX07 like an unfused one, run() and doFrame() skip through the loop from there
+			break;
+		}
+
+		const auto &skip = this->decoded_instructions[offset + 2];
+		if (getValue(this->cpu.v[skip.x]) == skip.nn) {
+			this->cpu.pc = static_cast<Address>(offset + FUSED_LENGTH);
+			executed = 2;
+		}
+		else {
+			this->jump(this->decoded_instructions[offset + 4].nnn);
+			executed = 3;
+		}
+		break;
+	}
+
+	default:
+		// Unsupported instruction
+		break;
+	}
+
+#if CHIP8_PROFILER
+	// A superinstruction's time is split evenly between the instructions it executed
+	const auto profile_cycles = Chip8Profiler::now() - profile_start;
+	if (executed > 1) {
+		this->profiler.recordFusion(getFusionName(instruction.op), profile_cycles);
+	}
+	for (unsigned long component = 0; component < executed; ++component) {
+		const auto address = static_cast<uint16_t>(offset + component * 2);
+		const auto value = component == 0 ? profile_instruction : static_cast<uint16_t>(std::to_integer<uint16_t>(this->ram[address]) << 8 | std::to_integer<uint16_t>(this->ram[address + 1]));
+		this->profiler.record(value, address, this->profiled_stack, profile_cycles / executed + (component == 0 ? profile_cycles % executed : 0));
+	}
+#endif
+
+	for (unsigned long component = 0; component < executed; ++component) {
+		this->timers.advance(1);
+	}
+	return executed;
+}
+
+void Chip8ReferenceVm::invalidateDecodedInstructions(Address first, std::size_t count) {
+	this->memory_pages.markDirty(first & this->address_mask, count);
+
+	// An instruction starting on the byte before the write also reads the first written byte, a superinstruction up to 5 bytes before
+	for (std::ptrdiff_t offset = 1 - static_cast<std::ptrdiff_t>(FUSED_LENGTH); offset < -1; ++offset) {
+		auto &decoded = this->decoded_instructions[(first + offset) & this->address_mask];
+		if (getFusionName(decoded.op) != nullptr) {
+			decoded = DecodedInstruction{};
+		}
+	}
+	for (std::ptrdiff_t offset = -1; offset < static_cast<std::ptrdiff_t>(count); ++offset) {
+		this->decoded_instructions[(first + offset) & this->address_mask] = DecodedInstruction{};
+	}
+}
+
+bool Chip8ReferenceVm::wrapsAround() const {
+	return this->address_mask == std::numeric_limits<Address>::max();
+}
+
+bool Chip8ReferenceVm::isIdleLoop(std::ptrdiff_t offset) const {
+	// 1NNN can only jump back to a loop in the first 4 KiB
+	if (offset > 0xFFF || offset + 5 >= std::ssize(this->ram)) {
+		return false;
+	}
+
+	auto x = this->ram[offset] & std::byte{ 0x0F };
+	auto target = static_cast<uint16_t>(offset);
+	return this->ram[offset + 1] == std::byte{ 0x07 } &&
+		this->ram[offset + 2] == (std::byte{ 0x30 } | x) && this->ram[offset + 3] == std::byte{ 0x00 } &&
+		this->ram[offset + 4] == std::byte(0x10 | target >> 8) && this->ram[offset + 5] == std::byte(target & 0xFF);
+}
+
+unsigned long Chip8ReferenceVm::skipIdleLoop(unsigned long budget) {
+	this->idle = false;
+
+	// Timers clocked by instructions tick partway through the skipped passes, timers following the clock only change between calls to doFrame()/run()
+	if (auto until_tick = this->timers.instructionsUntilTick(); until_tick != 0) {
+		budget = std::min(budget, until_tick);
+	}
+
+	// pc is just past the FX07, each pass runs the skip, the jump and the FX07 again
+	constexpr unsigned long LOOP_LENGTH = 3;
+	auto skipped = budget / LOOP_LENGTH * LOOP_LENGTH;
+	if (skipped > 0) {
+		this->timers.advance(skipped);
+	}
+	return skipped;
 }
 
 bool Chip8ReferenceVm::isKeyPressed(const uint_fast8_t& x) const {
-	return this->keys.test(x);
+	// VX can hold any value, only 0-F name a key
+	return x < this->keys.size() && this->keys.test(x);
 }
 
 constexpr uint_fast8_t NO_KEY = -1;
@@ -466,7 +969,7 @@ void Chip8ReferenceVm::setKeyState(uint_fast8_t key, bool pressed) {
 	if (pressed) {
 		if (this->keypress_target_register != NO_KEY) {
 			// set key register to value. It is not defined what should happen if multiple keys are being held when a wait for keypress instruction is executed, this will use whatever the input device handler happens to give us first.
-			this->v.at(this->keypress_target_register) = std::byte(key);
+			this->cpu.v[this->keypress_target_register] = std::byte(key);
 			this->keypress_target_register = NO_KEY;
 			this->state = State::Running;
 		}
@@ -483,43 +986,177 @@ void Chip8ReferenceVm::clearKeyState() {
 
 unsigned long Chip8ReferenceVm::doFrame() {
 	unsigned long instructions_executed = 0;
+	unsigned long until_clock_check = this->clock_check_interval;
 
 	auto start_time = std::chrono::steady_clock::now();
+	this->timers.synchronise();
 
 	while (this->isRunning() &&
 		(this->frame_limit == 0 || instructions_executed < this->frame_limit)) {
-		this->step();
-		++instructions_executed;
+		instructions_executed += (this->*step_function)(this->frame_limit == 0 ? std::numeric_limits<unsigned long>::max() : this->frame_limit - instructions_executed);
+
+		if (this->idle) {
+			if (this->frame_limit == 0 && this->timers.instructionsUntilTick() == 0) {
+				// Nothing changes until the timers tick. In realtime mode that's at the start of the next frame, sleep through the rest of this one instead
+				// of spinning, in frame mode it's the end of this one.
+				this->idle = false;
+				if (this->timers.getMode() == Chip8Timers::Mode::Realtime) {
+					std::this_thread::sleep_until(start_time + Chip8Timers::tick_interval);
+				}
+				break;
+			}
 
-		auto time_elapsed = std::chrono::steady_clock::now() - start_time;
+			instructions_executed += this->skipIdleLoop(this->frame_limit == 0 ? std::numeric_limits<unsigned long>::max() : this->frame_limit - instructions_executed);
+		}
 
-		if (time_elapsed >= this->tick_interval && instructions_executed > 0) {
-			break;
+		if (--until_clock_check == 0) {
+			until_clock_check = this->clock_check_interval;
+			if (std::chrono::steady_clock::now() - start_time >= Chip8Timers::tick_interval) {
+				break;
+			}
 		}
 	}
 
+	this->timers.endFrame();
 	return instructions_executed;
 }
 
+unsigned long Chip8ReferenceVm::run(unsigned long instructions) {
+	unsigned long instructions_executed = 0;
+
+	this->timers.synchronise();
+	while (this->isRunning() && instructions_executed < instructions) {
+		instructions_executed += (this->*step_function)(instructions - instructions_executed);
+
+		if (this->idle) {
+			instructions_executed += this->skipIdleLoop(instructions - instructions_executed);
+		}
+	}
+
+	return instructions_executed;
+}
+
+void Chip8ReferenceVm::seed(uint32_t seed) {
+	this->random.seed(seed);
+}
+
+Chip8ReferenceVm::Variant Chip8ReferenceVm::getVariant() const {
+	return this->variant;
+}
+
+Chip8Platform Chip8ReferenceVm::getPlatform() const {
+	return this->platform;
+}
+
 void Chip8ReferenceVm::setEmulationSpeed(unsigned long target_speed) {
 	this->frame_limit = target_speed;
 }
 
+const Chip8RomAnalysis &Chip8ReferenceVm::getAnalysis() const {
+	return this->analysis;
+}
+
 const Chip8ReferenceVm::Display& Chip8ReferenceVm::getDisplayBuffer() const {
 	return this->display;
 }
 
+std::vector<Chip8ReferenceVm::Display::DirtyRegion> Chip8ReferenceVm::getDirtyRegions() const {
+	return this->display.getDirtyRegions();
+}
+
+void Chip8ReferenceVm::clearDirty() {
+	this->display.clearDirty();
+}
+
 const Chip8ReferenceVm::Timer Chip8ReferenceVm::getSoundTimer() const {
-	return this->sound;
+	return this->timers.sound;
+}
+
+void Chip8ReferenceVm::setTimerMode(TimerMode mode, unsigned long instructions_per_tick) {
+	this->timers.setMode(mode, instructions_per_tick);
+}
+
+std::array<uint8_t, 16> Chip8ReferenceVm::getRegisters() const {
+	std::array<uint8_t, 16> registers;
+	std::transform(this->cpu.v.cbegin(), this->cpu.v.cend(), registers.begin(), getValue);
+	return registers;
 }
 
+uint_fast16_t Chip8ReferenceVm::getProgramCounter() const {
+	return this->cpu.pc;
+}
+
+uint_fast16_t Chip8ReferenceVm::getAddressRegister() const {
+	return this->cpu.i;
+}
+
+std::array<uint16_t, 16> Chip8ReferenceVm::getCallStack() const {
+	std::array<uint16_t, 16> call_stack{};
+	std::copy_n(this->cpu.call_stack.cbegin(), this->cpu.stack_depth, call_stack.begin());
+	return call_stack;
+}
+
+uint_fast8_t Chip8ReferenceVm::getStackDepth() const {
+	return this->cpu.stack_depth;
+}
+
+Chip8ReferenceVm::Snapshot Chip8ReferenceVm::snapshot() {
+	return {
+		this->memory_pages.capture(this->ram),
+		this->cpu,
+		this->flags,
+		this->audio_pattern,
+		this->pitch,
+		this->timers,
+		this->display,
+		this->keys,
+		this->random,
+		this->state,
+		this->keypress_target_register
+	};
+}
+
+void Chip8ReferenceVm::restore(const Snapshot &snapshot) {
+	auto changed = this->memory_pages.restore(this->ram, snapshot.ram);
+	for (std::size_t page = 0; page < this->memory_pages.getPageCount(); ++page) {
+		if (changed.test(page)) {
+			// An instruction starting on the byte before the page also reads its first byte, a superinstruction up to 5 bytes before
+			auto begin = std::max<std::ptrdiff_t>(page * Chip8MemoryPages::PAGE_SIZE - (FUSED_LENGTH - 1), 0);
+			auto end = (page + 1) * Chip8MemoryPages::PAGE_SIZE;
+			std::fill(this->decoded_instructions.begin() + begin, this->decoded_instructions.begin() + end, DecodedInstruction{});
+		}
+	}
+	if (changed.test(0) && this->wrapsAround()) {
+		// So does an instruction at the very end of RAM
+		this->decoded_instructions.back() = DecodedInstruction{};
+	}
+
+	this->cpu = snapshot.cpu;
+	this->flags = snapshot.flags;
+	this->audio_pattern = snapshot.audio_pattern;
+	this->pitch = snapshot.pitch;
+	this->timers = snapshot.timers;
+	this->display.assign(snapshot.display);
+	this->keys = snapshot.keys;
+	this->random = snapshot.random;
+	this->state = snapshot.state;
+	this->keypress_target_register = snapshot.keypress_target_register;
+	this->idle = false;
+}
+
+#if CHIP8_PROFILER
+Chip8Profiler &Chip8ReferenceVm::getProfiler() {
+	return this->profiler;
+}
+#endif
+
 Chip8ReferenceVm::Instruction Chip8ReferenceVm::getInstruction() {
 	Instruction instruction;
-	if (this->pc != this->ram.cend()) {
-		instruction.hi = *this->pc++;
+	if (this->cpu.pc < this->ram.size()) {
+		instruction.hi = this->ram[this->cpu.pc++];
 	}
-	if (this->pc != this->ram.cend()) {
-		instruction.lo = *this->pc++;
+	if (this->cpu.pc < this->ram.size()) {
+		instruction.lo = this->ram[this->cpu.pc++];
 		return instruction;
 	}
 	this->state = State::Halted;
@@ -527,7 +1164,14 @@ Chip8ReferenceVm::Instruction Chip8ReferenceVm::getInstruction() {
 }
 
 void Chip8ReferenceVm::skip() {
+	// XO-CHIP's F000 NNNN is 4 bytes long and skipped as a whole
+	const bool long_instruction = this->variant == Variant::XoChip &&
+		this->ram[this->cpu.pc & this->address_mask] == std::byte{ 0xF0 } && this->ram[(this->cpu.pc + 1) & this->address_mask] == std::byte{ 0x00 };
+
 	this->getInstruction();
+	if (long_instruction && this->isLive()) {
+		this->getInstruction();
+	}
 }
 
 constexpr inline Chip8ReferenceVm::ShortValue Chip8ReferenceVm::getShortValueLo(const std::byte &byte) {
@@ -547,88 +1191,54 @@ constexpr inline Chip8ReferenceVm::LongValue Chip8ReferenceVm::getLongValue(cons
 }
 
 constexpr void Chip8ReferenceVm::jump(LongValue target) {
-	this->pc = this->ram.cbegin() + target;
+	this->cpu.pc = static_cast<Address>(target);
 }
 
 void Chip8ReferenceVm::call(LongValue target) {
-	call_stack.push(this->pc);
+	if (this->cpu.stack_depth == STACK_SIZE) {
+		this->state = State::Halted;
+		return;
+	}
+
+	this->cpu.call_stack[this->cpu.stack_depth++] = this->cpu.pc;
 	this->jump(target);
 }
 
 void Chip8ReferenceVm::doReturn() {
-	if (this->call_stack.empty()) {
+	if (this->cpu.stack_depth == 0) {
 		return;
 	}
 
-	this->pc = call_stack.top();
-	call_stack.pop();
+	this->cpu.pc = this->cpu.call_stack[--this->cpu.stack_depth];
 }
 
-void Chip8ReferenceVm::drawSprite(uint_fast8_t x, uint_fast8_t y, uint_fast8_t lines) {
-	this->v.at(0xF) = std::byte{ 0 }; // Clear VF
-
-	// Wrap x/y to screen space
-	auto display_col = x % Chip8ReferenceVm::DISPLAY_WIDTH;
-	auto display_row = y % Chip8ReferenceVm::DISPLAY_HEIGHT;
-
-	// offset into a display unit
-	uint_fast8_t subpixels = display_col % 8;
-
-	// Make looking up target bytes easier
-	display_col = display_col / 8;
+void Chip8ReferenceVm::drawSprite(uint_fast8_t x, uint_fast8_t y, uint_fast8_t lines, bool wrap, bool large) {
+	// Sprites wrap around both edges of the screen on Octo, the other platforms clip them (see Chip8Quirks::wrap_sprites).
+	// Sprite data is read through i like every other memory access, wrapping at the end of RAM. Each selected plane reads the next block of data.
+	// 0 lines is only decoded as a 16x16 sprite (DXY0) on SUPER-CHIP and XO-CHIP, plain CHIP-8 draws nothing like the other engines.
+	const std::size_t bytes_per_plane = large ? 32 : lines;
+	const auto size = bytes_per_plane * std::popcount(this->display.getSelectedPlanes());
 
-	for (auto sprite_data : std::span{ this->i, lines }) {
-		std::byte sprite_line[2]{ sprite_data >> subpixels, sprite_data << (8 - subpixels) };
-
-		uint_fast8_t display_index = display_row * Chip8ReferenceVm::DISPLAY_WIDTH_UNITS + display_col;
-		this->display.at(display_index) ^= sprite_line[0]; // Draw the first part of this line of the sprite
-		this->v.at(0xF) |= (this->display.at(display_index) ^ sprite_line[0]) != std::byte{ 0 } ? std::byte{ 0x1 } : std::byte{ 0 }; // If the previous line set a lit pixel to off, this XOR will leave a non-0 value in VF.
-
-		// Wrap sprites that would be drawn past the right extent of the screen back to the left of the same row
-		// Note: This is the original spec but certain extensions/implementations such as superchip do not wrap sprites.
-		display_index = display_row * Chip8ReferenceVm::DISPLAY_WIDTH_UNITS + (display_col + 1) % Chip8ReferenceVm::DISPLAY_WIDTH_UNITS;
-		this->display.at(display_index) ^= sprite_line[1]; // Draw any overflow
-		this->v.at(0xF) |= (this->display.at(display_index) ^ sprite_line[0]) != std::byte{ 0 } ? std::byte{ 0x1 } : std::byte{ 0 }; // As above, set VF if a pixel was turned off
-
-		// Wrap sprites that would be drawn past the bottom extent of the screen back to the top
-		// Note: This is the original spec but certain extensions/implementations such as superchip do not wrap sprites.
-		display_row = (display_row + 1) % Chip8ReferenceVm::DISPLAY_HEIGHT;
+	std::array<std::byte, Display::PLANES * 32> sprite;
+	for (std::size_t offset = 0; offset < size; ++offset) {
+		sprite[offset] = this->ram[(this->cpu.i + offset) & this->address_mask];
 	}
-}
+	bool collision = large
+		? this->display.drawWideSprite(x, y, std::span{ sprite.data(), size }, wrap)
+		: this->display.drawSprite(x, y, std::span{ sprite.data(), size }, wrap);
 
-void Chip8ReferenceVm::setAddressRegister(Address i) {
-	this->i = i;
+	// VF is set if any lit pixel was turned off by this sprite.
+	this->cpu.v[0xF] = collision ? std::byte{ 0x1 } : std::byte{ 0 };
 }
 
 void Chip8ReferenceVm::setAddressRegister(LongValue target) {
-	this->i = this->ram.begin() + target;
+	this->cpu.i = static_cast<Address>(target);
 }
 
 void Chip8ReferenceVm::incrementAddressRegister(Value offset) {
-	this->i += offset;
-}
-
-void Chip8ReferenceVm::runTimers(std::stop_token token, std::atomic<Chip8ReferenceVm::Timer> &sound, std::atomic<Chip8ReferenceVm::Timer> &delay) {
-	auto last_tick = std::chrono::steady_clock::now();
-	while (!token.stop_requested()) {
-		auto time_since_last_tick = std::chrono::steady_clock::now() - last_tick;
-		do {
-			std::this_thread::sleep_for(tick_interval - time_since_last_tick);
-			time_since_last_tick = std::chrono::steady_clock::now() - last_tick;
-		} while (time_since_last_tick < tick_interval);
-
-		last_tick += tick_interval;
-
-		if (sound > 0) {
-			--sound;
-		}
-
-		if (delay > 0) {
-			--delay;
-		}
-	}
+	this->cpu.i += offset;
 }
 
 const std::byte Chip8ReferenceVm::getRandomByte() {
-	return static_cast<std::byte>(this->distribution(this->random));
+	return static_cast<std::byte>(this->random.nextByte());
 }
\ No newline at end of file
@@ -1,21 +1,47 @@
 #pragma once
 
+#include "Chip8Display.h"
+#include "Chip8MemoryPages.h"
+#include "Chip8Profiler.h"
+#include "Chip8Quirks.h"
+#include "Chip8Random.h"
+#include "Chip8RomAnalysis.h"
+#include "Chip8Timers.h"
+
 #include <array>
-#include <atomic>
 #include <bitset>
 #include <cstddef>
 #include <cstdint>
 #include <ostream>
-#include <random>
-#include <stack>
 #include <span>
-#include <thread>
+#include <type_traits>
+#include <vector>
 
 class Chip8ReferenceVm {
 public:
-	Chip8ReferenceVm(const std::span<std::byte> &rom);
+	// Instruction set to emulate. SUPER-CHIP adds hires (128x64) graphics, scrolling, 16x16 sprites, a large font and persistent flags. XO-CHIP adds to
+	// that 64 KiB of memory, 4 bit-planes, scrolling up, register range loads/stores and audio patterns.
+	enum class Variant : uint8_t {
+		Chip8,
+		SuperChip,
+		XoChip
+	};
+
+	// The platform picks the quirks (see Chip8Quirks) independently of the instruction set, e.g. SUPER-CHIP programs written for Octo.
+	Chip8ReferenceVm(const std::span<const std::byte> &rom, Variant variant = Variant::Chip8, Chip8Platform platform = Chip8Platform::Octo);
 	~Chip8ReferenceVm();
 
+	/**
+	* Start over with a different ROM, as if newly constructed with the same variant and platform.
+	*
+	* Settings (emulation speed and timer mode) are kept, and the memory already allocated is reused so tools running many short programs (like the
+	* Fuzzer) don't pay for constructing a VM per program.
+	*/
+	void load(const std::span<const std::byte> &rom);
+
+	Variant getVariant() const;
+	Chip8Platform getPlatform() const;
+
 	// Set an upper limit on how many instructions per tick should be emulated (0 [default] disables the limit)
 	void setEmulationSpeed(unsigned long);
 
@@ -31,28 +57,75 @@ public:
 
 	unsigned long doFrame();
 
+	// Execute up to the given number of instructions back to back with no frame pacing, stopping early if the program blocks or halts
+	unsigned long run(unsigned long instructions);
+
 	void setKeyState(uint_fast8_t keyCode, bool isPressed);
 	void clearKeyState();
 
-	static constexpr uint_fast8_t DISPLAY_WIDTH = 64;
-	static constexpr uint_fast8_t DISPLAY_WIDTH_UNITS = DISPLAY_WIDTH / 8;
-	static constexpr uint_fast8_t DISPLAY_HEIGHT = 32;
-	using Display = std::array<std::byte, DISPLAY_WIDTH_UNITS *DISPLAY_HEIGHT>;
+	// The random number generator starts from seed 0, reseed it for a different run (see Chip8Random and Chip8InputLog).
+	void seed(uint32_t);
+
+	static constexpr uint_fast8_t DISPLAY_WIDTH = Chip8Display::WIDTH;
+	static constexpr uint_fast8_t DISPLAY_HEIGHT = Chip8Display::HEIGHT;
+	using Display = Chip8Display;
 	const Display &getDisplayBuffer() const;
 
-	using Timer = uint_fast8_t;
+	// Parts of the display changed by drawing, clearing or scrolling since the last call to clearDirty(), see Chip8Display::getDirtyRegions().
+	std::vector<Display::DirtyRegion> getDirtyRegions() const;
+	void clearDirty();
+
+	using Timer = Chip8Timers::Timer;
 	const Timer getSoundTimer() const;
 
+	// Timers follow the system clock by default, the other modes make a run independent of wall clock time (see Chip8Timers)
+	using TimerMode = Chip8Timers::Mode;
+	void setTimerMode(TimerMode mode, unsigned long instructions_per_tick = 0);
+
+	// Register state, intended for tools comparing or reporting on the state of a program
+	std::array<uint8_t, 16> getRegisters() const;
+	uint_fast16_t getProgramCounter() const;
+	uint_fast16_t getAddressRegister() const;
+
+	// Return addresses of the active calls, innermost last. Entries past the stack depth are 0.
+	std::array<uint16_t, 16> getCallStack() const;
+	uint_fast8_t getStackDepth() const;
+
+	// Complete VM state. RAM is stored as pages shared copy-on-write between snapshots (see Chip8MemoryPages).
+	struct Snapshot;
+
+	// Capture the current state, only RAM pages written since the last snapshot or restore are copied. The display's planes are shared with the VM until
+	// it draws on them (see Chip8Display).
+	Snapshot snapshot();
+
+	// Return to a captured state, only RAM pages that differ from the current contents are copied and display planes are shared again.
+	void restore(const Snapshot &);
+
+#if CHIP8_PROFILER
+	// Execution counts and timings of every instruction executed by step() so far
+	Chip8Profiler &getProfiler();
+#endif
+
+	// Control flow graph and data use of the program as loaded (see Chip8RomAnalysis), later writes to memory aren't reflected.
+	const Chip8RomAnalysis &getAnalysis() const;
+
 protected:
+	Variant variant;
+	Chip8Platform platform;
+
 	// Program Memory
+	//  4 KiB, or 64 KiB for XO-CHIP.
 	//  0x000-0x1FF and 0xE90-0xFFF are reserved on various implementations but at least on Octo all bytes are writable. No write/execute protection is implemented.
-	using RAM = std::array<std::byte, 4096>;
+	using RAM = std::vector<std::byte>;
 	RAM ram;
 
-	// Program Counter
-	//  As memory will only ever be read via the program counter it is implemented as a const_iterator.
-	using ProgramCounter = RAM::const_iterator;
-	ProgramCounter pc;
+	// Addresses
+	//  pc, i and return addresses are offsets into RAM. Memory accessed through i is masked so it always stays within RAM, an instruction fetched from
+	//  past the end of 4 KiB of RAM halts the VM instead. 64 KiB of RAM covers the whole address space so pc wraps around: an instruction at FFFF reads
+	//  its second byte from 0000 and is followed by the one at 0001.
+	using Address = uint16_t;
+	Address address_mask;
+	bool wrapsAround() const;
 
 	struct Instruction {
 		std::byte hi;
@@ -60,6 +133,140 @@ protected:
 	};
 	Instruction getInstruction();
 
+	// Pre-decoded instructions
+	//  Every instruction is decoded at most once into a compact record holding the handler to dispatch to and all operands already extracted, step() then only
+	//  needs a single switch over a dense enum instead of the nested switches on each nybble.
+	enum class Opcode : uint8_t {
+		Undecoded, // The slot has not been decoded yet (or was invalidated by a write into this part of memory)
+		Unsupported,
+		Halt, // 0000, only halts on platforms with Chip8Quirks::halt_on_zero
+		ClearScreen,
+		Return,
+		Jump,
+		Call,
+		SkipIfEqualValue,
+		SkipIfNotEqualValue,
+		SkipIfEqualRegister,
+		SetValue,
+		AddValue,
+		SetRegister,
+		Or,
+		And,
+		Xor,
+		Add,
+		Subtract,
+		ShiftRight,
+		SubtractReversed,
+		ShiftLeft,
+		SkipIfNotEqualRegister,
+		SetAddress,
+		JumpOffset,
+		Random,
+		Draw,
+		SkipIfKeyPressed,
+		SkipIfKeyNotPressed,
+		GetDelayTimer,
+		WaitForKey,
+		SetDelayTimer,
+		SetSoundTimer,
+		AddAddress,
+		SetAddressToFont,
+		StoreBcd,
+		StoreRegisters,
+		LoadRegisters,
+
+		// SUPER-CHIP
+		ScrollDown,
+		ScrollRight,
+		ScrollLeft,
+		Exit,
+		LowResolution,
+		HighResolution,
+		DrawLarge,
+		SetAddressToBigFont,
+		StoreFlags,
+		LoadFlags,
+
+		// XO-CHIP
+		ScrollUp,
+		StoreRange,
+		LoadRange,
+		SetAddressLong,
+		SelectPlanes,
+		LoadAudioPattern,
+		SetPitch,
+
+		// Superinstructions, see fuse()
+		SetValueSetAddressDraw, // 6XNN ANNN DXYN
+		AddValueSkipJump,       // 7XNN 3XNN 1NNN, a loop counter
+		GetDelayTimerSkipJump   // FX07 3XNN 1NNN, waiting for the delay timer
+	};
+
+	struct DecodedInstruction {
+		Opcode op = Opcode::Undecoded;
+		uint8_t x = 0;
+		uint8_t y = 0;
+		uint8_t nn = 0; // N (the sprite height for DXYN) is the low nybble of this value
+		uint16_t nnn = 0;
+	};
+
+	static constexpr DecodedInstruction decode(const Instruction &, Variant);
+
+	// Superinstructions
+	//  Common sequences of three instructions are fused when the first of them is decoded, the slot of the first instruction then holds the fused op and
+	//  its handler executes the whole sequence in one dispatch, reading the operands of the other two from their own (also decoded) slots. Fused ops still
+	//  count as the 2 or 3 instructions they execute for budgets and timers, and only run the first instruction when less than 3 are left in the budget.
+	static constexpr std::size_t FUSED_LENGTH = 6;
+
+	// Decode the instruction at offset, fusing it with the following two where they form one of the sequences above.
+	DecodedInstruction decodeAt(Address offset);
+
+	// The first instruction of a fused op (the op itself for any other instruction) and the name of the sequence (nullptr for any other instruction).
+	static constexpr Opcode unfuse(Opcode);
+	static constexpr const char *getFusionName(Opcode);
+
+	// One slot per byte of RAM as nothing stops a program from jumping to an odd address.
+	//  Every instruction the analysis finds is decoded on construction, anything it missed (and anything overwritten since) is decoded on first use.
+	std::vector<DecodedInstruction> decoded_instructions;
+
+	Chip8RomAnalysis analysis;
+
+	/**
+	* Discard any decoded instructions that overlap a range of memory that is about to be written to.
+	*
+	* @param first Address of the first byte that will be written, writes wrap at the end of RAM.
+	* @param count Number of bytes that will be written.
+	*/
+	void invalidateDecodedInstructions(Address first, std::size_t count);
+
+	/**
+	* step() for one platform, the quirks are resolved at compile time. step(), run() and doFrame() call the instantiation picked on construction.
+	*
+	* @param budget Upper limit on the number of instructions to execute, superinstructions are only run whole when it allows.
+	* @return The number of instructions executed, 0 if the VM isn't running.
+	*/
+	template<Chip8Platform quirks_platform>
+	unsigned long execute(unsigned long budget);
+
+	using StepFunction = unsigned long (Chip8ReferenceVm::*)(unsigned long);
+	StepFunction step_function;
+
+	// Idle loops
+	//  Many programs wait for the delay timer by spinning on FX07 / 3X00 / 1NNN (jumping back to the FX07). Each pass through the loop leaves the VM in
+	//  the same state until the timer changes, so once step() executes the FX07 of such a loop run() and doFrame() skip ahead to the next timer tick.
+	bool isIdleLoop(std::ptrdiff_t offset) const;
+
+	// Set by step() after executing the FX07 of an idle loop while the delay timer is non-zero
+	bool idle = false;
+
+	/**
+	* Account for whole passes through the idle loop without executing them, stopping at the next timer tick if it comes first.
+	*
+	* @param budget Maximum number of instructions to skip.
+	* @return The number of instructions skipped, a multiple of the loop length.
+	*/
+	unsigned long skipIdleLoop(unsigned long budget);
+
 	/**
 	* Skip the next instruction.
 	*/
@@ -85,11 +292,11 @@ protected:
 	*/
 	constexpr void jump(LongValue target);
 
-	std::stack<ProgramCounter> call_stack;
-
 	/**
 	* Jump to an address while saving the current location on the call stack for a future return.
 	*
+	* The call stack holds STACK_SIZE return addresses, a call with a full stack halts the VM.
+	*
 	* @param target Address as a 12 bit integer value, treated as an offset from the start of address space.
 	*/
 	void call(LongValue target);
@@ -97,22 +304,10 @@ protected:
 	/**
 	* Jumps back to the last call site.
 	*
-	* No sanity checking is performed, if a program attempts to return more times than it actually performs subroutine calls then this will crash.
+	* Returning with an empty call stack does nothing.
 	*/
 	void doReturn();
 
-	// Address Register
-	//  Used for both reads and writes via save/load instructions
-	using Address = RAM::iterator;
-	Address i;
-
-	/**
-	* Set the address register to a specific location.
-	*
-	* @param An iterator representing a location in RAM.
-	*/
-	void setAddressRegister(Address);
-
 	/**
 	* Set the address register to a specific location based on an integer value
 	*
@@ -125,31 +320,58 @@ protected:
 	*/
 	void incrementAddressRegister(Value offset);
 
-	// Data Registers
-	// Referenced as v0-vF from begin to end. vF will be trampled by many instructions.
 	using Register = std::byte;
 	using RegisterBank = std::array<Register, 16>;
-	RegisterBank v{ std::byte{0} };
 
-	// "Pointer" to the start of font data.
-	//  Declared as an iterator type instead of a const_iterator because Chip8 has no concept of protected/read only memory.
-	//  The FX29 (load address of font character) instruction will use this as the base address for convenience, so we can just increment the iterator and set i directly.
+	static constexpr std::size_t STACK_SIZE = 16;
+
+	// Everything most instructions read or write, packed into a single cache line. The struct is trivially copyable so cloning it is a plain copy, and
+	// nothing in it ever allocates.
+	struct Registers {
+		// Data Registers
+		//  Referenced as v0-vF from begin to end. vF will be trampled by many instructions.
+		RegisterBank v{};
+
+		// Program Counter, offset of the next instruction.
+		Address pc = 0x200;
+
+		// Address Register
+		//  Used for both reads and writes via save/load instructions
+		Address i = 0;
+
+		// Return addresses, innermost last. The first stack_depth entries are in use, tools like the profiler can walk them.
+		std::array<Address, STACK_SIZE> call_stack{};
+		uint8_t stack_depth = 0;
+	};
+	static_assert(std::is_trivially_copyable_v<Registers> && sizeof(Registers) <= 64, "Registers must stay a single cache line of plain data");
+	alignas(64) Registers cpu;
+
+	// Start of font data.
+	//  The FX29 (load address of font character) instruction will use this as the base address for convenience, so we can just add the character offset and set i directly.
 	//  Also while I'm not sure if any programs actually do so, potentially a rom might want to alter the font characters when it loads or trample over this region of
 	//  memory because it was written for a specific platform where it was unused by the emulator.
-	Address font_offset = this->ram.begin() + 0x50; // By convention fonts are stored starting from 0x50
+	static constexpr Address font_offset = 0x50; // By convention fonts are stored starting from 0x50
+
+	static constexpr Address big_font_offset = 0xA0; // SUPER-CHIP/XO-CHIP large digits (FX30) follow straight after
 
-	Address rom_offset = this->ram.begin() + 0x200; // Roms are loaded starting at address 0x200, all jumps will be based on this so don't deviate.
+	static constexpr Address rom_offset = 0x200; // Roms are loaded starting at address 0x200, all jumps will be based on this so don't deviate.
+
+	// SUPER-CHIP "RPL user flags" (FX75/FX85), 8 on SUPER-CHIP and 16 on XO-CHIP. On the HP-48 these survived the interpreter exiting, here they last as
+	// long as the VM.
+	std::array<std::byte, 16> flags{};
+
+	// XO-CHIP audio pattern (F002) and pitch (FX3A), kept so programs can read back what they set but not played by any frontend yet.
+	std::array<std::byte, 16> audio_pattern{};
+	uint8_t pitch = 64;
 
 	// Timers.
-	// Both timers count down at 60hz.
-	std::atomic<Timer> delay = 0;
-	std::atomic<Timer> sound = 0; // Sound will play iff this value is greater than 1
-	std::jthread timer_thread;
+	// Both timers count down at 60hz, clocked from doFrame()/run()/step() instead of a separate thread.
+	Chip8Timers timers;
 
 	unsigned long frame_limit = 0;
 
-	static constexpr std::chrono::milliseconds tick_interval = std::chrono::milliseconds(1000 / 60);
-	static void runTimers(std::stop_token, std::atomic<Timer> &sound, std::atomic<Timer> &delay);
+	// How many instructions to run between checks of the frame deadline in doFrame(), reading the clock costs more than most instructions
+	static constexpr unsigned long clock_check_interval = 64;
 
 	const std::byte getRandomByte();
 
@@ -160,14 +382,20 @@ protected:
 	bool isKeyPressed(const uint_fast8_t &x) const;
 
 	// Display Buffer
-	//  64*32 pixels, with each pixel being a single bit. This could possibly be a bitset but that seems like a headache to copy into.
-	Display display;
+	//  64*32 pixels with each pixel being a single bit, or 128*64 in hires with up to 4 bit-planes (see Chip8Display).
+	Display display{};
+
+	// A large sprite is 16x16 (SUPER-CHIP DXY0) and ignores lines, otherwise 0 lines draws nothing.
+	void drawSprite(uint_fast8_t, uint_fast8_t, uint_fast8_t lines, bool wrap, bool large = false);
 
-	void drawSprite(uint_fast8_t, uint_fast8_t, uint_fast8_t);
+#if CHIP8_PROFILER
+	Chip8Profiler profiler;
 
-	// Random number generation internals
-	std::default_random_engine random;
-	std::uniform_int_distribution<unsigned short> distribution;
+	// Entry addresses of the active subroutines, rebuilt from call_stack before each instruction
+	std::vector<uint16_t> profiled_stack;
+#endif
+
+	Chip8Random random;
 
 	enum class State {
 		Loading,
@@ -179,7 +407,21 @@ protected:
 
 	uint_fast8_t keypress_target_register = -1;
 
-private:
-	std::random_device rd;
+	// Tracks which parts of RAM were written since the last snapshot or restore
+	Chip8MemoryPages memory_pages;
+};
+
+struct Chip8ReferenceVm::Snapshot {
+	Chip8MemoryPages::Pages ram;
+	Registers cpu;
+	std::array<std::byte, 16> flags;
+	std::array<std::byte, 16> audio_pattern;
+	uint8_t pitch;
+	Chip8Timers timers;
+	Display display;
+	std::bitset<16> keys;
+	Chip8Random random;
+	State state;
+	uint_fast8_t keypress_target_register;
 };
 
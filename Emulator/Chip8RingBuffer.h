@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+* Fixed size queue from one producer thread to one consumer thread (e.g. key presses from the thread reading input to the one running the VM). Neither
+* side takes a lock or ever waits, a full queue drops what's pushed onto it.
+*
+* The producer only writes the tail and the consumer only the head, each on its own cache line so the two threads don't keep taking it from each other.
+*/
+template<typename T, std::size_t Capacity>
+class Chip8RingBuffer {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+public:
+	// Producer: @return false if the queue is full, the value isn't queued.
+	bool push(const T &value) {
+		auto tail = this->tail.load(std::memory_order_relaxed);
+		if (tail - this->head.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+
+		this->items[tail % Capacity] = value;
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer: @return false if the queue is empty, value is left as it was.
+	bool pop(T &value) {
+		auto head = this->head.load(std::memory_order_relaxed);
+		if (head == this->tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		value = this->items[head % Capacity];
+		this->head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+protected:
+	static constexpr std::size_t CACHE_LINE = 64;
+
+	std::array<T, Capacity> items{};
+
+	// Counts of values ever pushed and popped, only wrapped into items when indexing it
+	alignas(CACHE_LINE) std::atomic<std::size_t> head = 0;
+	alignas(CACHE_LINE) std::atomic<std::size_t> tail = 0;
+};
@@ -0,0 +1,96 @@
+#include "Chip8Rom.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const Chip8Rom> Chip8Rom::map(const std::filesystem::path &file_name) {
+	// The constructor taking no data is protected, so make_shared can't be used here
+	std::shared_ptr<Chip8Rom> rom(new Chip8Rom());
+
+#ifdef _WIN32
+	auto file = CreateFileW(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	// Mapping an empty file fails, there's nothing to map anyway
+	if (size.QuadPart > 0) {
+		auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		auto view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (mapping) {
+			// The view keeps the mapping alive
+			CloseHandle(mapping);
+		}
+		if (!view) {
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		rom->mapping = view;
+		rom->mapping_size = static_cast<std::size_t>(size.QuadPart);
+	}
+	CloseHandle(file);
+#else
+	auto file = open(file_name.c_str(), O_RDONLY);
+	if (file < 0) {
+		return nullptr;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0) {
+		close(file);
+		return nullptr;
+	}
+
+	if (status.st_size > 0) {
+		auto view = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (view == MAP_FAILED) {
+			close(file);
+			return nullptr;
+		}
+
+		rom->mapping = view;
+		rom->mapping_size = static_cast<std::size_t>(status.st_size);
+	}
+	close(file);
+#endif
+
+	rom->data = std::span{ static_cast<const std::byte *>(rom->mapping), rom->mapping_size };
+	return rom;
+}
+
+Chip8Rom::Chip8Rom(std::span<const std::byte> data) :
+	copy(data.begin(), data.end())
+{
+	this->data = this->copy;
+}
+
+Chip8Rom::~Chip8Rom() {
+	if (this->mapping == nullptr) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(this->mapping);
+#else
+	munmap(this->mapping, this->mapping_size);
+#endif
+}
+
+std::span<const std::byte> Chip8Rom::getData() const {
+	return this->data;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+* An immutable ROM image, shared between every VM running it.
+*
+* Files are memory mapped read-only instead of being read into a buffer, so opening a ROM costs a page table entry per page actually touched and every
+* process (and thread) running the same file shares the same physical pages. ROMs built in memory are copied once on construction.
+*/
+class Chip8Rom {
+public:
+	// Map a file, returns nullptr if it can't be opened. Empty files give an empty ROM.
+	static std::shared_ptr<const Chip8Rom> map(const std::filesystem::path &file_name);
+
+	explicit Chip8Rom(std::span<const std::byte> data);
+	~Chip8Rom();
+
+	Chip8Rom(const Chip8Rom &) = delete;
+	Chip8Rom &operator=(const Chip8Rom &) = delete;
+
+	std::span<const std::byte> getData() const;
+
+protected:
+	Chip8Rom() = default;
+
+	// Either points into the mapping or into copy
+	std::span<const std::byte> data;
+
+	void *mapping = nullptr;
+	std::size_t mapping_size = 0;
+
+	std::vector<std::byte> copy;
+};
@@ -0,0 +1,433 @@
+#include "Chip8RomAnalysis.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+
+namespace {
+	constexpr int NO_ADDRESS = -1;
+
+	// Code is walked again for each distinct value of I it's reached with (subroutines drawing whatever sprite the caller points at), up to this many
+	// times per address before I is treated as unknown there.
+	constexpr std::size_t MAX_WALKS = 8;
+}
+
+// How an instruction affects control flow, decoded the same way Chip8ReferenceVm::decode() does
+struct Chip8RomAnalysis::Flow {
+	enum class Kind : uint8_t {
+		Next,     // Continues with the following instruction
+		Jump,     // 1NNN
+		Call,     // 2NNN, continues after the call once the subroutine returns
+		Skip,     // Continues with either of the following two instructions
+		Return,   // 00EE
+		Stop,     // 0000 (halts on Octo) and 00FD
+		Indirect, // BNNN
+		Invalid   // Unsupported, or not enough memory left to hold it
+	};
+
+	Kind kind = Kind::Next;
+	uint16_t target = 0;
+	uint8_t length = 2;
+};
+
+Chip8RomAnalysis::Flow Chip8RomAnalysis::decodeFlow(std::span<const std::byte> memory, uint16_t address, bool super_chip, bool xo_chip) {
+	using Kind = Flow::Kind;
+
+	// 64 KiB of memory covers the whole address space and wraps around like pc does, anything less ends where memory does
+	const bool wraps = memory.size() > 0xFFFF;
+	if (address + 1u >= memory.size() && !wraps) {
+		return { Kind::Invalid };
+	}
+
+	const auto hi = std::to_integer<uint8_t>(memory[address]);
+	const auto lo = std::to_integer<uint8_t>(memory[(address + 1u) % memory.size()]);
+	const auto nnn = static_cast<uint16_t>((hi & 0x0F) << 8 | lo);
+
+	switch (hi >> 4)
+	{
+	case 0x0:
+		if (nnn == 0x000 || (super_chip && nnn == 0x0FD)) {
+			return { Kind::Stop };
+		}
+		if (nnn == 0x0EE) {
+			return { Kind::Return };
+		}
+		if (nnn == 0x0E0 || (super_chip && (nnn >= 0x0FB || (nnn & 0xFF0) == 0x0C0)) || (xo_chip && (nnn & 0xFF0) == 0x0D0)) {
+			return { Kind::Next };
+		}
+		return { Kind::Invalid };
+
+	case 0x1:
+		return { Kind::Jump, nnn };
+
+	case 0x2:
+		return { Kind::Call, nnn };
+
+	case 0x3:
+	case 0x4:
+	case 0x9:
+		return { Kind::Skip };
+
+	case 0x5:
+		return { xo_chip && ((lo & 0x0F) == 0x2 || (lo & 0x0F) == 0x3) ? Kind::Next : Kind::Skip };
+
+	case 0x8:
+		return { (lo & 0x0F) <= 0x7 || (lo & 0x0F) == 0xE ? Kind::Next : Kind::Invalid };
+
+	case 0xB:
+		return { Kind::Indirect, nnn };
+
+	case 0xE:
+		return { lo == 0x9E || lo == 0xA1 ? Kind::Skip : Kind::Invalid };
+
+	case 0xF:
+		switch (lo)
+		{
+		case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x33: case 0x55: case 0x65:
+			return { Kind::Next };
+
+		case 0x30: case 0x75: case 0x85:
+			return { super_chip ? Kind::Next : Kind::Invalid };
+
+		case 0x00:
+			// F000 NNNN
+			if (xo_chip && (hi & 0x0F) == 0) {
+				return { address + 3u < memory.size() || wraps ? Kind::Next : Kind::Invalid, 0, 4 };
+			}
+			return { Kind::Invalid };
+
+		case 0x02:
+			return { xo_chip && (hi & 0x0F) == 0 ? Kind::Next : Kind::Invalid };
+
+		case 0x01: case 0x3A:
+			return { xo_chip ? Kind::Next : Kind::Invalid };
+
+		default:
+			return { Kind::Invalid };
+		}
+
+	default:
+		// 6XNN, 7XNN, ANNN, CXNN, DXYN
+		return { Kind::Next };
+	}
+}
+
+Chip8RomAnalysis::Chip8RomAnalysis(std::span<const std::byte> memory, Region program, bool super_chip, bool xo_chip) :
+	flags(memory.size(), 0),
+	program(program)
+{
+	using Kind = Flow::Kind;
+
+	const auto size = memory.size();
+	auto byte_at = [&](std::size_t address) { return std::to_integer<uint8_t>(memory[address % size]); };
+	auto mark = [&](int first, std::size_t count, uint8_t flag) {
+		for (std::size_t offset = 0; offset < count; ++offset) {
+			this->flags[(first + offset) % size] |= flag;
+		}
+	};
+	auto length_at = [&](std::size_t address) { return decodeFlow(memory, static_cast<uint16_t>(address % size), super_chip, xo_chip).length; };
+
+	// Blocks start at the entry point and every target of a jump, call or skip. I (or NO_ADDRESS when not known) is carried along with each address.
+	std::vector<bool> is_leader(size, false);
+	std::vector<uint16_t> leaders;
+	std::vector<std::pair<uint16_t, int>> pending;
+	auto follow = [&](std::size_t address, int i) {
+		address %= size;
+		if (!is_leader[address]) {
+			is_leader[address] = true;
+			leaders.push_back(static_cast<uint16_t>(address));
+		}
+		pending.emplace_back(static_cast<uint16_t>(address), i);
+	};
+
+	// Almost every instruction is only ever reached with one value of I, further values are kept in a list searched linearly
+	std::vector<uint8_t> walks(size, 0);
+	auto first_walk = std::make_unique_for_overwrite<int[]>(size);
+	std::vector<std::pair<uint16_t, int>> other_walks;
+	auto walk = [&](uint16_t address, int &i) {
+		if (walks[address] >= MAX_WALKS) {
+			i = NO_ADDRESS;
+		}
+		if (walks[address] > 0 && (first_walk[address] == i ||
+			std::find(other_walks.begin(), other_walks.end(), std::make_pair(address, i)) != other_walks.end())) {
+			return false;
+		}
+
+		if (walks[address]++ == 0) {
+			first_walk[address] = i;
+		}
+		else {
+			other_walks.emplace_back(address, i);
+		}
+		return true;
+	};
+
+	struct Store {
+		uint16_t instruction;
+		int first;
+		std::size_t count;
+	};
+	std::vector<Store> stores;
+
+	follow(program.first, NO_ADDRESS);
+	while (!pending.empty()) {
+		auto [address, i] = pending.back();
+		pending.pop_back();
+
+		while (walk(address, i)) {
+			auto flow = decodeFlow(memory, address, super_chip, xo_chip);
+			if (flow.kind == Kind::Invalid) {
+				this->invalid_instructions.push_back(address);
+				break;
+			}
+
+			this->flags[address] |= INSTRUCTION;
+			mark(address + 1, flow.length - 1, OPERAND);
+
+			const auto hi = byte_at(address);
+			const auto lo = byte_at(address + 1);
+			const auto x = hi & 0x0F;
+			const auto y = lo >> 4;
+
+			// Data accessed through I
+			switch (hi >> 4)
+			{
+			case 0x5:
+				if (xo_chip && (lo & 0x0F) == 0x2 && i != NO_ADDRESS) {
+					stores.push_back({ address, i, static_cast<std::size_t>(std::abs(x - y) + 1) });
+				}
+				else if (xo_chip && (lo & 0x0F) == 0x3 && i != NO_ADDRESS) {
+					mark(i, std::abs(x - y) + 1, DATA);
+				}
+				break;
+
+			case 0xA:
+				i = (hi & 0x0F) << 8 | lo;
+				break;
+
+			case 0xD:
+				if (i != NO_ADDRESS) {
+					// DXY0 draws a 16x16 sprite on SUPER-CHIP. Further bit-planes on XO-CHIP read more bytes but the planes selected aren't known.
+					mark(i, (lo & 0x0F) == 0 ? (super_chip ? 32 : 0) : lo & 0x0F, SPRITE);
+				}
+				break;
+
+			case 0xF:
+				if (lo == 0x00 && flow.length == 4) {
+					i = byte_at(address + 2) << 8 | byte_at(address + 3);
+				}
+				else if (lo == 0x02 && i != NO_ADDRESS) {
+					mark(i, 16, DATA);
+				}
+				else if (lo == 0x33 && i != NO_ADDRESS) {
+					stores.push_back({ address, i, 3 });
+				}
+				else if (lo == 0x55 && i != NO_ADDRESS) {
+					stores.push_back({ address, i, static_cast<std::size_t>(x + 1) });
+				}
+				else if (lo == 0x65 && i != NO_ADDRESS) {
+					mark(i, x + 1, DATA);
+				}
+
+				// FX1E and FX29/FX30 move I, FX55/FX65 move it by an amount that depends on the platform
+				if (lo == 0x1E || lo == 0x29 || lo == 0x30 || lo == 0x55 || lo == 0x65) {
+					i = NO_ADDRESS;
+				}
+				break;
+			}
+
+			auto next = (address + flow.length) % size;
+			switch (flow.kind)
+			{
+			case Kind::Jump:
+				follow(flow.target, i);
+				break;
+
+			case Kind::Call:
+				this->subroutines.push_back(flow.target);
+				follow(flow.target, i);
+				follow(next, i);
+				break;
+
+			case Kind::Skip:
+				follow(next, i);
+				follow(next + length_at(next), i);
+				break;
+
+			case Kind::Indirect:
+				follow(flow.target, i);
+				break;
+
+			case Kind::Next:
+				address = static_cast<uint16_t>(next);
+				continue;
+
+			default:
+				break;
+			}
+			break;
+		}
+	}
+
+	std::sort(this->subroutines.begin(), this->subroutines.end());
+	this->subroutines.erase(std::unique(this->subroutines.begin(), this->subroutines.end()), this->subroutines.end());
+	std::sort(this->invalid_instructions.begin(), this->invalid_instructions.end());
+	this->invalid_instructions.erase(std::unique(this->invalid_instructions.begin(), this->invalid_instructions.end()), this->invalid_instructions.end());
+
+	// Stores are only checked against code once all of it has been found
+	for (const auto &store : stores) {
+		mark(store.first, store.count, WRITTEN);
+
+		bool hits_code = false;
+		for (std::size_t offset = 0; offset < store.count; ++offset) {
+			hits_code = hits_code || (this->flags[(store.first + offset) % size] & (INSTRUCTION | OPERAND));
+		}
+		if (hits_code) {
+			this->self_modifying_writes.push_back({ store.instruction, { static_cast<uint16_t>(store.first), static_cast<uint16_t>(store.count) } });
+		}
+	}
+	std::sort(this->self_modifying_writes.begin(), this->self_modifying_writes.end(), [](const auto &a, const auto &b) { return a.instruction < b.instruction; });
+
+	// Each block runs from a leader up to the first instruction that changes control flow, or up to the next leader
+	std::sort(leaders.begin(), leaders.end());
+	for (auto start : leaders) {
+		if (!(this->flags[start] & INSTRUCTION)) {
+			continue;
+		}
+
+		Block block;
+		block.start = start;
+		std::size_t address = start;
+		while (true) {
+			auto flow = decodeFlow(memory, static_cast<uint16_t>(address), super_chip, xo_chip);
+			auto next = (address + flow.length) % size;
+			block.end = static_cast<uint16_t>(address + flow.length);
+
+			if (flow.kind == Kind::Next) {
+				if (!is_leader[next] && (this->flags[next] & INSTRUCTION) && next > address) {
+					address = next;
+					continue;
+				}
+				if (this->flags[next] & INSTRUCTION) {
+					block.successors[block.successor_count++] = (static_cast<uint16_t>(next));
+				}
+			}
+			else if (flow.kind == Kind::Jump || flow.kind == Kind::Indirect) {
+				block.successors[block.successor_count++] = (flow.target);
+				block.indirect = flow.kind == Kind::Indirect;
+			}
+			else if (flow.kind == Kind::Call) {
+				block.callee = flow.target;
+				block.successors[block.successor_count++] = (static_cast<uint16_t>(next));
+			}
+			else if (flow.kind == Kind::Skip) {
+				block.successors[block.successor_count++] = (static_cast<uint16_t>(next));
+				block.successors[block.successor_count++] = (static_cast<uint16_t>((next + length_at(next)) % size));
+			}
+			break;
+		}
+		this->blocks.push_back(std::move(block));
+	}
+
+	// Program bytes nothing was found to use
+	auto end = std::min<std::size_t>(program.first + program.count, size);
+	for (std::size_t address = program.first; address < end;) {
+		if (this->flags[address] & (INSTRUCTION | OPERAND | SPRITE | DATA)) {
+			++address;
+			continue;
+		}
+
+		auto first = address;
+		while (address < end && !(this->flags[address] & (INSTRUCTION | OPERAND | SPRITE | DATA))) {
+			++address;
+		}
+		this->unknown_regions.push_back({ static_cast<uint16_t>(first), static_cast<uint16_t>(address - first) });
+	}
+}
+
+uint8_t Chip8RomAnalysis::getFlags(uint16_t address) const {
+	return address < this->flags.size() ? this->flags[address] : 0;
+}
+
+bool Chip8RomAnalysis::isInstruction(uint16_t address) const {
+	return this->getFlags(address) & INSTRUCTION;
+}
+
+const std::vector<Chip8RomAnalysis::Block> &Chip8RomAnalysis::getBlocks() const {
+	return this->blocks;
+}
+
+const std::vector<uint16_t> &Chip8RomAnalysis::getSubroutines() const {
+	return this->subroutines;
+}
+
+const std::vector<Chip8RomAnalysis::SelfModifyingWrite> &Chip8RomAnalysis::getSelfModifyingWrites() const {
+	return this->self_modifying_writes;
+}
+
+const std::vector<uint16_t> &Chip8RomAnalysis::getInvalidInstructions() const {
+	return this->invalid_instructions;
+}
+
+const std::vector<Chip8RomAnalysis::Region> &Chip8RomAnalysis::getUnknownRegions() const {
+	return this->unknown_regions;
+}
+
+void Chip8RomAnalysis::writeReport(std::ostream &output) const {
+	auto flags = output.flags();
+	output << std::hex << std::uppercase << std::setfill('0');
+	auto address = [&](uint16_t value) -> std::ostream & { return output << std::setw(3) << value; };
+
+	std::size_t counts[5] = {};
+	auto end = std::min<std::size_t>(this->program.first + this->program.count, this->flags.size());
+	for (std::size_t offset = this->program.first; offset < end; ++offset) {
+		for (std::size_t bit = 0; bit < 5; ++bit) {
+			counts[bit] += (this->flags[offset] >> bit) & 1;
+		}
+	}
+	output << std::dec << "program bytes: " << this->program.count << ", instructions: " << counts[0] << ", operand bytes: " << counts[1] <<
+		", sprite bytes: " << counts[2] << ", data bytes: " << counts[3] << ", written bytes: " << counts[4] << "\n" << std::hex;
+
+	output << "blocks:\n";
+	for (const auto &block : this->blocks) {
+		output << "  ";
+		address(block.start) << "-";
+		address(static_cast<uint16_t>(block.end - 1));
+		if (block.callee != Block::NO_CALLEE) {
+			output << " call ";
+			address(block.callee);
+		}
+		output << (block.indirect ? " indirect" : "") << " ->";
+		for (uint8_t successor = 0; successor < block.successor_count; ++successor) {
+			output << " ";
+			address(block.successors[successor]);
+		}
+		output << "\n";
+	}
+
+	output << "subroutines:";
+	for (auto subroutine : this->subroutines) {
+		output << " ";
+		address(subroutine);
+	}
+	output << "\n";
+
+	for (const auto &write : this->self_modifying_writes) {
+		output << "self-modifying write at ";
+		address(write.instruction) << " to ";
+		address(write.target.first) << "-";
+		address(static_cast<uint16_t>(write.target.first + write.target.count - 1)) << "\n";
+	}
+	for (auto instruction : this->invalid_instructions) {
+		output << "invalid instruction at ";
+		address(instruction) << "\n";
+	}
+	for (const auto &region : this->unknown_regions) {
+		output << "unknown bytes at ";
+		address(region.first) << "-";
+		address(static_cast<uint16_t>(region.first + region.count - 1)) << "\n";
+	}
+
+	output.flags(flags);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <vector>
+
+/**
+* Static analysis of a program as it is loaded, before any of it runs.
+*
+* Recursive-descent disassembly from the entry point follows every jump, call and skip to find which bytes are instructions, then splits them into basic
+* blocks and subroutines. Known values of I are carried along every path (while set by ANNN or F000 NNNN), which finds the sprite data drawn and the data
+* loaded by most programs and the bytes written by FX33/FX55 (and the XO-CHIP range store). Writes landing on code are reported as self-modifying.
+*
+* The result is a conservative guide: BNNN jumps to NNN plus a register, only NNN itself is followed and the block is marked indirect, so code only
+* reached through jump tables or generated at run time stays unknown. Program bytes found to be neither code nor data are reported as unknown regions.
+*/
+class Chip8RomAnalysis {
+public:
+	// Bit flags describing how each byte of memory is used
+	enum ByteFlags : uint8_t {
+		INSTRUCTION = 0x01, // First byte of a reachable instruction
+		OPERAND = 0x02,     // Any other byte of a reachable instruction
+		SPRITE = 0x04,      // Drawn by DXYN
+		DATA = 0x08,        // Loaded into registers or the audio pattern
+		WRITTEN = 0x10      // Stored to by FX33, FX55 or 5XY2
+	};
+
+	struct Block {
+		uint16_t start = 0;
+		uint16_t end = 0; // One past the last byte of the last instruction
+
+		// Where execution continues, two places after a skip. Call targets are in callee rather than here.
+		std::array<uint16_t, 2> successors{};
+		uint8_t successor_count = 0;
+
+		static constexpr uint16_t NO_CALLEE = 0xFFFF;
+		uint16_t callee = NO_CALLEE;
+
+		// Ends in BNNN, successors only holds NNN
+		bool indirect = false;
+	};
+
+	struct Region {
+		uint16_t first;
+		uint16_t count;
+	};
+
+	// A store that writes to bytes holding code
+	struct SelfModifyingWrite {
+		uint16_t instruction;
+		Region target;
+	};
+
+	Chip8RomAnalysis() = default;
+
+	/**
+	* @param memory RAM as loaded, including the font.
+	* @param program Where the ROM was loaded, also the entry point. Only this part of memory is reported on for unknown bytes.
+	* @param super_chip Decode SUPER-CHIP instructions.
+	* @param xo_chip Decode XO-CHIP instructions (including the 4 byte F000 NNNN).
+	*/
+	Chip8RomAnalysis(std::span<const std::byte> memory, Region program, bool super_chip, bool xo_chip);
+
+	uint8_t getFlags(uint16_t address) const;
+	bool isInstruction(uint16_t address) const;
+
+	// Ordered by start address
+	const std::vector<Block> &getBlocks() const;
+
+	// Entry addresses of every subroutine called, ordered
+	const std::vector<uint16_t> &getSubroutines() const;
+
+	const std::vector<SelfModifyingWrite> &getSelfModifyingWrites() const;
+
+	// Reachable instructions that are invalid for the instruction set, including 0NNN machine code calls. Instructions running past the end of 4 KiB of
+	// memory are invalid too, 64 KiB of memory wraps around instead.
+	const std::vector<uint16_t> &getInvalidInstructions() const;
+
+	// Runs of program bytes that are neither code nor data
+	const std::vector<Region> &getUnknownRegions() const;
+
+	// Human readable summary listing every block, subroutine and suspicious region
+	void writeReport(std::ostream &output) const;
+
+protected:
+	struct Flow;
+	static Flow decodeFlow(std::span<const std::byte> memory, uint16_t address, bool super_chip, bool xo_chip);
+
+	std::vector<uint8_t> flags;
+	std::vector<Block> blocks;
+	std::vector<uint16_t> subroutines;
+	std::vector<SelfModifyingWrite> self_modifying_writes;
+	std::vector<uint16_t> invalid_instructions;
+	std::vector<Region> unknown_regions;
+	Region program{};
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+/**
+* Delay and sound timers, both counting down at 60hz.
+*
+* The timers are clocked by the VM that owns them instead of a thread per instance. Where ticks come from depends on the mode:
+*  - Realtime (default): ticks follow the system clock, any that came due are applied when the VM synchronises at the start of doFrame()/run().
+*  - Frame: exactly one tick at the end of every doFrame() call.
+*  - Instruction: one tick after every N executed instructions.
+* Only realtime mode ever reads the clock, the other two give the same results no matter how fast the host runs the VM.
+*/
+class Chip8Timers {
+public:
+	using Timer = uint_fast8_t;
+
+	enum class Mode : uint8_t {
+		Realtime,
+		Frame,
+		Instruction
+	};
+
+	static constexpr std::chrono::milliseconds tick_interval = std::chrono::milliseconds(1000 / 60);
+
+	Timer delay = 0;
+	Timer sound = 0; // Sound will play iff this value is greater than 1
+
+	/**
+	* Change how the timers are clocked.
+	*
+	* @param instructions_per_tick Only used in instruction mode, values below 1 are treated as 1.
+	*/
+	void setMode(Mode mode, unsigned long instructions_per_tick) {
+		this->mode = mode;
+		this->instructions_per_tick = std::max(instructions_per_tick, 1ul);
+		this->instructions_until_tick = this->instructions_per_tick;
+		this->last_tick = std::chrono::steady_clock::now();
+	}
+
+	Mode getMode() const {
+		return this->mode;
+	}
+
+	// Stop both timers and start counting towards the next tick from scratch, keeping the mode.
+	void reset() {
+		this->delay = 0;
+		this->sound = 0;
+		this->instructions_until_tick = this->instructions_per_tick;
+		this->last_tick = std::chrono::steady_clock::now();
+	}
+
+	void tick() {
+		if (this->sound > 0) {
+			--this->sound;
+		}
+
+		if (this->delay > 0) {
+			--this->delay;
+		}
+	}
+
+	// Apply every tick that has come due since the last call. Timers only hold 8 bit values so a long pause just runs them down to 0.
+	void synchronise() {
+		if (this->mode != Mode::Realtime) {
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		while (now - this->last_tick >= tick_interval) {
+			this->last_tick += tick_interval;
+			this->tick();
+		}
+	}
+
+	void endFrame() {
+		if (this->mode == Mode::Frame) {
+			this->tick();
+		}
+	}
+
+	/**
+	* How many instructions can be executed before the next tick is due.
+	*
+	* @return 0 when ticks don't depend on the number of instructions executed.
+	*/
+	unsigned long instructionsUntilTick() const {
+		return this->mode == Mode::Instruction ? this->instructions_until_tick : 0;
+	}
+
+	// Account for executed instructions, callers split their work so this never passes more than one tick boundary.
+	void advance(unsigned long instructions) {
+		if (this->mode != Mode::Instruction) {
+			return;
+		}
+
+		this->instructions_until_tick -= std::min(instructions, this->instructions_until_tick);
+		if (this->instructions_until_tick == 0) {
+			this->tick();
+			this->instructions_until_tick = this->instructions_per_tick;
+		}
+	}
+
+protected:
+	Mode mode = Mode::Realtime;
+
+	unsigned long instructions_per_tick = 1;
+	unsigned long instructions_until_tick = 1;
+
+	std::chrono::steady_clock::time_point last_tick = std::chrono::steady_clock::now();
+};
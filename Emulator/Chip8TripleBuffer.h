@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+* Hands the latest of a stream of values (e.g. frames) from one producer thread to one consumer thread without either of them ever waiting on the other.
+*
+* There are three slots: the producer fills its back slot and swaps it with the middle one, the consumer swaps its front slot with the middle one when a
+* newer value is waiting there. Values published faster than the consumer takes them are overwritten, so a slow consumer only sees the most recent value
+* and never holds up the producer.
+*/
+template<typename T>
+class Chip8TripleBuffer {
+public:
+	// Producer: the slot to fill in before calling publish(). It isn't cleared in between so it holds whatever was published from it last time.
+	T &back() {
+		return this->slots[this->back_index];
+	}
+
+	// Producer: make the back slot the latest value, and take another slot to fill next.
+	void publish() {
+		this->back_index = this->middle.exchange(this->back_index | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer: move on to the latest value. @return false if nothing was published since the last call, front() is unchanged.
+	bool update() {
+		if (!(this->middle.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+		this->front_index = this->middle.exchange(this->front_index, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// Consumer: the value taken by the last call to update(), which stays untouched until the next call.
+	const T &front() const {
+		return this->slots[this->front_index];
+	}
+
+protected:
+	// The middle slot's index, plus a flag set when it holds a value the consumer hasn't taken yet
+	static constexpr uint8_t INDEX = 0x3;
+	static constexpr uint8_t FRESH = 0x4;
+
+	std::array<T, 3> slots{};
+	std::atomic<uint8_t> middle = 1;
+
+	// Only ever touched by their own thread
+	uint8_t back_index = 0;
+	uint8_t front_index = 2;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <istream>
+
+/**
+* Unsigned LEB128 varints as used by Chip8InputLog and the Chip8FrameWriter/Chip8FrameReader streams: 7 bits per byte from the lowest up, the top bit set
+* on every byte but the last. Values below 0x80 take a single byte.
+*/
+namespace Chip8Varint {
+	// @param output Output iterator of char, e.g. std::back_inserter() of a buffer or std::ostreambuf_iterator. @return output past the last byte written.
+	template<typename OutputIterator>
+	OutputIterator write(OutputIterator output, unsigned long long value) {
+		while (value >= 0x80) {
+			*output++ = static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		*output++ = static_cast<char>(value);
+		return output;
+	}
+
+	// @return false at the end of the input or if the varint is too long to be a 64 bit value, value is left partly read.
+	inline bool read(std::istream &input, unsigned long long &value) {
+		value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			auto byte = input.get();
+			if (byte == std::istream::traits_type::eof()) {
+				return false;
+			}
+
+			value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,305 @@
+// FrameDecoder.cpp : Turns a frame stream recorded by BatchRunner --frames (see Chip8FrameWriter) back into images.
+//
+// Usage: FrameDecoder [--gif | --pbm] [--scale N] [--unique] <stream> <output or ->
+//
+// --pbm (the default) writes every frame as a raw PBM image, one after another in the same file as netpbm tools expect, so they can be piped straight
+// into other tools (e.g. ffmpeg -f image2pipe -c:v pbm -framerate 60 -i -). PBM has one bit per pixel, pixels lit in any plane are black. With --unique
+// frames the same as the one before them are left out.
+//
+// --gif writes an animated GIF playing at the recorded speed of 60 frames a second. Frames the same as the one before them only lengthen how long it's
+// shown for. GIF delays are in hundredths of a second and viewers don't honour delays under 2, so frames that would be shown for less than that are
+// dropped in favour of the one after them. XO-CHIP planes are coloured with Octo's default 16 colour palette.
+//
+// Images are always 128x64 pixels times --scale (default 1), lores frames have each pixel drawn as 2x2, so programs that switch resolution give images of
+// a single size.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../Emulator/Chip8FrameStream.h"
+
+constexpr unsigned FRAMES_PER_SECOND = 60;
+
+// Black and white first so plain CHIP-8 programs look as they do in ConsoleUI
+constexpr std::array<uint32_t, 16> PALETTE = {
+	0x000000, 0xFFFFFF, 0xAAAAAA, 0x555555, 0xFF0000, 0x00FF00, 0x0000FF, 0xFFFF00,
+	0x880000, 0x008800, 0x000088, 0x888800, 0xFF00FF, 0x00FFFF, 0x880088, 0x008888
+};
+
+// The planes lit at each pixel of a frame, scaled up to the size of the images written
+std::vector<uint8_t> render(const Chip8FrameReader &frames, unsigned scale) {
+	const unsigned width = Chip8Display::HIRES_WIDTH * scale;
+	const unsigned height = Chip8Display::HIRES_HEIGHT * scale;
+	const unsigned pixel = frames.isHires() ? scale : 2 * scale;
+
+	std::vector<uint8_t> image(static_cast<std::size_t>(width) * height);
+	for (unsigned y = 0; y < height; ++y) {
+		for (unsigned x = 0; x < width; ++x) {
+			image[y * width + x] = frames.getPlanes(static_cast<uint_fast8_t>(x / pixel), static_cast<uint_fast8_t>(y / pixel));
+		}
+	}
+	return image;
+}
+
+void write_pbm(std::ostream &output, const std::vector<uint8_t> &image, unsigned width, unsigned height) {
+	output << "P4\n" << width << " " << height << "\n";
+
+	std::vector<char> row((width + 7) / 8);
+	for (unsigned y = 0; y < height; ++y) {
+		std::fill(row.begin(), row.end(), 0);
+		for (unsigned x = 0; x < width; ++x) {
+			if (image[y * width + x] != 0) {
+				row[x / 8] |= static_cast<char>(0x80 >> (x % 8));
+			}
+		}
+		output.write(row.data(), static_cast<std::streamsize>(row.size()));
+	}
+}
+
+/**
+* Writes an animated GIF a frame at a time.
+*
+* Every frame covers the whole image and is compressed on its own with the 16 colour palette, a 4 bit colour index per pixel.
+*/
+class GifWriter {
+public:
+	GifWriter(std::ostream &output, unsigned width, unsigned height) :
+		output(output),
+		width(width),
+		height(height)
+	{
+		this->output.write("GIF89a", 6);
+		this->writeShort(width);
+		this->writeShort(height);
+
+		// Global colour table of 2^(3 + 1) entries, 8 bits per primary
+		this->output.put(static_cast<char>(0xF3));
+		this->output.put(0);
+		this->output.put(0);
+		for (auto colour : PALETTE) {
+			this->output.put(static_cast<char>(colour >> 16));
+			this->output.put(static_cast<char>(colour >> 8));
+			this->output.put(static_cast<char>(colour));
+		}
+
+		// Loop forever
+		this->output.write("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+	}
+
+	// @param delay How long to show the frame for, in hundredths of a second.
+	void write(const std::vector<uint8_t> &image, unsigned delay) {
+		// Graphic control extension holding the delay, a delay is at most 16 bits so long frames are written several times
+		do {
+			auto part = std::min(delay, 0xFFFFu);
+			delay -= part;
+
+			this->output.write("\x21\xF9\x04\x00", 4);
+			this->writeShort(part);
+			this->output.write("\x00\x00", 2);
+
+			this->output.put(0x2C);
+			this->writeShort(0);
+			this->writeShort(0);
+			this->writeShort(this->width);
+			this->writeShort(this->height);
+			this->output.put(0);
+			this->writeLzw(image);
+		} while (delay > 0);
+	}
+
+	void finish() {
+		this->output.put(0x3B);
+		this->output.flush();
+	}
+
+private:
+	static constexpr unsigned MIN_CODE_SIZE = 4;
+	static constexpr unsigned MAX_CODE = 4095;
+
+	std::ostream &output;
+	unsigned width;
+	unsigned height;
+
+	// Codes are packed least significant bit first into sub-blocks of up to 255 bytes
+	std::vector<char> block;
+	uint32_t bits = 0;
+	unsigned bit_count = 0;
+
+	void writeShort(unsigned value) {
+		this->output.put(static_cast<char>(value & 0xFF));
+		this->output.put(static_cast<char>(value >> 8 & 0xFF));
+	}
+
+	void writeCode(unsigned code, unsigned size) {
+		this->bits |= code << this->bit_count;
+		this->bit_count += size;
+		while (this->bit_count >= 8) {
+			this->writeByte(static_cast<char>(this->bits & 0xFF));
+			this->bits >>= 8;
+			this->bit_count -= 8;
+		}
+	}
+
+	void writeByte(char byte) {
+		this->block.push_back(byte);
+		if (this->block.size() == 255) {
+			this->flushBlock();
+		}
+	}
+
+	void flushBlock() {
+		if (!this->block.empty()) {
+			this->output.put(static_cast<char>(this->block.size()));
+			this->output.write(this->block.data(), static_cast<std::streamsize>(this->block.size()));
+			this->block.clear();
+		}
+	}
+
+	void writeLzw(const std::vector<uint8_t> &image) {
+		constexpr unsigned clear = 1u << MIN_CODE_SIZE;
+		constexpr unsigned end = clear + 1;
+
+		// Code for each string extended by each colour, 0 if there isn't one yet (no string's code is ever 0)
+		std::vector<uint16_t> table((MAX_CODE + 1) * clear);
+		unsigned code_size = MIN_CODE_SIZE + 1;
+		unsigned last_code = end;
+
+		this->output.put(static_cast<char>(MIN_CODE_SIZE));
+		this->writeCode(clear, code_size);
+
+		unsigned prefix = image.front();
+		for (std::size_t index = 1; index < image.size(); ++index) {
+			auto &entry = table[prefix * clear + image[index]];
+			if (entry != 0) {
+				prefix = entry;
+				continue;
+			}
+
+			this->writeCode(prefix, code_size);
+			entry = static_cast<uint16_t>(++last_code);
+			if (last_code >= 1u << code_size) {
+				++code_size;
+			}
+			if (last_code == MAX_CODE) {
+				this->writeCode(clear, code_size);
+				std::fill(table.begin(), table.end(), 0);
+				code_size = MIN_CODE_SIZE + 1;
+				last_code = end;
+			}
+			prefix = image[index];
+		}
+
+		this->writeCode(prefix, code_size);
+		this->writeCode(end, code_size);
+		if (this->bit_count > 0) {
+			this->writeByte(static_cast<char>(this->bits & 0xFF));
+			this->bits = 0;
+			this->bit_count = 0;
+		}
+		this->flushBlock();
+		this->output.put(0);
+	}
+};
+
+// When a frame starts, in hundredths of a second
+unsigned long long frame_time(unsigned long long frame) {
+	return frame * 100 / FRAMES_PER_SECOND;
+}
+
+int main(int argc, char **argv) {
+	bool gif = false;
+	bool unique = false;
+	unsigned scale = 1;
+	std::vector<std::string> paths;
+
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option(argv[arg]);
+		if (option == "--gif") {
+			gif = true;
+		}
+		else if (option == "--pbm") {
+			gif = false;
+		}
+		else if (option == "--scale" && arg + 1 < argc) {
+			scale = std::max(1u, static_cast<unsigned>(std::stoul(argv[++arg])));
+		}
+		else if (option == "--unique") {
+			unique = true;
+		}
+		else {
+			paths.push_back(option);
+		}
+	}
+
+	if (paths.size() != 2) {
+		std::cerr << "Usage: " << argv[0] << " [--gif | --pbm] [--scale N] [--unique] <stream> <output or ->\n";
+		return 1;
+	}
+
+	std::ifstream input(paths[0], std::ios::binary);
+	Chip8FrameReader frames(input);
+	if (!input || !frames.isValid()) {
+		std::cerr << "Unable to read a frame stream from " << paths[0] << "\n";
+		return 1;
+	}
+
+	std::ofstream file;
+	if (paths[1] != "-") {
+		file.open(paths[1], std::ios::binary);
+		if (!file) {
+			std::cerr << "Unable to write " << paths[1] << "\n";
+			return 1;
+		}
+	}
+	std::ostream &output = paths[1] != "-" ? file : std::cout;
+
+	const unsigned width = Chip8Display::HIRES_WIDTH * scale;
+	const unsigned height = Chip8Display::HIRES_HEIGHT * scale;
+	unsigned long long written = 0;
+
+	if (!gif) {
+		while (frames.next()) {
+			if (unique && !frames.isChanged()) {
+				continue;
+			}
+			write_pbm(output, render(frames, scale), width, height);
+			++written;
+		}
+	}
+	else {
+		// Each frame is held back until the next change shows how long it lasts
+		GifWriter writer(output, width, height);
+		std::vector<uint8_t> pending;
+		unsigned long long pending_start = 0;
+		while (frames.next()) {
+			if (!frames.isChanged()) {
+				continue;
+			}
+
+			auto start = frames.getFrameCount() - 1;
+			if (!pending.empty() && frame_time(start) - frame_time(pending_start) >= 2) {
+				writer.write(pending, static_cast<unsigned>(frame_time(start) - frame_time(pending_start)));
+				++written;
+				pending_start = start;
+			}
+			else if (pending.empty()) {
+				pending_start = start;
+			}
+			pending = render(frames, scale);
+		}
+
+		if (!pending.empty()) {
+			writer.write(pending, static_cast<unsigned>(std::max<unsigned long long>(frame_time(frames.getFrameCount()) - frame_time(pending_start), 2)));
+			++written;
+		}
+		writer.finish();
+	}
+
+	std::fprintf(stderr, "%llu frames read, %llu images written\n", frames.getFrameCount(), written);
+	return output ? 0 : 1;
+}
@@ -0,0 +1,1202 @@
+// Fuzzer.cpp : Differential fuzzer checking that the optimised engines behave exactly like the reference VM.
+//
+// Usage: Fuzzer [--engine reference|fast|jit|batch] [--variant chip8|schip|xochip] [--quirks vip|chip48|schip|octo] [--threads N] [--seconds N]
+//               [--cases N] [--instructions N] [--lanes N] [--max-failures N] [--seed N] [--output DIR] [rom...]
+//
+// A case is a ROM and an input log (see Chip8InputLog): the RNG seed, how often the timers tick and a trace of key events. Each round picks a ROM and runs
+// --lanes cases with it (default 8), each with its own random seed and key events. ROMs are either generated from scratch, biased towards programs that keep
+// running (jumps and calls land inside the ROM, I mostly points at the ROM or the font), or mutated from a corpus made up of the ROM files given on the
+// command line and earlier ROMs that kept running for at least half of their budget (--instructions, default 10000).
+//
+// Every case is first run on a Chip8ReferenceVm one step() at a time, recording a hash of the state (registers, pc, i, call stack, sound timer, whether it
+// is running and the display) at the end of every basic block: after every instruction that doesn't continue to the next one, and before every key event.
+// Each engine under test (all of them, or only the one given with --engine) then runs the case with run(), stopping at each of those points to compare:
+//  - reference: Chip8ReferenceVm::run(), with superinstructions and idle loop skipping
+//  - fast, jit: Chip8FastVm with the JIT off and on
+//  - batch: every case of the round as lanes of one Chip8BatchVm, Octo quirks only. Lanes don't keep pc once they halt so it isn't compared then.
+// The first case of each round is also run one doFrame() at a time with frame clocked timers on Chip8ReferenceVm and the fast and jit engines, comparing
+// the instructions executed and the state after every frame. Frames are limited to the log's instructions per tick, and ROMs holding an idle loop are run
+// again without a limit, where a frame only ends on its own once the VM halts, waits for a key or reaches the idle loop.
+// SUPER-CHIP and XO-CHIP (--variant) are only supported by the reference engine. Without --quirks each round picks a platform at random.
+//
+// Each worker thread (one per core by default) constructs its VMs once and load()s every ROM into them, restoring a snapshot taken after loading between
+// the cases of a round, so the cost of a case is running it.
+//
+// Before fuzzing starts the ROMs of earlier divergences (REGRESSIONS) are run on every engine and platform under test, without key events.
+//
+// A case that diverges is minimised while it still diverges on the same engine: the run is cut short at the first block that differs, the seed is set
+// to 0 and the timers to tick every instruction, key events are dropped, and the ROM is truncated and has instructions replaced with 8000 (V0 = V0,
+// which changes nothing). The result is written to the --output directory (the current directory by default) as <name>.ch8 and <name>.c8il along with
+// a BatchRunner manifest <name>.txt replaying it, and the states both VMs ended up in are printed. Fuzzing stops after --max-failures divergences
+// (default 10), --cases cases, or --seconds (default 60, 0 for no limit).
+//
+// Progress is reported on stderr every few seconds. The exit code is 1 if any case diverged.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Emulator/Chip8BatchVm.h"
+#include "../Emulator/Chip8FastVm.h"
+#include "../Emulator/Chip8InputLog.h"
+#include "../Emulator/Chip8Random.h"
+#include "../Emulator/Chip8ReferenceVm.h"
+
+using Variant = Chip8ReferenceVm::Variant;
+using Rom = std::vector<std::byte>;
+
+enum class Engine {
+	Reference,
+	Fast,
+	Jit,
+	Batch
+};
+
+const char *engine_name(Engine engine) {
+	switch (engine) {
+	case Engine::Reference: return "reference";
+	case Engine::Fast: return "fast";
+	case Engine::Jit: return "jit";
+	case Engine::Batch: return "batch";
+	}
+	return "";
+}
+
+const char *platform_name(Chip8Platform platform) {
+	switch (platform) {
+	case Chip8Platform::CosmacVip: return "vip";
+	case Chip8Platform::Chip48: return "chip48";
+	case Chip8Platform::SuperChip: return "schip";
+	case Chip8Platform::Octo: return "octo";
+	}
+	return "";
+}
+
+const char *variant_name(Variant variant) {
+	switch (variant) {
+	case Variant::Chip8: return "chip8";
+	case Variant::SuperChip: return "schip";
+	case Variant::XoChip: return "xochip";
+	}
+	return "";
+}
+
+constexpr std::array<Chip8Platform, 4> PLATFORMS = { Chip8Platform::CosmacVip, Chip8Platform::Chip48, Chip8Platform::SuperChip, Chip8Platform::Octo };
+
+// V0 = V0, fills instructions removed from a ROM while minimising without moving anything after them
+constexpr uint16_t NOP = 0x8000;
+
+// Upper limit on the cases run to minimise one divergence
+constexpr unsigned MAX_MINIMISE_RUNS = 4096;
+
+// How many ROMs that kept running each worker keeps around to mutate
+constexpr std::size_t MAX_FOUND_ROMS = 64;
+
+// ROMs that engines diverged on before, checked before fuzzing starts
+const std::vector<Rom> REGRESSIONS = {
+	// V0 = FF, BFFF jumps to 10FE past the end of memory. Halting leaves pc there rather than at 1000.
+	{ std::byte{ 0x60 }, std::byte{ 0xFF }, std::byte{ 0xBF }, std::byte{ 0xFF } },
+	// Puts 00EE at 004 and calls 000, running the zeros before it as 0NNN. Then F355 at FFE wraps around to write 6A07 (VA = 07) at 000, which has to
+	// replace what was run from there before.
+	{
+		std::byte{ 0xA0 }, std::byte{ 0x04 }, std::byte{ 0x60 }, std::byte{ 0x00 }, std::byte{ 0x61 }, std::byte{ 0xEE }, std::byte{ 0xF1 }, std::byte{ 0x55 }, std::byte{ 0x20 }, std::byte{ 0x00 },
+		std::byte{ 0xAF }, std::byte{ 0xFE }, std::byte{ 0x60 }, std::byte{ 0x00 }, std::byte{ 0x61 }, std::byte{ 0x00 }, std::byte{ 0x62 }, std::byte{ 0x6A }, std::byte{ 0x63 }, std::byte{ 0x07 }, std::byte{ 0xF3 }, std::byte{ 0x55 },
+		std::byte{ 0x20 }, std::byte{ 0x00 }, std::byte{ 0x12 }, std::byte{ 0x18 },
+	},
+	// VA = 3C, sets the delay timer from it and waits in an idle loop at 204 before starting over. Without a frame limit every frame ends right after the
+	// FX07, 3 instructions in.
+	{
+		std::byte{ 0x6A }, std::byte{ 0x3C }, std::byte{ 0xFA }, std::byte{ 0x15 }, std::byte{ 0xFA }, std::byte{ 0x07 }, std::byte{ 0x3A }, std::byte{ 0x00 },
+		std::byte{ 0x12 }, std::byte{ 0x04 }, std::byte{ 0x12 }, std::byte{ 0x00 },
+	},
+};
+
+struct Settings {
+	Variant variant = Variant::Chip8;
+	std::optional<Chip8Platform> platform;
+	std::vector<Engine> engines = { Engine::Reference, Engine::Fast, Engine::Jit, Engine::Batch };
+	unsigned long long instructions = 10000;
+	std::size_t lanes = 8;
+	uint32_t seed = 0;
+	unsigned max_failures = 10;
+	std::filesystem::path output = ".";
+
+	std::size_t getMaxRomSize() const {
+		return (this->variant == Variant::XoChip ? 64 * 1024 : 4096) - 0x200;
+	}
+};
+
+struct Case {
+	Rom rom;
+	Chip8Platform platform = Chip8Platform::Octo;
+	Chip8InputLog log;
+};
+
+// Uniformly distributed value in [0, bound)
+uint32_t below(Chip8Random &random, uint32_t bound) {
+	return static_cast<uint32_t>(static_cast<uint64_t>(random.next()) * bound >> 32);
+}
+
+/**
+* A random instruction, weighted towards ones that keep a program running.
+*
+* @param rom_size Jumps, calls and most ANNN land inside a ROM of this many bytes loaded at 0x200.
+*/
+uint16_t generate_instruction(Chip8Random &random, std::size_t rom_size, Variant variant) {
+	const bool super_chip = variant != Variant::Chip8;
+	const bool xo_chip = variant == Variant::XoChip;
+
+	const uint16_t x = static_cast<uint16_t>(below(random, 16) << 8);
+	const uint16_t y = static_cast<uint16_t>(below(random, 16) << 4);
+	const uint16_t n = static_cast<uint16_t>(below(random, 16));
+	const uint16_t nn = static_cast<uint16_t>(below(random, 256));
+
+	// Mostly instruction aligned, odd addresses are valid targets too
+	auto target = [&]() {
+		auto offset = below(random, static_cast<uint32_t>(std::max<std::size_t>(rom_size, 2)));
+		return static_cast<uint16_t>(0x200 + (below(random, 16) == 0 ? offset : offset & ~1u));
+	};
+
+	if (below(random, 16) == 0) {
+		return static_cast<uint16_t>(random.next());
+	}
+
+	switch (below(random, 16))
+	{
+	case 0x0: {
+		static constexpr uint16_t chip8[] = { 0x00E0, 0x00EE, 0x0000 };
+		static constexpr uint16_t schip[] = { 0x00E0, 0x00EE, 0x0000, 0x00C0, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF };
+		if (!super_chip) {
+			return chip8[below(random, std::size(chip8))];
+		}
+		auto opcode = schip[below(random, std::size(schip))];
+		if (opcode == 0x00C0) {
+			// 00CN scrolls down, XO-CHIP adds 00DN to scroll up
+			return static_cast<uint16_t>((xo_chip && below(random, 2) ? 0x00D0 : 0x00C0) | n);
+		}
+		return opcode;
+	}
+
+	case 0x1:
+		return static_cast<uint16_t>(0x1000 | (target() & 0xFFF));
+
+	case 0x2:
+		return static_cast<uint16_t>(0x2000 | (target() & 0xFFF));
+
+	case 0xB:
+		return static_cast<uint16_t>(0xB000 | (target() & 0xFFF));
+
+	case 0x5:
+		return static_cast<uint16_t>(0x5000 | x | y | (xo_chip ? below(random, 4) : 0));
+
+	case 0x8: {
+		static constexpr uint16_t operations[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+		return static_cast<uint16_t>(0x8000 | x | y | operations[below(random, std::size(operations))]);
+	}
+
+	case 0x9:
+		return static_cast<uint16_t>(0x9000 | x | y);
+
+	case 0xA: {
+		// The ROM itself, the font or anywhere at all
+		auto choice = below(random, 4);
+		return static_cast<uint16_t>(0xA000 | (choice < 2 ? target() : choice == 2 ? 0x50 + below(random, 80) : below(random, 0x1000)));
+	}
+
+	case 0xD:
+		return static_cast<uint16_t>(0xD000 | x | y | n);
+
+	case 0xE:
+		return static_cast<uint16_t>(x | (below(random, 2) ? 0xE09E : 0xE0A1));
+
+	case 0xF: {
+		static constexpr uint16_t chip8[] = { 0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65 };
+		static constexpr uint16_t schip[] = { 0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65, 0x30, 0x75, 0x85 };
+		static constexpr uint16_t xochip[] = { 0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65, 0x30, 0x75, 0x85, 0x00, 0x01, 0x02, 0x3A };
+		if (xo_chip) {
+			auto operation = xochip[below(random, std::size(xochip))];
+			// F000 NNNN takes the next instruction as its address, FN01 selects planes
+			return static_cast<uint16_t>(operation == 0x00 || operation == 0x02 ? 0xF000 | operation : 0xF000 | x | operation);
+		}
+		if (super_chip) {
+			return static_cast<uint16_t>(0xF000 | x | schip[below(random, std::size(schip))]);
+		}
+		return static_cast<uint16_t>(0xF000 | x | chip8[below(random, std::size(chip8))]);
+	}
+
+	default:
+		// 3XNN, 4XNN, 6XNN, 7XNN and CXNN
+		break;
+	}
+
+	static constexpr uint16_t immediate[] = { 0x3000, 0x4000, 0x6000, 0x7000, 0xC000 };
+	return static_cast<uint16_t>(immediate[below(random, std::size(immediate))] | x | nn);
+}
+
+void put_instruction(Rom &rom, std::size_t offset, uint16_t instruction) {
+	rom[offset] = std::byte(instruction >> 8);
+	rom[offset + 1] = std::byte(instruction & 0xFF);
+}
+
+void generate_rom(Chip8Random &random, Variant variant, Rom &rom) {
+	auto instructions = 1 + below(random, 128);
+	rom.assign(instructions * 2, std::byte{ 0 });
+	for (std::size_t offset = 0; offset < rom.size(); offset += 2) {
+		put_instruction(rom, offset, generate_instruction(random, rom.size(), variant));
+	}
+
+	// Sprite or other data after the code
+	if (below(random, 2)) {
+		auto data = below(random, 32);
+		for (std::size_t byte = 0; byte < data; ++byte) {
+			rom.push_back(std::byte(below(random, 256)));
+		}
+	}
+}
+
+void mutate_rom(Chip8Random &random, Variant variant, std::size_t max_size, Rom &rom) {
+	auto mutations = 1 + below(random, 4);
+	for (unsigned mutation = 0; mutation < mutations; ++mutation) {
+		if (rom.size() < 2) {
+			rom.resize(2);
+		}
+
+		auto offset = below(random, static_cast<uint32_t>(rom.size() - 1));
+		switch (below(random, 5))
+		{
+		case 0:
+			// Replace an instruction
+			put_instruction(rom, offset, generate_instruction(random, rom.size(), variant));
+			break;
+
+		case 1:
+			// Flip a bit
+			rom[offset] ^= std::byte(1 << below(random, 8));
+			break;
+
+		case 2:
+			// Insert an instruction, moving everything after it
+			if (rom.size() + 2 <= max_size) {
+				rom.insert(rom.begin() + offset, 2, std::byte{ 0 });
+				put_instruction(rom, offset, generate_instruction(random, rom.size(), variant));
+			}
+			break;
+
+		case 3:
+			// Remove an instruction
+			if (rom.size() > 2) {
+				rom.erase(rom.begin() + offset, rom.begin() + offset + 2);
+			}
+			break;
+
+		default: {
+			// Copy a run of bytes over another
+			auto source = below(random, static_cast<uint32_t>(rom.size()));
+			auto length = std::min<std::size_t>({ 1 + below(random, 16), rom.size() - source, rom.size() - offset });
+			Rom bytes(rom.cbegin() + source, rom.cbegin() + source + length);
+			std::copy(bytes.cbegin(), bytes.cend(), rom.begin() + offset);
+			break;
+		}
+		}
+	}
+}
+
+void generate_log(Chip8Random &random, unsigned long long length, unsigned long instructions_per_tick, Chip8InputLog &log) {
+	log = {};
+	log.seed = random.next();
+	log.instructions_per_tick = instructions_per_tick;
+	log.length = length;
+
+	auto events = below(random, 16);
+	for (unsigned event = 0; event < events; ++event) {
+		log.events.push_back({ below(random, static_cast<uint32_t>(length)), static_cast<uint8_t>(below(random, 16)), below(random, 2) != 0 });
+	}
+	std::stable_sort(log.events.begin(), log.events.end(), [](const auto &a, const auto &b) { return a.instruction < b.instruction; });
+}
+
+enum class RunState : uint8_t {
+	Running,
+	Blocked,
+	Halted
+};
+
+const char *run_state_name(RunState state) {
+	switch (state) {
+	case RunState::Running: return "running";
+	case RunState::Blocked: return "blocked";
+	case RunState::Halted: return "halted";
+	}
+	return "";
+}
+
+// Everything compared between engines, read from a VM or a lane of a Chip8BatchVm.
+struct State {
+	RunState run_state = RunState::Running;
+	std::array<uint8_t, 16> v{};
+	uint_fast16_t pc = 0;
+	uint_fast16_t i = 0;
+	std::array<uint16_t, 16> call_stack{};
+	uint_fast8_t stack_depth = 0;
+	unsigned sound = 0;
+	const Chip8Display *display = nullptr;
+};
+
+template<typename Vm>
+State get_state(const Vm &vm) {
+	return {
+		vm.isRunning() ? RunState::Running : vm.isLive() ? RunState::Blocked : RunState::Halted,
+		vm.getRegisters(),
+		vm.getProgramCounter(),
+		vm.getAddressRegister(),
+		vm.getCallStack(),
+		vm.getStackDepth(),
+		static_cast<unsigned>(vm.getSoundTimer()),
+		&vm.getDisplayBuffer()
+	};
+}
+
+State get_state(const Chip8BatchVm &vm, std::size_t lane) {
+	return {
+		vm.isRunning(lane) ? RunState::Running : vm.isLive(lane) ? RunState::Blocked : RunState::Halted,
+		vm.getRegisters(lane),
+		vm.getProgramCounter(lane),
+		vm.getAddressRegister(lane),
+		vm.getCallStack(lane),
+		vm.getStackDepth(lane),
+		static_cast<unsigned>(vm.getSoundTimer(lane)),
+		&vm.getDisplayBuffer(lane)
+	};
+}
+
+uint64_t mix(uint64_t hash, uint64_t word) {
+	hash = (hash ^ word) * 0x9E3779B97F4A7C15;
+	return hash ^ hash >> 29;
+}
+
+// @param halted_pc Whether pc is hashed once the VM halts, Chip8BatchVm doesn't keep it so it's left out when comparing against a lane.
+uint64_t hash_state(const State &state, bool halted_pc = true) {
+	uint64_t hash = mix(0, static_cast<uint64_t>(state.run_state) << 8 | state.sound);
+	for (std::size_t index = 0; index < state.v.size(); index += 8) {
+		uint64_t word = 0;
+		for (std::size_t byte = 0; byte < 8; ++byte) {
+			word = word << 8 | state.v[index + byte];
+		}
+		hash = mix(hash, word);
+	}
+	hash = mix(hash, (state.run_state == RunState::Halted && !halted_pc ? 0 : state.pc) << 16 | state.i);
+	for (std::size_t index = 0; index < state.call_stack.size(); index += 4) {
+		hash = mix(hash, static_cast<uint64_t>(state.call_stack[index]) << 48 | static_cast<uint64_t>(state.call_stack[index + 1]) << 32 |
+			static_cast<uint64_t>(state.call_stack[index + 2]) << 16 | state.call_stack[index + 3]);
+	}
+	hash = mix(hash, state.stack_depth);
+	return mix(hash, state.display->getHash());
+}
+
+void print_state(std::ostream &output, const char *name, const State &state) {
+	char registers[16 * 2 + 1];
+	for (std::size_t index = 0; index < state.v.size(); ++index) {
+		std::snprintf(registers + index * 2, 3, "%02X", state.v[index]);
+	}
+
+	std::string stack;
+	for (uint_fast8_t depth = 0; depth < state.stack_depth; ++depth) {
+		char entry[8];
+		std::snprintf(entry, sizeof(entry), depth == 0 ? "%03X" : ",%03X", state.call_stack[depth]);
+		stack += entry;
+	}
+
+	char line[256];
+	std::snprintf(line, sizeof(line), "  %-10s state=%s pc=%03X i=%03X v=%s stack=[%s] sound=%u display=%016llX\n", name, run_state_name(state.run_state),
+		static_cast<unsigned>(state.pc), static_cast<unsigned>(state.i), registers, stack.c_str(), state.sound,
+		static_cast<unsigned long long>(state.display->getHash()));
+	output << line;
+}
+
+// The end of a basic block in the reference run of a case
+struct Checkpoint {
+	unsigned long long instruction;
+	uint64_t hash;
+	uint64_t lane_hash; // As compared against a Chip8BatchVm lane, see hash_state()
+};
+
+template<typename Vm, typename Iterator>
+void apply_events(Vm &vm, const Chip8InputLog &log, Iterator &event, unsigned long long executed) {
+	// Same as Chip8InputLog::replay(), a VM waiting for a key gets the next event straight away
+	while (event != log.events.cend() && (event->instruction <= executed || !vm.isRunning())) {
+		vm.setKeyState(event->key, event->pressed);
+		++event;
+	}
+}
+
+// Run a case one instruction at a time on a freshly loaded reference VM, recording a checkpoint at the end of every basic block.
+void trace(Chip8ReferenceVm &vm, const Chip8InputLog &log, std::vector<Checkpoint> &checkpoints) {
+	vm.seed(log.seed);
+	vm.setTimerMode(Chip8ReferenceVm::TimerMode::Instruction, log.instructions_per_tick);
+	checkpoints.clear();
+
+	auto event = log.events.cbegin();
+	unsigned long long executed = 0;
+	while (executed < log.length && vm.isLive()) {
+		apply_events(vm, log, event, executed);
+		if (!vm.isRunning()) {
+			break;
+		}
+
+		auto target = event != log.events.cend() ? std::min(log.length, event->instruction) : log.length;
+		do {
+			auto pc = vm.getProgramCounter();
+			vm.step();
+			++executed;
+			if (vm.getProgramCounter() != pc + 2) {
+				break;
+			}
+		} while (executed < target && vm.isRunning());
+
+		auto state = get_state(vm);
+		checkpoints.push_back({ executed, hash_state(state), hash_state(state, false) });
+	}
+}
+
+/**
+* Run a case on a freshly loaded VM, stopping at every checkpoint of the reference run to compare states.
+*
+* @return Index of the first checkpoint the VM didn't reach in the same state, checkpoints.size() if there is none.
+*/
+template<typename Vm>
+std::size_t compare(Vm &vm, const Chip8InputLog &log, const std::vector<Checkpoint> &checkpoints) {
+	vm.seed(log.seed);
+	vm.setTimerMode(Vm::TimerMode::Instruction, log.instructions_per_tick);
+
+	auto event = log.events.cbegin();
+	unsigned long long executed = 0;
+	for (std::size_t index = 0; index < checkpoints.size(); ++index) {
+		apply_events(vm, log, event, executed);
+
+		const auto &checkpoint = checkpoints[index];
+		executed += vm.run(static_cast<unsigned long>(checkpoint.instruction - executed));
+		if (executed != checkpoint.instruction || hash_state(get_state(vm)) != checkpoint.hash) {
+			return index;
+		}
+	}
+	return checkpoints.size();
+}
+
+/**
+* As compare() for a case per lane of a freshly loaded Chip8BatchVm, all lanes run together up to their next checkpoint. Every log must have the same
+* instructions_per_tick.
+*
+* @param mismatches Receives the index of the first checkpoint each lane didn't reach in the same state, the size of its checkpoints if there is none.
+*/
+void compare_batch(Chip8BatchVm &vm, const std::vector<Chip8InputLog> &logs, const std::vector<std::vector<Checkpoint>> &checkpoints, std::vector<std::size_t> &mismatches) {
+	vm.setInstructionsPerTick(logs.front().instructions_per_tick);
+
+	std::vector<std::vector<Chip8InputLog::Event>::const_iterator> events;
+	std::vector<std::size_t> next(logs.size(), 0);
+	mismatches.resize(logs.size());
+	for (std::size_t lane = 0; lane < logs.size(); ++lane) {
+		vm.seed(lane, logs[lane].seed);
+		events.push_back(logs[lane].events.cbegin());
+		mismatches[lane] = checkpoints[lane].size();
+	}
+
+	auto pending = [&](std::size_t lane) {
+		return next[lane] < checkpoints[lane].size() && mismatches[lane] == checkpoints[lane].size();
+	};
+
+	for (bool running = true; running;) {
+		running = false;
+		for (std::size_t lane = 0; lane < logs.size(); ++lane) {
+			auto executed = vm.getInstructionCount(lane);
+			if (!pending(lane)) {
+				vm.setInstructionLimit(lane, executed);
+				continue;
+			}
+
+			auto &event = events[lane];
+			while (event != logs[lane].events.cend() && (event->instruction <= executed || !vm.isRunning(lane))) {
+				vm.setKeyState(lane, event->key, event->pressed);
+				++event;
+			}
+			vm.setInstructionLimit(lane, checkpoints[lane][next[lane]].instruction);
+			running = true;
+		}
+
+		if (!running) {
+			break;
+		}
+
+		vm.run();
+		for (std::size_t lane = 0; lane < logs.size(); ++lane) {
+			if (!pending(lane)) {
+				continue;
+			}
+
+			const auto &checkpoint = checkpoints[lane][next[lane]];
+			if (vm.getInstructionCount(lane) != checkpoint.instruction || hash_state(get_state(vm, lane), false) != checkpoint.lane_hash) {
+				mismatches[lane] = next[lane];
+			}
+			else {
+				++next[lane];
+			}
+		}
+	}
+}
+
+// The end of a doFrame() call
+struct Frame {
+	unsigned long instructions;
+	uint64_t hash;
+};
+
+// Whether a ROM holds an FX07 / 3X00 / 1NNN loop jumping back to its FX07, which a VM reaching it without a frame limit ends the frame on
+bool has_idle_loop(const Rom &rom) {
+	for (std::size_t offset = 0; offset + 5 < rom.size(); ++offset) {
+		auto address = 0x200 + offset;
+		auto byte = [&](std::size_t index) { return std::to_integer<unsigned>(rom[offset + index]); };
+		if ((byte(0) & 0xF0) == 0xF0 && byte(1) == 0x07 && byte(2) == (0x30 | (byte(0) & 0xF)) && byte(3) == 0x00 &&
+			byte(4) == (0x10 | (address >> 8 & 0xF)) && byte(5) == (address & 0xFF)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Frame limits (see setEmulationSpeed()) a case is run with by doFrame(): its instructions per tick, and no limit at all if the ROM holds an idle loop.
+// Without a limit any other ROM would run until the deadline of every frame.
+std::vector<unsigned long> frame_limits(const Case &c) {
+	std::vector<unsigned long> limits = { c.log.instructions_per_tick };
+	if (has_idle_loop(c.rom)) {
+		limits.push_back(0);
+	}
+	return limits;
+}
+
+/**
+* Run a case one doFrame() at a time with frame clocked timers, recording every frame until the log's length is reached.
+*
+* Without a frame limit a frame ends once the VM halts, waits for a key or reaches an idle loop, or else at its deadline. Where the deadline falls depends
+* on the host, so recording stops at the first frame that doesn't end well before it.
+*/
+void trace_frames(Chip8ReferenceVm &vm, const Chip8InputLog &log, unsigned long frame_limit, std::vector<Frame> &frames) {
+	vm.seed(log.seed);
+	vm.setTimerMode(Chip8ReferenceVm::TimerMode::Frame);
+	vm.setEmulationSpeed(frame_limit);
+	frames.clear();
+
+	auto event = log.events.cbegin();
+	unsigned long long executed = 0;
+	while (executed < log.length && vm.isLive()) {
+		apply_events(vm, log, event, executed);
+		if (!vm.isRunning()) {
+			break;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto instructions = vm.doFrame();
+		if (frame_limit == 0 && std::chrono::steady_clock::now() - start >= Chip8Timers::tick_interval / 4) {
+			break;
+		}
+
+		executed += instructions;
+		frames.push_back({ instructions, hash_state(get_state(vm)) });
+	}
+}
+
+/**
+* Run a case on a freshly loaded VM one doFrame() at a time as trace_frames() did, comparing the instructions executed and the state after every frame.
+*
+* @return Index of the first frame that differs, frames.size() if there is none.
+*/
+template<typename Vm>
+std::size_t compare_frames(Vm &vm, const Chip8InputLog &log, unsigned long frame_limit, const std::vector<Frame> &frames) {
+	vm.seed(log.seed);
+	vm.setTimerMode(Vm::TimerMode::Frame);
+	vm.setEmulationSpeed(frame_limit);
+
+	auto event = log.events.cbegin();
+	unsigned long long executed = 0;
+	for (std::size_t index = 0; index < frames.size(); ++index) {
+		apply_events(vm, log, event, executed);
+
+		auto instructions = vm.doFrame();
+		executed += instructions;
+		if (instructions != frames[index].instructions || hash_state(get_state(vm)) != frames[index].hash) {
+			return index;
+		}
+	}
+	return frames.size();
+}
+
+/**
+* Counters and divergence reports shared by every worker.
+*/
+class Results {
+public:
+	std::atomic<unsigned long long> cases = 0;
+	std::atomic<unsigned long long> instructions = 0;
+	std::atomic<unsigned> failures = 0;
+
+	explicit Results(const Settings &settings) :
+		settings(settings)
+	{
+	}
+
+	/**
+	* Write a minimised case to the output directory and print a report of it, unless an identical case was already reported.
+	*
+	* @param states Description of the state each VM ended up in.
+	*/
+	void report(const Case &failing, Engine engine, const std::string &states) {
+		uint64_t hash = mix(0, static_cast<uint64_t>(engine) << 8 | static_cast<uint64_t>(failing.platform));
+		for (auto byte : failing.rom) {
+			hash = mix(hash, std::to_integer<uint64_t>(byte));
+		}
+		// The log records which VM to replay it on, so BatchRunner needs no --variant or --quirks for it
+		auto recorded = failing.log;
+		recorded.variant = this->settings.variant;
+		recorded.platform = failing.platform;
+		std::ostringstream log;
+		recorded.write(log);
+		for (auto byte : log.str()) {
+			hash = mix(hash, static_cast<uint8_t>(byte));
+		}
+
+		std::scoped_lock lock(this->mutex);
+		if (!this->reported.insert(hash).second) {
+			return;
+		}
+		++this->failures;
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "divergence-%s-%016llx", engine_name(engine), static_cast<unsigned long long>(hash));
+		auto base = this->settings.output / name;
+		auto rom_path = std::filesystem::path(base).replace_extension(".ch8");
+		auto log_path = std::filesystem::path(base).replace_extension(".c8il");
+		auto manifest_path = std::filesystem::path(base).replace_extension(".txt");
+
+		std::ofstream(rom_path, std::ios::binary).write(reinterpret_cast<const char *>(failing.rom.data()), failing.rom.size());
+		std::ofstream(log_path, std::ios::binary) << log.str();
+		std::ofstream(manifest_path) << rom_path.string() << " " << log_path.string() << " 0\n";
+
+		std::cout << name << " engine=" << engine_name(engine) << " variant=" << variant_name(this->settings.variant) << " quirks=" << platform_name(failing.platform)
+			<< " rom=" << failing.rom.size() << " bytes, " << failing.log.length << " instructions, " << failing.log.events.size() << " key events\n"
+			<< "  BatchRunner --engine " << engine_name(engine) << " --instructions-per-tick " << failing.log.instructions_per_tick << " " << manifest_path.string() << "\n"
+			<< states << std::flush;
+	}
+
+private:
+	const Settings &settings;
+
+	std::mutex mutex;
+	std::set<uint64_t> reported;
+};
+
+/**
+* Generates and runs rounds of cases on one thread, every VM it uses is constructed once and reused for every case.
+*/
+class Worker {
+public:
+	Worker(const Settings &settings, const std::vector<Rom> &corpus, Results &results, unsigned index) :
+		settings(settings),
+		corpus(corpus),
+		results(results),
+		random(settings.seed + index),
+		logs(settings.lanes),
+		checkpoints(settings.lanes)
+	{
+	}
+
+	void runRound() {
+		this->nextRom();
+		this->platform = this->settings.platform.value_or(PLATFORMS[below(this->random, static_cast<uint32_t>(PLATFORMS.size()))]);
+
+		// Lanes of a Chip8BatchVm share how often the timers tick
+		auto instructions_per_tick = 1 + below(this->random, 32);
+		for (auto &log : this->logs) {
+			generate_log(this->random, this->settings.instructions, instructions_per_tick, log);
+		}
+
+		auto &vms = this->getVms(this->platform);
+		vms.oracle.load(this->rom);
+		auto start = vms.oracle.snapshot();
+		bool kept_running = false;
+		for (std::size_t lane = 0; lane < this->logs.size(); ++lane) {
+			if (lane > 0) {
+				vms.oracle.restore(start);
+			}
+			trace(vms.oracle, this->logs[lane], this->checkpoints[lane]);
+
+			auto executed = this->checkpoints[lane].empty() ? 0 : this->checkpoints[lane].back().instruction;
+			this->results.instructions += executed;
+			kept_running |= executed * 2 >= this->settings.instructions;
+		}
+
+		if (kept_running) {
+			if (this->found.size() < MAX_FOUND_ROMS) {
+				this->found.push_back(this->rom);
+			}
+			else {
+				this->found[below(this->random, MAX_FOUND_ROMS)] = this->rom;
+			}
+		}
+
+		for (auto engine : this->settings.engines) {
+			if (!this->supports(engine, this->platform)) {
+				continue;
+			}
+
+			switch (engine)
+			{
+			case Engine::Reference:
+				this->compareLanes(vms.reference, engine);
+				break;
+
+			case Engine::Fast:
+				this->compareLanes(vms.fast, engine);
+				this->compareFrames(engine);
+				break;
+
+			case Engine::Jit:
+				this->compareLanes(vms.jit, engine);
+				this->compareFrames(engine);
+				break;
+
+			case Engine::Batch: {
+				auto &batch = this->getBatch(this->settings.lanes);
+				batch.load(this->rom);
+				compare_batch(batch, this->logs, this->checkpoints, this->mismatches);
+				for (std::size_t lane = 0; lane < this->logs.size(); ++lane) {
+					if (this->mismatches[lane] < this->checkpoints[lane].size()) {
+						this->diverged(lane, engine);
+					}
+				}
+				break;
+			}
+			}
+		}
+
+		this->results.cases += this->logs.size();
+	}
+
+	// Run every ROM in REGRESSIONS on every engine and platform under test without any key events.
+	void runRegressions() {
+		for (const auto &rom : REGRESSIONS) {
+			for (auto platform : PLATFORMS) {
+				if (this->settings.platform && platform != *this->settings.platform) {
+					continue;
+				}
+
+				Case regression{ rom, platform, {} };
+				// Timers ticking every instruction would leave Chip8Jit running one instruction at a time, never a whole block
+				regression.log.instructions_per_tick = 32;
+				regression.log.length = this->settings.instructions;
+				for (auto engine : this->settings.engines) {
+					if (!this->supports(engine, platform)) {
+						continue;
+					}
+
+					std::string states;
+					if (this->check(regression, engine, &states)) {
+						this->results.report(regression, engine, states);
+					}
+				}
+				++this->results.cases;
+			}
+		}
+	}
+
+private:
+	const Settings &settings;
+	const std::vector<Rom> &corpus;
+	Results &results;
+
+	Chip8Random random;
+
+	// ROMs generated or mutated by this worker that kept running for at least half of their budget
+	std::vector<Rom> found;
+
+	Rom rom;
+	Chip8Platform platform = Chip8Platform::Octo;
+	std::vector<Chip8InputLog> logs;
+	std::vector<std::vector<Checkpoint>> checkpoints;
+	std::vector<std::size_t> mismatches;
+
+	// The reference VM stepping one instruction at a time, and a VM for each engine under test
+	struct Vms {
+		Vms(Variant variant, Chip8Platform platform) :
+			oracle(Rom{}, variant, platform),
+			reference(Rom{}, variant, platform),
+			fast(Rom{}, platform),
+			jit(Rom{}, platform)
+		{
+			this->jit.setJitEnabled(true);
+		}
+
+		Chip8ReferenceVm oracle;
+		Chip8ReferenceVm reference;
+		Chip8FastVm fast;
+		Chip8FastVm jit;
+	};
+	std::array<std::unique_ptr<Vms>, PLATFORMS.size()> vms;
+
+	// One with a lane per case of a round and one with a single lane for minimising
+	std::unique_ptr<Chip8BatchVm> batch;
+	std::unique_ptr<Chip8BatchVm> single_batch;
+
+	bool supports(Engine engine, Chip8Platform platform) const {
+		return engine == Engine::Reference || (this->settings.variant == Variant::Chip8 && (engine != Engine::Batch || platform == Chip8Platform::Octo));
+	}
+
+	Vms &getVms(Chip8Platform platform) {
+		auto &vms = this->vms[static_cast<std::size_t>(platform)];
+		if (!vms) {
+			vms = std::make_unique<Vms>(this->settings.variant, platform);
+		}
+		return *vms;
+	}
+
+	Chip8BatchVm &getBatch(std::size_t lanes) {
+		auto &batch = lanes == 1 ? this->single_batch : this->batch;
+		if (!batch) {
+			batch = std::make_unique<Chip8BatchVm>(Rom{}, lanes);
+		}
+		return *batch;
+	}
+
+	// Mutate a ROM from the corpus or generate a new one
+	void nextRom() {
+		auto corpus_size = this->corpus.size() + this->found.size();
+		if (corpus_size == 0 || below(this->random, 2) == 0) {
+			generate_rom(this->random, this->settings.variant, this->rom);
+			return;
+		}
+
+		auto entry = below(this->random, static_cast<uint32_t>(corpus_size));
+		this->rom = entry < this->corpus.size() ? this->corpus[entry] : this->found[entry - this->corpus.size()];
+		mutate_rom(this->random, this->settings.variant, this->settings.getMaxRomSize(), this->rom);
+	}
+
+	template<typename Vm>
+	void compareLanes(Vm &vm, Engine engine) {
+		vm.load(this->rom);
+		auto start = vm.snapshot();
+		for (std::size_t lane = 0; lane < this->logs.size(); ++lane) {
+			if (lane > 0) {
+				vm.restore(start);
+			}
+			if (compare(vm, this->logs[lane], this->checkpoints[lane]) < this->checkpoints[lane].size()) {
+				this->diverged(lane, engine);
+			}
+		}
+	}
+
+	// Run the first case of the round with doFrame() as well, it costs as much as every lane with run()
+	void compareFrames(Engine engine) {
+		if (this->checkFrames({ this->rom, this->platform, this->logs.front() }, engine)) {
+			this->diverged(0, engine);
+		}
+	}
+
+	/**
+	* Run a single case on the reference VM and one engine, with run() and then with doFrame() (see checkFrames()).
+	*
+	* @param states Receives the state of both VMs at the end of the run (or where they diverged) if given.
+	* @return The instruction count at the end of the first block or frame where the engine diverged, if it does.
+	*/
+	std::optional<unsigned long long> check(const Case &c, Engine engine, std::string *states = nullptr) {
+		std::vector<Checkpoint> checkpoints;
+		auto &vms = this->getVms(c.platform);
+		vms.oracle.load(c.rom);
+		trace(vms.oracle, c.log, checkpoints);
+
+		std::ostringstream output;
+		if (states) {
+			print_state(output, "reference", get_state(vms.oracle));
+		}
+
+		std::size_t mismatch = checkpoints.size();
+		auto compare_vm = [&](auto &vm) {
+			vm.load(c.rom);
+			mismatch = compare(vm, c.log, checkpoints);
+			if (states) {
+				print_state(output, engine_name(engine), get_state(vm));
+			}
+		};
+
+		switch (engine)
+		{
+		case Engine::Reference:
+			compare_vm(vms.reference);
+			break;
+
+		case Engine::Fast:
+			compare_vm(vms.fast);
+			break;
+
+		case Engine::Jit:
+			compare_vm(vms.jit);
+			break;
+
+		case Engine::Batch: {
+			auto &batch = this->getBatch(1);
+			batch.load(c.rom);
+			std::vector<std::size_t> mismatches;
+			compare_batch(batch, { c.log }, { checkpoints }, mismatches);
+			mismatch = mismatches.front();
+			if (states) {
+				print_state(output, engine_name(engine), get_state(batch, 0));
+			}
+			break;
+		}
+		}
+
+		if (states) {
+			*states = output.str();
+		}
+		if (mismatch == checkpoints.size()) {
+			return this->checkFrames(c, engine, states);
+		}
+		return checkpoints[mismatch].instruction;
+	}
+
+	/**
+	* Run a single case one doFrame() at a time on Chip8ReferenceVm and one engine, with every frame limit from frame_limits(). Only Chip8FastVm is
+	* checked: Chip8ReferenceVm is what it's compared against and Chip8BatchVm has no frames.
+	*
+	* @param states Replaced with the state of both VMs at the end of the run if the engine diverged.
+	* @return The instruction count at the end of the first frame where the engine diverged, if it does.
+	*/
+	std::optional<unsigned long long> checkFrames(const Case &c, Engine engine, std::string *states = nullptr) {
+		if (engine != Engine::Fast && engine != Engine::Jit) {
+			return std::nullopt;
+		}
+
+		auto &vms = this->getVms(c.platform);
+		auto &vm = engine == Engine::Jit ? vms.jit : vms.fast;
+		std::vector<Frame> frames;
+		for (auto frame_limit : frame_limits(c)) {
+			vms.oracle.load(c.rom);
+			trace_frames(vms.oracle, c.log, frame_limit, frames);
+			vm.load(c.rom);
+			auto mismatch = compare_frames(vm, c.log, frame_limit, frames);
+			if (mismatch == frames.size()) {
+				continue;
+			}
+
+			if (states) {
+				std::ostringstream output;
+				output << "  doFrame() with frame limit " << frame_limit << " differs at frame " << mismatch << "\n";
+				print_state(output, "reference", get_state(vms.oracle));
+				print_state(output, engine_name(engine), get_state(vm));
+				*states = output.str();
+			}
+
+			unsigned long long instructions = 0;
+			for (std::size_t index = 0; index <= mismatch; ++index) {
+				instructions += frames[index].instructions;
+			}
+			return instructions;
+		}
+		return std::nullopt;
+	}
+
+	void diverged(std::size_t lane, Engine engine) {
+		Case failing{ this->rom, this->platform, this->logs[lane] };
+		if (!this->minimise(failing, engine)) {
+			// Didn't diverge when run on its own (e.g. state left over from an earlier case), report it as it is
+			failing = { this->rom, this->platform, this->logs[lane] };
+		}
+
+		std::string states;
+		this->check(failing, engine, &states);
+		this->results.report(failing, engine, states);
+	}
+
+	/**
+	* Shrink a case that diverges on an engine while keeping it diverging.
+	*
+	* @return false if the case doesn't diverge on its own.
+	*/
+	bool minimise(Case &failing, Engine engine) {
+		unsigned runs = 0;
+		auto diverges = [&](Case &candidate) {
+			if (runs++ >= MAX_MINIMISE_RUNS) {
+				return false;
+			}
+
+			// Nothing after the block that differs matters
+			auto point = this->check(candidate, engine);
+			if (point) {
+				candidate.log.length = *point;
+			}
+			return point.has_value();
+		};
+
+		if (!diverges(failing)) {
+			return false;
+		}
+
+		// The same bug found by several cases of a round often only differs in the seed and timers
+		for (auto simplify : { +[](Case &c) { c.log.seed = 0; }, +[](Case &c) { c.log.instructions_per_tick = 1; } }) {
+			auto candidate = failing;
+			simplify(candidate);
+			if (diverges(candidate)) {
+				failing = std::move(candidate);
+			}
+		}
+
+		for (auto event = failing.log.events.size(); event-- > 0;) {
+			auto candidate = failing;
+			candidate.log.events.erase(candidate.log.events.begin() + event);
+			if (diverges(candidate)) {
+				failing = std::move(candidate);
+			}
+		}
+
+		for (auto chunk = std::bit_floor(std::max<std::size_t>(failing.rom.size(), 2)); chunk >= 2; chunk /= 2) {
+			while (failing.rom.size() > chunk) {
+				auto candidate = failing;
+				candidate.rom.resize(candidate.rom.size() - chunk);
+				if (!diverges(candidate)) {
+					break;
+				}
+				failing = std::move(candidate);
+			}
+
+			for (std::size_t start = 0; start + 1 < failing.rom.size(); start += chunk) {
+				auto candidate = failing;
+				bool changed = false;
+				for (auto offset = start; offset < start + chunk && offset + 1 < candidate.rom.size(); offset += 2) {
+					changed |= candidate.rom[offset] != std::byte(NOP >> 8) || candidate.rom[offset + 1] != std::byte(NOP & 0xFF);
+					put_instruction(candidate.rom, offset, NOP);
+				}
+				if (changed && diverges(candidate)) {
+					failing = std::move(candidate);
+				}
+			}
+		}
+
+		return true;
+	}
+};
+
+bool read_file_into_rom(const std::filesystem::path &file_name, Rom &rom) {
+	std::ifstream file(file_name, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	std::transform(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), std::back_inserter(rom), [](char c) -> std::byte { return std::byte(c); });
+	return true;
+}
+
+int main(int argc, char **argv) {
+	Settings settings;
+	std::size_t thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+	std::chrono::duration<double> duration(60.0);
+	unsigned long long case_limit = 0;
+	std::vector<Rom> corpus;
+
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option(argv[arg]);
+		if (option == "--engine" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			settings.engines = { name == "reference" ? Engine::Reference : name == "jit" ? Engine::Jit : name == "batch" ? Engine::Batch : Engine::Fast };
+		}
+		else if (option == "--variant" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			settings.variant = name == "xochip" ? Variant::XoChip : name == "schip" ? Variant::SuperChip : Variant::Chip8;
+		}
+		else if (option == "--quirks" && arg + 1 < argc) {
+			std::string name(argv[++arg]);
+			settings.platform = name == "vip" ? Chip8Platform::CosmacVip : name == "chip48" ? Chip8Platform::Chip48 : name == "schip" ? Chip8Platform::SuperChip : Chip8Platform::Octo;
+		}
+		else if (option == "--threads" && arg + 1 < argc) {
+			thread_count = std::max<std::size_t>(std::stoul(argv[++arg]), 1);
+		}
+		else if (option == "--seconds" && arg + 1 < argc) {
+			duration = std::chrono::duration<double>(std::stod(argv[++arg]));
+		}
+		else if (option == "--cases" && arg + 1 < argc) {
+			case_limit = std::stoull(argv[++arg]);
+		}
+		else if (option == "--instructions" && arg + 1 < argc) {
+			settings.instructions = std::max<unsigned long long>(std::stoull(argv[++arg]), 1);
+		}
+		else if (option == "--lanes" && arg + 1 < argc) {
+			settings.lanes = std::max<std::size_t>(std::stoul(argv[++arg]), 1);
+		}
+		else if (option == "--max-failures" && arg + 1 < argc) {
+			settings.max_failures = std::max(static_cast<unsigned>(std::stoul(argv[++arg])), 1u);
+		}
+		else if (option == "--seed" && arg + 1 < argc) {
+			settings.seed = static_cast<uint32_t>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--output" && arg + 1 < argc) {
+			settings.output = argv[++arg];
+		}
+		else {
+			Rom rom;
+			if (!read_file_into_rom(option, rom)) {
+				std::cerr << "Unable to read " << option << "\n";
+				return 1;
+			}
+			rom.resize(std::min(rom.size(), settings.getMaxRomSize()));
+			corpus.push_back(std::move(rom));
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(settings.output, error);
+
+	Results results(settings);
+	auto start = std::chrono::steady_clock::now();
+	auto report_progress = [&]() {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		auto seconds = std::max(elapsed.count(), 1e-9);
+		std::fprintf(stderr, "%.0fs: %llu cases (%.2f million/hour), %.1f million reference instructions/sec, %u divergences\n", elapsed.count(),
+			results.cases.load(), results.cases / seconds * 3600 / 1e6, results.instructions / seconds / 1e6, results.failures.load());
+	};
+
+	{
+		std::vector<std::jthread> workers;
+		for (unsigned index = 0; index < thread_count; ++index) {
+			workers.emplace_back([&, index](std::stop_token stop) {
+				Worker worker(settings, corpus, results, index);
+				if (index == 0) {
+					worker.runRegressions();
+				}
+				while (!stop.stop_requested()) {
+					worker.runRound();
+				}
+			});
+		}
+
+		auto next_report = start + std::chrono::seconds(5);
+		while (results.failures < settings.max_failures && (case_limit == 0 || results.cases < case_limit) &&
+			(duration.count() <= 0 || std::chrono::steady_clock::now() - start < duration)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			if (std::chrono::steady_clock::now() >= next_report) {
+				report_progress();
+				next_report += std::chrono::seconds(5);
+			}
+		}
+	}
+
+	report_progress();
+	return results.failures > 0 ? 1 : 0;
+}